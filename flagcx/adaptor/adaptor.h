@@ -95,6 +95,9 @@ struct flagcxCCLAdaptor {
   // Group semantics
   flagcxResult_t (*groupStart)();
   flagcxResult_t (*groupEnd)();
+
+  // Sets supported to 0 if coll is not implemented, NULL if all are
+  flagcxResult_t (*collSupported)(flagcxCollType_t coll, int *supported);
 };
 
 const int MAX_VENDOR_LEN = 128;
@@ -109,6 +112,11 @@ struct flagcxDeviceAdaptor {
   flagcxResult_t (*deviceMemcpy)(void *dst, void *src, size_t size,
                                  flagcxMemcpyType_t type, flagcxStream_t stream,
                                  void *args);
+  // copies height rows of width bytes, spitch and dpitch bytes apart
+  flagcxResult_t (*deviceMemcpy2D)(void *dst, size_t dpitch, const void *src,
+                                   size_t spitch, size_t width, size_t height,
+                                   flagcxMemcpyType_t type,
+                                   flagcxStream_t stream);
   flagcxResult_t (*deviceMemset)(void *ptr, int value, size_t size,
                                  flagcxMemType_t type, flagcxStream_t stream);
   flagcxResult_t (*deviceMalloc)(void **ptr, size_t size, flagcxMemType_t type,
@@ -84,29 +84,29 @@ flagcxResult_t bootstrapAdaptorCommGetAsyncError(flagcxInnerComm_t comm,
 }
 
 
-// TODO: unsupported
 flagcxResult_t bootstrapAdaptorGather(const void *sendbuff, void *recvbuff,
                                       size_t count, flagcxDataType_t datatype,
                                       int root, flagcxInnerComm_t comm,
                                       flagcxStream_t /*stream*/) {
-  return flagcxNotSupported;
+  FLAGCXCHECK(GatherBootstrap(comm->base, sendbuff, recvbuff, count, datatype, root));
+  return flagcxSuccess;
 }
 
-// TODO: unsupported
 flagcxResult_t bootstrapAdaptorScatter(const void *sendbuff, void *recvbuff,
                                        size_t count, flagcxDataType_t datatype,
                                        int root, flagcxInnerComm_t comm,
                                        flagcxStream_t /*stream*/) {
-  return flagcxNotSupported;
+  FLAGCXCHECK(ScatterBootstrap(comm->base, sendbuff, recvbuff, count, datatype, root));
+  return flagcxSuccess;
 }
 
-// TODO: unsupported
 flagcxResult_t bootstrapAdaptorBroadcast(const void *sendbuff, void *recvbuff,
                                          size_t count,
                                          flagcxDataType_t datatype, int root,
                                          flagcxInnerComm_t comm,
                                          flagcxStream_t /*stream*/) {
-  return flagcxNotSupported;
+  FLAGCXCHECK(BroadcastBootstrap(comm->base, sendbuff, recvbuff, count, datatype, root));
+  return flagcxSuccess;
 }
 
 flagcxResult_t bootstrapAdaptorAllReduce(const void *sendbuff, void *recvbuff, size_t count,
@@ -151,13 +151,13 @@ flagcxResult_t bootstrapAdaptorAlltoAll(const void *sendbuff, void *recvbuff,
   return flagcxSuccess;
 }
 
-// TODO: unsupported
 flagcxResult_t
 bootstrapAdaptorAlltoAllv(const void *sendbuff, size_t *sendcounts,
                           size_t *sdispls, void *recvbuff, size_t *recvcounts,
                           size_t *rdispls, flagcxDataType_t datatype,
                           flagcxInnerComm_t comm, flagcxStream_t /*stream*/) {
-  return flagcxNotSupported;
+  FLAGCXCHECK(AlltoAllvBootstrap(comm->base, sendbuff, sendcounts, sdispls, recvbuff, recvcounts, rdispls, datatype));
+  return flagcxSuccess;
 }
 
 #define BOOTSTRAP_SEND_RECV_TAG -6767
@@ -25,6 +25,21 @@ flagcxResult_t cudaAdaptorDeviceMemcpy(void *dst, void *src, size_t size,
   return flagcxSuccess;
 }
 
+flagcxResult_t cudaAdaptorDeviceMemcpy2D(void *dst, size_t dpitch,
+                                         const void *src, size_t spitch,
+                                         size_t width, size_t height,
+                                         flagcxMemcpyType_t type,
+                                         flagcxStream_t stream) {
+  if (stream == NULL) {
+    DEVCHECK(cudaMemcpy2D(dst, dpitch, src, spitch, width, height,
+                          memcpy_type_map[type]));
+  } else {
+    DEVCHECK(cudaMemcpy2DAsync(dst, dpitch, src, spitch, width, height,
+                               memcpy_type_map[type], stream->base));
+  }
+  return flagcxSuccess;
+}
+
 flagcxResult_t cudaAdaptorDeviceMemset(void *ptr, int value, size_t size,
                                        flagcxMemType_t type,
                                        flagcxStream_t stream) {
@@ -279,9 +294,9 @@ struct flagcxDeviceAdaptor cudaAdaptor {
   "CUDA",
       // Basic functions
       cudaAdaptorDeviceSynchronize, cudaAdaptorDeviceMemcpy,
-      cudaAdaptorDeviceMemset, cudaAdaptorDeviceMalloc, cudaAdaptorDeviceFree,
-      cudaAdaptorSetDevice, cudaAdaptorGetDevice, cudaAdaptorGetDeviceCount,
-      cudaAdaptorGetVendor,
+      cudaAdaptorDeviceMemcpy2D, cudaAdaptorDeviceMemset,
+      cudaAdaptorDeviceMalloc, cudaAdaptorDeviceFree, cudaAdaptorSetDevice,
+      cudaAdaptorGetDevice, cudaAdaptorGetDeviceCount, cudaAdaptorGetVendor,
       // GDR functions
       NULL, // flagcxResult_t (*memHandleInit)(int dev_id, void **memHandle);
       NULL, // flagcxResult_t (*memHandleDestroy)(int dev, void *memHandle);
@@ -196,14 +196,64 @@ flagcxResult_t glooAdaptorAlltoAll(const void *sendbuff, void *recvbuff,
   return flagcxSuccess;
 }
 
-// TODO: unsupported
+// Point-to-point exchange over unbound buffers rather than ::gloo::alltoallv,
+// which needs the extents of the peers back to back in rank order. Peers
+// without data to exchange are skipped.
 flagcxResult_t glooAdaptorAlltoAllv(const void *sendbuff, size_t *sendcounts,
                                     size_t *sdispls, void *recvbuff,
                                     size_t *recvcounts, size_t *rdispls,
                                     flagcxDataType_t datatype,
                                     flagcxInnerComm_t comm,
                                     flagcxStream_t /*stream*/) {
-  return flagcxNotSupported;
+  size_t typeSize = getFlagcxDataTypeSize(datatype);
+  int rank = comm->base->rank;
+  int nranks = comm->base->size;
+  const char *src = static_cast<const char *>(sendbuff);
+  char *dst = static_cast<char *>(recvbuff);
+
+  // in place: keep a copy of the send extents, the receives may overwrite them
+  std::vector<char> tmpbuff;
+  if (sendbuff == recvbuff) {
+    size_t extent = 0;
+    for (int i = 0; i < nranks; i++) {
+      if (sendcounts[i] > 0)
+        extent = std::max(extent, (sdispls[i] + sendcounts[i]) * typeSize);
+    }
+    tmpbuff.assign(src, src + extent);
+    src = tmpbuff.data();
+  }
+  if (sendcounts[rank] > 0 &&
+      src + sdispls[rank] * typeSize != dst + rdispls[rank] * typeSize) {
+    memcpy(dst + rdispls[rank] * typeSize, src + sdispls[rank] * typeSize,
+           sendcounts[rank] * typeSize);
+  }
+
+  // all ranks take the same slot, the exchange is collective
+  uint64_t slot = comm->base->nextSlot();
+  std::vector<buffer_ptr> sends, recvs;
+  for (int k = 1; k < nranks; k++) {
+    int sendPeer = (rank + k) % nranks;
+    int recvPeer = (rank - k + nranks) % nranks;
+    if (recvcounts[recvPeer] > 0) {
+      recvs.push_back(comm->base->createUnboundBuffer(
+          dst + rdispls[recvPeer] * typeSize,
+          recvcounts[recvPeer] * typeSize));
+      recvs.back()->recv(recvPeer, slot);
+    }
+    if (sendcounts[sendPeer] > 0) {
+      sends.push_back(comm->base->createUnboundBuffer(
+          const_cast<char *>(src) + sdispls[sendPeer] * typeSize,
+          sendcounts[sendPeer] * typeSize));
+      sends.back()->send(sendPeer, slot);
+    }
+  }
+  for (auto &buf : recvs) {
+    buf->waitRecv(flagcxGlooDefaultTimeout);
+  }
+  for (auto &buf : sends) {
+    buf->waitSend(flagcxGlooDefaultTimeout);
+  }
+  return flagcxSuccess;
 }
 
 flagcxResult_t glooAdaptorSend(const void *sendbuff, size_t count,
@@ -248,6 +298,22 @@ flagcxResult_t glooAdaptorGroupEnd() {
   return flagcxSuccess;
 }
 
+flagcxResult_t glooAdaptorCollSupported(flagcxCollType_t coll,
+                                        int *supported) {
+  switch (coll) {
+  case flagcxCollBroadcast:
+  case flagcxCollReduce:
+  case flagcxCollReduceScatter:
+  case flagcxCollGather:
+  case flagcxCollScatter:
+    *supported = 0;
+    break;
+  default:
+    *supported = 1;
+  }
+  return flagcxSuccess;
+}
+
 struct flagcxCCLAdaptor glooAdaptor = {
     "GLOO",
     // Basic functions
@@ -264,6 +330,8 @@ struct flagcxCCLAdaptor glooAdaptor = {
     glooAdaptorAllGather, glooAdaptorAlltoAll, glooAdaptorAlltoAllv,
     glooAdaptorSend, glooAdaptorRecv,
     // Group semantics
-    glooAdaptorGroupStart, glooAdaptorGroupEnd};
+    glooAdaptorGroupStart, glooAdaptorGroupEnd,
+    // Support queries
+    glooAdaptorCollSupported};
 
 #endif // USE_GLOO_ADAPTOR
\ No newline at end of file
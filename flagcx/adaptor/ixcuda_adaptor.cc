@@ -25,6 +25,21 @@ flagcxResult_t ixcudaAdaptorDeviceMemcpy(void *dst, void *src, size_t size,
   return flagcxSuccess;
 }
 
+flagcxResult_t ixcudaAdaptorDeviceMemcpy2D(void *dst, size_t dpitch,
+                                           const void *src, size_t spitch,
+                                           size_t width, size_t height,
+                                           flagcxMemcpyType_t type,
+                                           flagcxStream_t stream) {
+  if (stream == NULL) {
+    DEVCHECK(cudaMemcpy2D(dst, dpitch, src, spitch, width, height,
+                          memcpy_type_map[type]));
+  } else {
+    DEVCHECK(cudaMemcpy2DAsync(dst, dpitch, src, spitch, width, height,
+                               memcpy_type_map[type], stream->base));
+  }
+  return flagcxSuccess;
+}
+
 flagcxResult_t ixcudaAdaptorDeviceMemset(void *ptr, int value, size_t size,
                                          flagcxMemType_t type,
                                          flagcxStream_t stream) {
@@ -279,8 +294,9 @@ struct flagcxDeviceAdaptor ixcudaAdaptor {
   "IXCUDA",
       // Basic functions
       ixcudaAdaptorDeviceSynchronize, ixcudaAdaptorDeviceMemcpy,
-      ixcudaAdaptorDeviceMemset, ixcudaAdaptorDeviceMalloc,
-      ixcudaAdaptorDeviceFree, ixcudaAdaptorSetDevice, ixcudaAdaptorGetDevice,
+      ixcudaAdaptorDeviceMemcpy2D, ixcudaAdaptorDeviceMemset,
+      ixcudaAdaptorDeviceMalloc, ixcudaAdaptorDeviceFree,
+      ixcudaAdaptorSetDevice, ixcudaAdaptorGetDevice,
       ixcudaAdaptorGetDeviceCount, ixcudaAdaptorGetVendor,
       // GDR functions
       NULL, // flagcxResult_t (*memHandleInit)(int dev_id, void **memHandle);
@@ -25,6 +25,25 @@ flagcxResult_t mluAdaptorDeviceMemcpy(void *dst, void *src, size_t size,
   return flagcxSuccess;
 }
 
+// one copy per row
+flagcxResult_t mluAdaptorDeviceMemcpy2D(void *dst, size_t dpitch,
+                                        const void *src, size_t spitch,
+                                        size_t width, size_t height,
+                                        flagcxMemcpyType_t type,
+                                        flagcxStream_t stream) {
+  for (size_t i = 0; i < height; i++) {
+    char *rowDst = (char *)dst + i * dpitch;
+    char *rowSrc = (char *)src + i * spitch;
+    if (stream == NULL) {
+      DEVCHECK(cnrtMemcpy(rowDst, rowSrc, width, memcpy_type_map[type]));
+    } else {
+      DEVCHECK(cnrtMemcpyAsync_V2(rowDst, rowSrc, width, stream->base,
+                                  memcpy_type_map[type]));
+    }
+  }
+  return flagcxSuccess;
+}
+
 flagcxResult_t mluAdaptorDeviceMemset(void *ptr, int value, size_t size,
                                       flagcxMemType_t type,
                                       flagcxStream_t stream) {
@@ -259,9 +278,9 @@ struct flagcxDeviceAdaptor mluAdaptor {
   "MLU",
       // Basic functions
       mluAdaptorDeviceSynchronize, mluAdaptorDeviceMemcpy,
-      mluAdaptorDeviceMemset, mluAdaptorDeviceMalloc, mluAdaptorDeviceFree,
-      mluAdaptorSetDevice, mluAdaptorGetDevice, mluAdaptorGetDeviceCount,
-      mluAdaptorGetVendor,
+      mluAdaptorDeviceMemcpy2D, mluAdaptorDeviceMemset, mluAdaptorDeviceMalloc,
+      mluAdaptorDeviceFree, mluAdaptorSetDevice, mluAdaptorGetDevice,
+      mluAdaptorGetDeviceCount, mluAdaptorGetVendor,
       // GDR functions
       NULL, // flagcxResult_t (*memHandleInit)(int dev_id, void **memHandle);
       NULL, // flagcxResult_t (*memHandleDestroy)(int dev, void *memHandle);
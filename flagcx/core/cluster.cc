@@ -55,10 +55,12 @@ flagcxResult_t flagcxCollectClusterInfos(const flagcxVendor *allData,
   }
 
   if (*type == flagcxCommunicatorHybrid) {
+    // the inter rank is the first gateway of the cluster, see
+    // c2cSelectGateways for the others
     const char *useDev = flagcxGetEnv("FLAGCX_USEDEV");
     int useDev_;
     if (useDev == NULL) {
-      useDev_ = -1;
+      useDev_ = 0;
     } else {
       useDev_ = std::stoi(useDev);
     }
@@ -1,4 +1,5 @@
 #include "collectives.h"
+#include "compress.h"
 #include "type.h"
 #include "transport.h"
 #include "net.h"
@@ -20,6 +21,7 @@ flagcxResult_t flagcxHeteroSend(const void* sendbuff, size_t count, flagcxDataTy
     p2p->bytes = count*getFlagcxDataTypeSize(datatype);
     p2p->chunk = 0;
     p2p->stream = stream;
+    p2p->codec = comm->compress && datatype == flagcxFloat ? comm->codec : flagcxCodecNone;
     if(flagcxIntruQueueEmpty(&tasks->peers[peer].sendQueue)) tasks->p2pOrder[tasks->p2pOrderSteps++]=peer;
     flagcxIntruQueueEnqueue(&tasks->peers[peer].sendQueue, p2p);
 
@@ -45,6 +47,7 @@ flagcxResult_t flagcxHeteroRecv(void* recvbuff, size_t count, flagcxDataType_t d
     p2p->bytes = count*getFlagcxDataTypeSize(datatype);
     p2p->chunk = 0;
     p2p->stream = stream;
+    p2p->codec = comm->compress && datatype == flagcxFloat ? comm->codec : flagcxCodecNone;
     if(flagcxIntruQueueEmpty(&tasks->peers[peer].recvQueue)) tasks->p2pOrder[tasks->p2pOrderSteps++]=peer;
     flagcxIntruQueueEnqueue(&tasks->peers[peer].recvQueue, p2p);
 
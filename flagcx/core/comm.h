@@ -192,6 +192,8 @@ struct flagcxHeteroComm {
   int netDev;                 // my net  device index
   int nvmlDev;                // my nvml device index
   int compCap;                // compute capability of the GPU
+  int codec;                  // flagcxCodec_t of the fp32 transfers
+  int compress;               // whether the next transfers use codec
   int minCompCap, maxCompCap; // min/max compute capability in the communicator
   int64_t busId;              // my PCI bus ID in int format
   cpu_set_t cpuAffinity;      // CPU affinity of the GPU
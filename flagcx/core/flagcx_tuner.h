@@ -55,6 +55,17 @@ typedef struct {
 
 typedef flagcxTuner_v2_t flagcxTuner_t;
 
+// Algorithms of the collectives of heterogeneous communicators, returned by
+// getCollInfo in algorithm (nNodes is then the number of clusters). The choice
+// must be the same on all ranks for a given collective and size. Returning
+// FLAGCX_HETERO_ALGO_UNDEF or an algorithm the collective does not support
+// falls back to the built-in cost model.
+#define FLAGCX_HETERO_ALGO_UNDEF -1
+#define FLAGCX_HETERO_ALGO_HOST 0       // staged through host memory, host comm
+#define FLAGCX_HETERO_ALGO_SINGLE_NIC 1 // one inter rank per cluster
+#define FLAGCX_HETERO_ALGO_MULTI_NIC 2  // every rank exchanges a shard
+#define FLAGCX_HETERO_NUM_ALGORITHMS 3
+
 #define FLAGCX_TUNER_PLUGIN_SYMBOL "flagcxTunerPlugin_v2"
 
 #endif
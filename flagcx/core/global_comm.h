@@ -30,6 +30,15 @@ struct flagcxComm {
   uint64_t magic;
   volatile uint32_t *abortFlag;
   int *cluster_sizes;
+  // first global rank of every cluster, nclusters + 1 entries
+  int *cluster_offsets;
+  // relative throughput of every cluster, the multi-NIC allreduce has each
+  // cluster reduce a share of the buffer proportional to it
+  int *cluster_weights;
+  // gateways of the clusters, ngateways per cluster starting with the inter
+  // rank, striping the inter-cluster phase of the single-NIC allreduce
+  int ngateways;
+  int *cluster_gateways;
   int *cluster_ids;
   int *cluster_inter_ranks;
   int *globalrank2homorank;
@@ -37,6 +46,27 @@ struct flagcxComm {
   flagcxInnerComm_t host_comm;
   flagcxInnerComm_t homo_comm;
   flagcxHeteroComm_t hetero_comm;
+  struct flagcxHostBufferPool *host_buffer_pool;
+  struct flagcxHostPipeline *host_pipeline;
+  // queues the host-comm collectives when FLAGCX_HOST_ASYNC is set
+  struct flagcxHostEngine *host_engine;
+  struct flagcxHeteroTuner *tuner;
+  // mask of the FLAGCX_HETERO_ALGO_* the environment leaves to the tuner
+  int hetero_algos;
+  // mask of the flagcxCollType_t the host adaptor implements
+  int host_colls;
+  // hetero collectives recorded inside flagcxGroupStart/End
+  struct flagcxC2cGroup *c2c_group;
+  // device flags of flagcxStreamBarrier, allocated on first use
+  void *barrier_buff;
+  // stream of the intra-cluster broadcasts that overlap the inter-cluster
+  // transfers of c2cInterBroadcast, created on first use
+  flagcxStream_t bcast_stream;
+  // completion of the staging copies of c2cReducePeers, created on first use
+  flagcxEvent_t reduce_events[2];
+  // staging buffers of c2cAlltoAllAggregated, grown on demand
+  void *alltoall_buff;
+  size_t alltoall_buff_size;
 };
 
 #endif // end include guard
\ No newline at end of file
@@ -145,6 +145,7 @@ static flagcxResult_t groupLaunch(struct flagcxAsyncJob *job_) {
           op->args.chunkSize = CHUNCKSIZE;
           op->args.chunkSteps = (p2p->bytes + CHUNCKSIZE - 1) / (CHUNCKSIZE);
           op->args.sendStepMask = MAXSENDSTEP - 1;
+          op->args.codec = p2p->codec;
           op->stream = p2p->stream;
           FLAGCXCHECK(deviceAdaptor->launchHostFunc(op->stream, cpuAsyncLaunch,
                                                     &op->args.hlArgs));
@@ -168,6 +169,7 @@ static flagcxResult_t groupLaunch(struct flagcxAsyncJob *job_) {
           op->args.chunkSize = CHUNCKSIZE;
           op->args.chunkSteps = (p2p->bytes + CHUNCKSIZE - 1) / (CHUNCKSIZE);
           op->args.sendStepMask = MAXSENDSTEP - 1;
+          op->args.codec = p2p->codec;
           op->stream = p2p->stream;
           FLAGCXCHECK(deviceAdaptor->launchHostFunc(op->stream, cpuAsyncLaunch,
                                                     &op->args.hlArgs));
@@ -0,0 +1,157 @@
+#include "host_buffer_pool.h"
+#include "adaptor.h"
+#include "alloc.h"
+#include "check.h"
+#include "debug.h"
+#include "param.h"
+
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+FLAGCX_PARAM(HostBufferPoolMaxBytes, "HOST_BUFFER_POOL_MAX_BYTES", 0);
+
+#define FLAGCX_HOST_BUFFER_MIN_CLASS 4096
+
+struct flagcxHostBufferPool {
+  std::mutex mutex;
+  // idle buffers by size class
+  std::map<size_t, std::vector<void *>> idle;
+  // size class of every buffer handed out
+  std::unordered_map<void *, size_t> busy;
+  // released inside a group, recycled at group end
+  std::vector<void *> deferred;
+  size_t idleBytes;
+  size_t maxIdleBytes;
+  int groupDepth;
+  // statistics, reported when the pool is destroyed
+  uint64_t hits;
+  uint64_t misses;
+  size_t allocatedBytes;
+};
+
+// Four classes per power of two bound the wasted space to 25%.
+static size_t hostBufferClass(size_t size) {
+  if (size <= FLAGCX_HOST_BUFFER_MIN_CLASS)
+    return FLAGCX_HOST_BUFFER_MIN_CLASS;
+  size_t step = ((size_t)1 << (63 - __builtin_clzll(size))) / 4;
+  return (size + step - 1) / step * step;
+}
+
+static flagcxResult_t hostBufferFree(struct flagcxHostBufferPool *pool,
+                                     void *buff, size_t cls) {
+  pool->allocatedBytes -= cls;
+  FLAGCXCHECK(deviceAdaptor->deviceFree(buff, flagcxMemHost, NULL));
+  return flagcxSuccess;
+}
+
+// Moves a buffer back to the idle lists, evicting idle buffers (largest
+// first) to stay within maxIdleBytes.
+static flagcxResult_t hostBufferRecycle(struct flagcxHostBufferPool *pool,
+                                        void *buff) {
+  auto it = pool->busy.find(buff);
+  size_t cls = it->second;
+  pool->busy.erase(it);
+  if (pool->maxIdleBytes > 0) {
+    if (cls > pool->maxIdleBytes) {
+      FLAGCXCHECK(hostBufferFree(pool, buff, cls));
+      return flagcxSuccess;
+    }
+    while (pool->idleBytes + cls > pool->maxIdleBytes) {
+      auto last = std::prev(pool->idle.end());
+      FLAGCXCHECK(hostBufferFree(pool, last->second.back(), last->first));
+      pool->idleBytes -= last->first;
+      last->second.pop_back();
+      if (last->second.empty())
+        pool->idle.erase(last);
+    }
+  }
+  pool->idle[cls].push_back(buff);
+  pool->idleBytes += cls;
+  return flagcxSuccess;
+}
+
+flagcxResult_t flagcxHostBufferPoolCreate(struct flagcxHostBufferPool **pool) {
+  *pool = new flagcxHostBufferPool();
+  (*pool)->maxIdleBytes =
+      std::max((int64_t)flagcxParamHostBufferPoolMaxBytes(), (int64_t)0);
+  return flagcxSuccess;
+}
+
+flagcxResult_t flagcxHostBufferPoolDestroy(struct flagcxHostBufferPool *pool) {
+  if (pool == NULL)
+    return flagcxSuccess;
+  if (!pool->busy.empty()) {
+    WARN("Host buffer pool destroyed with %zu buffers in use",
+         pool->busy.size());
+  }
+  INFO(FLAGCX_INIT,
+       "Host buffer pool: %lu hits, %lu misses, %zu bytes allocated",
+       pool->hits, pool->misses, pool->allocatedBytes);
+  for (auto &entry : pool->idle) {
+    for (void *buff : entry.second) {
+      FLAGCXCHECK(hostBufferFree(pool, buff, entry.first));
+    }
+  }
+  for (auto &entry : pool->busy) {
+    FLAGCXCHECK(hostBufferFree(pool, entry.first, entry.second));
+  }
+  delete pool;
+  return flagcxSuccess;
+}
+
+flagcxResult_t flagcxHostBufferAcquire(struct flagcxHostBufferPool *pool,
+                                       size_t size, void **buff) {
+  size_t cls = hostBufferClass(size);
+  std::lock_guard<std::mutex> lock(pool->mutex);
+  auto it = pool->idle.find(cls);
+  if (it != pool->idle.end()) {
+    *buff = it->second.back();
+    it->second.pop_back();
+    if (it->second.empty())
+      pool->idle.erase(it);
+    pool->idleBytes -= cls;
+    pool->hits++;
+  } else {
+    FLAGCXCHECK(deviceAdaptor->deviceMalloc(buff, cls, flagcxMemHost, NULL));
+    pool->allocatedBytes += cls;
+    pool->misses++;
+    TRACE(FLAGCX_ALLOC, "Host buffer pool: new %zu bytes buffer %p", cls,
+          *buff);
+  }
+  pool->busy[*buff] = cls;
+  return flagcxSuccess;
+}
+
+flagcxResult_t flagcxHostBufferRelease(struct flagcxHostBufferPool *pool,
+                                       void *buff) {
+  std::lock_guard<std::mutex> lock(pool->mutex);
+  if (pool->busy.find(buff) == pool->busy.end()) {
+    WARN("Host buffer pool: releasing unknown buffer %p", buff);
+    return flagcxInvalidArgument;
+  }
+  if (pool->groupDepth > 0) {
+    pool->deferred.push_back(buff);
+    return flagcxSuccess;
+  }
+  FLAGCXCHECK(hostBufferRecycle(pool, buff));
+  return flagcxSuccess;
+}
+
+flagcxResult_t flagcxHostBufferPoolGroupStart(struct flagcxHostBufferPool *pool) {
+  std::lock_guard<std::mutex> lock(pool->mutex);
+  pool->groupDepth++;
+  return flagcxSuccess;
+}
+
+flagcxResult_t flagcxHostBufferPoolGroupEnd(struct flagcxHostBufferPool *pool) {
+  std::lock_guard<std::mutex> lock(pool->mutex);
+  if (pool->groupDepth > 0 && --pool->groupDepth == 0) {
+    for (void *buff : pool->deferred) {
+      FLAGCXCHECK(hostBufferRecycle(pool, buff));
+    }
+    pool->deferred.clear();
+  }
+  return flagcxSuccess;
+}
@@ -0,0 +1,33 @@
+#ifndef FLAGCX_HOST_BUFFER_POOL_H_
+#define FLAGCX_HOST_BUFFER_POOL_H_
+
+#include "flagcx.h"
+#include <stddef.h>
+
+/*
+ * Per-communicator cache of pinned host buffers (deviceMalloc with
+ * flagcxMemHost) used to stage data on the host-comm path.
+ *
+ * Requests are rounded up to a size class (four classes per power of two) and
+ * served from the idle buffers of that class; new buffers are only allocated
+ * when none is idle. Released buffers are kept for reuse, up to
+ * FLAGCX_HOST_BUFFER_POOL_MAX_BYTES of idle memory if set (0: unbounded).
+ *
+ * Between flagcxHostBufferPoolGroupStart and flagcxHostBufferPoolGroupEnd,
+ * released buffers are only recycled when the group ends, since operations
+ * posted in the group may still be reading them.
+ */
+struct flagcxHostBufferPool;
+
+flagcxResult_t flagcxHostBufferPoolCreate(struct flagcxHostBufferPool **pool);
+flagcxResult_t flagcxHostBufferPoolDestroy(struct flagcxHostBufferPool *pool);
+
+flagcxResult_t flagcxHostBufferAcquire(struct flagcxHostBufferPool *pool,
+                                       size_t size, void **buff);
+flagcxResult_t flagcxHostBufferRelease(struct flagcxHostBufferPool *pool,
+                                       void *buff);
+
+flagcxResult_t flagcxHostBufferPoolGroupStart(struct flagcxHostBufferPool *pool);
+flagcxResult_t flagcxHostBufferPoolGroupEnd(struct flagcxHostBufferPool *pool);
+
+#endif // end include guard
@@ -0,0 +1,194 @@
+#include "host_engine.h"
+#include "adaptor.h"
+#include "check.h"
+#include "debug.h"
+#include "param.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <pthread.h>
+
+FLAGCX_PARAM(HostAsync, "HOST_ASYNC", 0);
+
+struct flagcxHostEngine;
+
+struct flagcxHostEngineTask {
+  struct flagcxHostEngine *engine;
+  flagcxHostTask_t fn;
+  flagcxStream_t stream;
+  // recorded on stream when the task is queued, NULL without a stream
+  flagcxEvent_t ready;
+  // set by the worker under the engine mutex
+  bool done;
+};
+
+struct flagcxHostEngine {
+  std::mutex mutex;
+  std::condition_variable queued;
+  std::condition_variable completed;
+  std::deque<struct flagcxHostEngineTask *> tasks;
+  // tasks queued and not completed yet, all on userStream
+  int pending;
+  flagcxStream_t userStream;
+  bool stop;
+  flagcxResult_t error;
+  int dev;
+  flagcxStream_t stream;
+  pthread_t thread;
+};
+
+// Engine whose worker is the calling thread
+static __thread struct flagcxHostEngine *hostEngineSelf = NULL;
+
+// Host function queued on the user stream: holds the stream until the task is
+// done, sleeping on the completion of the engine. Owns the task.
+static void hostEngineStreamWait(void *args) {
+  struct flagcxHostEngineTask *task = (struct flagcxHostEngineTask *)args;
+  struct flagcxHostEngine *engine = task->engine;
+  {
+    std::unique_lock<std::mutex> lock(engine->mutex);
+    engine->completed.wait(lock, [task] { return task->done; });
+  }
+  delete task;
+}
+
+static void *hostEngineWorker(void *args) {
+  struct flagcxHostEngine *engine = (struct flagcxHostEngine *)args;
+  hostEngineSelf = engine;
+  deviceAdaptor->setDevice(engine->dev);
+  while (true) {
+    struct flagcxHostEngineTask *task;
+    {
+      std::unique_lock<std::mutex> lock(engine->mutex);
+      engine->queued.wait(
+          lock, [engine] { return engine->stop || !engine->tasks.empty(); });
+      if (engine->tasks.empty())
+        break;
+      task = engine->tasks.front();
+      engine->tasks.pop_front();
+    }
+    // the event only follows the host functions of earlier tasks, which this
+    // thread has already completed
+    flagcxResult_t res = flagcxSuccess;
+    if (task->ready != NULL) {
+      res = deviceAdaptor->eventSynchronize(task->ready);
+      deviceAdaptor->eventDestroy(task->ready);
+    }
+    // failed tasks do not stop the following ones, the other ranks expect
+    // the same sequence of host collectives
+    flagcxResult_t taskRes = task->fn(engine->stream);
+    if (res == flagcxSuccess)
+      res = taskRes;
+    {
+      std::lock_guard<std::mutex> lock(engine->mutex);
+      if (task->stream == NULL) {
+        delete task;
+      } else {
+        task->done = true;
+      }
+      if (res != flagcxSuccess && engine->error == flagcxSuccess) {
+        WARN("Host engine: task failed with error %d", res);
+        engine->error = res;
+      }
+      engine->pending--;
+    }
+    engine->completed.notify_all();
+  }
+  return NULL;
+}
+
+flagcxResult_t flagcxHostEngineCreate(struct flagcxHostEngine **engine) {
+  *engine = NULL;
+  if (flagcxParamHostAsync() != 1)
+    return flagcxSuccess;
+  struct flagcxHostEngine *e = new flagcxHostEngine();
+  e->pending = 0;
+  e->userStream = NULL;
+  e->stop = false;
+  e->error = flagcxSuccess;
+  FLAGCXCHECK(deviceAdaptor->getDevice(&e->dev));
+  FLAGCXCHECK(deviceAdaptor->streamCreate(&e->stream));
+  if (pthread_create(&e->thread, NULL, hostEngineWorker, e) != 0) {
+    WARN("Failed to create the host engine thread");
+    deviceAdaptor->streamDestroy(e->stream);
+    delete e;
+    return flagcxSystemError;
+  }
+  flagcxSetThreadName(e->thread, "FLAGCX host engine");
+  INFO(FLAGCX_INIT, "Host-comm collectives run asynchronously");
+  *engine = e;
+  return flagcxSuccess;
+}
+
+flagcxResult_t flagcxHostEngineDestroy(struct flagcxHostEngine *engine) {
+  if (engine == NULL)
+    return flagcxSuccess;
+  flagcxResult_t res = flagcxHostEngineDrain(engine);
+  {
+    std::lock_guard<std::mutex> lock(engine->mutex);
+    engine->stop = true;
+  }
+  engine->queued.notify_all();
+  pthread_join(engine->thread, NULL);
+  FLAGCXCHECK(deviceAdaptor->streamDestroy(engine->stream));
+  delete engine;
+  return res;
+}
+
+bool flagcxHostEngineDefers(struct flagcxHostEngine *engine) {
+  return engine != NULL && hostEngineSelf != engine;
+}
+
+flagcxResult_t flagcxHostEngineEnqueue(struct flagcxHostEngine *engine,
+                                       flagcxHostTask_t task,
+                                       flagcxStream_t stream) {
+  struct flagcxHostEngineTask *t = new flagcxHostEngineTask();
+  t->engine = engine;
+  t->fn = std::move(task);
+  t->stream = stream;
+  t->ready = NULL;
+  t->done = false;
+  flagcxResult_t res = flagcxSuccess;
+  {
+    std::unique_lock<std::mutex> lock(engine->mutex);
+    if (stream != NULL) {
+      // a host function queued behind one of another stream could hold the
+      // task the latter waits for
+      if (engine->pending > 0 && engine->userStream != stream) {
+        engine->completed.wait(lock,
+                               [engine] { return engine->pending == 0; });
+      }
+      engine->userStream = stream;
+      res = deviceAdaptor->eventCreate(&t->ready);
+      if (res == flagcxSuccess) {
+        res = deviceAdaptor->eventRecord(t->ready, stream);
+      }
+      if (res == flagcxSuccess) {
+        res = deviceAdaptor->launchHostFunc(stream, hostEngineStreamWait, t);
+      }
+      if (res != flagcxSuccess) {
+        if (t->ready != NULL)
+          deviceAdaptor->eventDestroy(t->ready);
+        delete t;
+        return res;
+      }
+    }
+    engine->tasks.push_back(t);
+    engine->pending++;
+    res = engine->error;
+    engine->error = flagcxSuccess;
+  }
+  engine->queued.notify_one();
+  return res;
+}
+
+flagcxResult_t flagcxHostEngineDrain(struct flagcxHostEngine *engine) {
+  if (engine == NULL || hostEngineSelf == engine)
+    return flagcxSuccess;
+  std::unique_lock<std::mutex> lock(engine->mutex);
+  engine->completed.wait(lock, [engine] { return engine->pending == 0; });
+  flagcxResult_t res = engine->error;
+  engine->error = flagcxSuccess;
+  return res;
+}
@@ -0,0 +1,47 @@
+#ifndef FLAGCX_HOST_ENGINE_H_
+#define FLAGCX_HOST_ENGINE_H_
+
+#include "flagcx.h"
+#include <functional>
+
+/*
+ * Asynchronous engine of the host-comm path, enabled with FLAGCX_HOST_ASYNC=1.
+ *
+ * Host-comm collectives are queued as tasks instead of blocking the caller
+ * through the device-to-host copy, the host collective and the host-to-device
+ * copy. A task is stream-ordered: an event recorded on the user stream marks
+ * it ready once the work queued before it has completed, and a host function
+ * queued after the event holds the stream until the task is done, so the work
+ * queued after it sees the result.
+ *
+ * Tasks run in submission order on the worker thread of the communicator,
+ * which keeps the host collectives in the same order on all ranks; the
+ * workers of different communicators run concurrently. The worker waits on
+ * the events and never on the host functions. The pending tasks of an engine
+ * are all on the same stream: queueing a task on another stream first waits
+ * for them, so the host functions always run in task order, even when the
+ * device runtime runs the host functions of all streams one at a time.
+ * A task gets the stream of the engine to copy on. The first error of a task
+ * is returned by the following flagcxHostEngineEnqueue or
+ * flagcxHostEngineDrain.
+ */
+struct flagcxHostEngine;
+
+typedef std::function<flagcxResult_t(flagcxStream_t)> flagcxHostTask_t;
+
+// Sets *engine to NULL when the engine is disabled.
+flagcxResult_t flagcxHostEngineCreate(struct flagcxHostEngine **engine);
+flagcxResult_t flagcxHostEngineDestroy(struct flagcxHostEngine *engine);
+
+// Whether host-comm work has to be queued to engine, false on its worker.
+bool flagcxHostEngineDefers(struct flagcxHostEngine *engine);
+
+// Queues task, ordered with the work on stream unless stream is NULL.
+flagcxResult_t flagcxHostEngineEnqueue(struct flagcxHostEngine *engine,
+                                       flagcxHostTask_t task,
+                                       flagcxStream_t stream);
+
+// Waits for all queued tasks to complete.
+flagcxResult_t flagcxHostEngineDrain(struct flagcxHostEngine *engine);
+
+#endif // end include guard
@@ -0,0 +1,100 @@
+#include "host_pipeline.h"
+#include "adaptor.h"
+#include "check.h"
+#include "debug.h"
+#include "param.h"
+
+#include <algorithm>
+
+// Segment size of the host-comm pipeline, 0 disables the pipeline.
+FLAGCX_PARAM(HostPipelineChunkSize, "HOST_PIPELINE_CHUNK_SIZE", 1 << 22);
+
+// Number of device-to-host copies queued ahead of the host collective.
+#define FLAGCX_HOST_PIPELINE_DEPTH 8
+
+struct flagcxHostPipeline {
+  flagcxStream_t d2hStream;
+  flagcxStream_t h2dStream;
+  flagcxEvent_t d2hEvents[FLAGCX_HOST_PIPELINE_DEPTH];
+  size_t chunkSize;
+};
+
+flagcxResult_t flagcxHostPipelineCreate(struct flagcxHostPipeline **pipe) {
+  int64_t chunkSize = flagcxParamHostPipelineChunkSize();
+  *pipe = NULL;
+  if (chunkSize <= 0) {
+    INFO(FLAGCX_INIT, "Host-comm pipeline disabled");
+    return flagcxSuccess;
+  }
+  struct flagcxHostPipeline *p = new flagcxHostPipeline();
+  p->chunkSize = chunkSize;
+  FLAGCXCHECK(deviceAdaptor->streamCreate(&p->d2hStream));
+  FLAGCXCHECK(deviceAdaptor->streamCreate(&p->h2dStream));
+  for (int i = 0; i < FLAGCX_HOST_PIPELINE_DEPTH; i++) {
+    FLAGCXCHECK(deviceAdaptor->eventCreate(&p->d2hEvents[i]));
+  }
+  *pipe = p;
+  return flagcxSuccess;
+}
+
+flagcxResult_t flagcxHostPipelineDestroy(struct flagcxHostPipeline *pipe) {
+  if (pipe == NULL)
+    return flagcxSuccess;
+  for (int i = 0; i < FLAGCX_HOST_PIPELINE_DEPTH; i++) {
+    FLAGCXCHECK(deviceAdaptor->eventDestroy(pipe->d2hEvents[i]));
+  }
+  FLAGCXCHECK(deviceAdaptor->streamDestroy(pipe->d2hStream));
+  FLAGCXCHECK(deviceAdaptor->streamDestroy(pipe->h2dStream));
+  delete pipe;
+  return flagcxSuccess;
+}
+
+bool flagcxHostPipelineEnabled(struct flagcxHostPipeline *pipe, size_t size) {
+  return pipe != NULL && size > pipe->chunkSize;
+}
+
+flagcxResult_t flagcxHostPipelineRun(struct flagcxHostPipeline *pipe,
+                                     const void *sendbuff, void *recvbuff,
+                                     void *hostIn, void *hostOut, size_t size,
+                                     size_t align, flagcxHostPipelineFunc_t func,
+                                     void *args, flagcxStream_t stream) {
+  size_t chunkSize = std::max(pipe->chunkSize / align, (size_t)1) * align;
+  size_t nsegs = (size + chunkSize - 1) / chunkSize;
+  auto segBytes = [&](size_t seg) {
+    return std::min(chunkSize, size - seg * chunkSize);
+  };
+  auto enqueueD2H = [&](size_t seg) -> flagcxResult_t {
+    size_t offset = seg * chunkSize;
+    FLAGCXCHECK(deviceAdaptor->deviceMemcpy(
+        (char *)hostIn + offset, (char *)sendbuff + offset, segBytes(seg),
+        flagcxMemcpyDeviceToHost, pipe->d2hStream, NULL));
+    FLAGCXCHECK(deviceAdaptor->eventRecord(
+        pipe->d2hEvents[seg % FLAGCX_HOST_PIPELINE_DEPTH], pipe->d2hStream));
+    return flagcxSuccess;
+  };
+
+  // The side streams do not synchronize with the user stream.
+  if (stream != NULL) {
+    FLAGCXCHECK(deviceAdaptor->streamSynchronize(stream));
+  }
+  for (size_t seg = 0; seg < nsegs && seg < FLAGCX_HOST_PIPELINE_DEPTH; seg++) {
+    FLAGCXCHECK(enqueueD2H(seg));
+  }
+  for (size_t seg = 0; seg < nsegs; seg++) {
+    size_t offset = seg * chunkSize;
+    FLAGCXCHECK(deviceAdaptor->eventSynchronize(
+        pipe->d2hEvents[seg % FLAGCX_HOST_PIPELINE_DEPTH]));
+    // The event is free again, queue the copy it will track next.
+    if (seg + FLAGCX_HOST_PIPELINE_DEPTH < nsegs) {
+      FLAGCXCHECK(enqueueD2H(seg + FLAGCX_HOST_PIPELINE_DEPTH));
+    }
+    FLAGCXCHECK(func(hostIn, hostOut, offset, segBytes(seg), args));
+    FLAGCXCHECK(deviceAdaptor->deviceMemcpy(
+        (char *)recvbuff + offset, (char *)hostOut + offset, segBytes(seg),
+        flagcxMemcpyHostToDevice, pipe->h2dStream, NULL));
+  }
+  FLAGCXCHECK(deviceAdaptor->streamSynchronize(pipe->h2dStream));
+  TRACE(FLAGCX_COLL, "Host-comm pipeline: %zu bytes in %zu segments", size,
+        nsegs);
+  return flagcxSuccess;
+}
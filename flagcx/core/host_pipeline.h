@@ -0,0 +1,46 @@
+#ifndef FLAGCX_HOST_PIPELINE_H_
+#define FLAGCX_HOST_PIPELINE_H_
+
+#include "flagcx.h"
+#include <stddef.h>
+
+/*
+ * Segment pipeline of the host-comm path.
+ *
+ * Instead of copying the whole device buffer to the host, running the host
+ * collective and copying the result back, the buffer is cut into segments of
+ * FLAGCX_HOST_PIPELINE_CHUNK_SIZE bytes: the device-to-host copy of a segment
+ * runs on a side stream while the host collective works on the previous
+ * segment and the host-to-device copy of the one before runs on another side
+ * stream, so the total time approaches the largest of the three instead of
+ * their sum.
+ *
+ * Only collectives where segment i of the output depends on segment i of the
+ * input alone can be pipelined. Every rank must use the same chunk size.
+ */
+struct flagcxHostPipeline;
+
+// Host collective on bytes [offset, offset+bytes) of the staging buffers.
+typedef flagcxResult_t (*flagcxHostPipelineFunc_t)(void *hostIn, void *hostOut,
+                                                   size_t offset, size_t bytes,
+                                                   void *args);
+
+flagcxResult_t flagcxHostPipelineCreate(struct flagcxHostPipeline **pipe);
+flagcxResult_t flagcxHostPipelineDestroy(struct flagcxHostPipeline *pipe);
+
+// Whether a message of size bytes spans more than one segment.
+bool flagcxHostPipelineEnabled(struct flagcxHostPipeline *pipe, size_t size);
+
+/*
+ * Runs func over sendbuff (device) into recvbuff (device) through the pinned
+ * staging buffers hostIn and hostOut of size bytes. Segments are multiples of
+ * align bytes. Work already queued on stream is waited for before the first
+ * copy; recvbuff is ready when the call returns.
+ */
+flagcxResult_t flagcxHostPipelineRun(struct flagcxHostPipeline *pipe,
+                                     const void *sendbuff, void *recvbuff,
+                                     void *hostIn, void *hostOut, size_t size,
+                                     size_t align, flagcxHostPipelineFunc_t func,
+                                     void *args, flagcxStream_t stream);
+
+#endif // end include guard
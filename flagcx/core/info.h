@@ -117,6 +117,8 @@ struct flagcxTaskP2p {
   // of where it left off.
   int chunk;
   flagcxStream_t stream;
+  // flagcxCodec_t of the transfer
+  int codec;
 };
 
 struct flagcxCudaStreamList {
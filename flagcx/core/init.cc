@@ -8,6 +8,7 @@
 #include "bootstrap.h"
 #include "check.h"
 #include "collectives.h"
+#include "compress.h"
 #include "flagcx.h"
 #include "group.h"
 #include "net.h"
@@ -185,6 +186,12 @@ static flagcxResult_t flagcxCommInitRankFunc(struct flagcxAsyncJob *job_) {
     comm->groupNext = reinterpret_cast<struct flagcxHeteroComm *>(0x1);
     comm->preconnectNext = reinterpret_cast<struct flagcxHeteroComm *>(0x1);
     comm->proxyState->nRanks = comm->nRanks;
+    comm->codec = flagcxCodecFromEnv();
+    comm->compress = 0;
+    if (comm->codec != flagcxCodecNone) {
+      INFO(FLAGCX_INIT, "Compressing inter-cluster fp32 transfers to %s",
+           flagcxCodecToString((flagcxCodec_t)comm->codec));
+    }
 
     FLAGCXCHECK(flagcxProxyInit(comm));
   }
@@ -1,11 +1,129 @@
 #include "net.h"
 #include "adaptor.h"
+#include "compress.h"
 #include "device.h"
 #include "proxy.h"
 
+// Compressed sends stage every step in host memory: the fp32 step is copied
+// to hostStage, then encoded by the proxy thread into hostBuffers, which is
+// what goes on the wire.
+static flagcxResult_t proxySendEncoded(sendNetResources *resources, void *data,
+                                       size_t size, flagcxProxyArgs *args) {
+  flagcxCodec_t codec = (flagcxCodec_t)args->codec;
+  int stepMask = args->sendStepMask;
+
+  if (args->waitCopy < args->chunkSteps &&
+      args->waitCopy - args->transmitted < MAXSENDSTEP) {
+    int step = args->waitCopy & stepMask;
+    args->subs[step].stepSize =
+        std::min(args->chunkSize, size - args->totalCopySize);
+    args->subs[step].stepBuff = resources->hostStage + (CHUNCKSIZE * step);
+    deviceAdaptor->deviceMemcpy(
+        args->subs[step].stepBuff, (char *)data + args->totalCopySize,
+        args->subs[step].stepSize, flagcxMemcpyDeviceToHost,
+        resources->cpStream, args->subs[step].copyArgs);
+    args->totalCopySize += args->subs[args->waitCopy++ & stepMask].stepSize;
+  }
+
+  if (args->copied < args->waitCopy) {
+    if (deviceAdaptor->streamQuery(resources->cpStream) == flagcxSuccess) {
+      args->copied++;
+    }
+  }
+
+  if (args->encoded < args->copied) {
+    int step = args->encoded & stepMask;
+    size_t count = args->subs[step].stepSize / sizeof(float);
+    char *wire = resources->hostBuffers + (CHUNCKSIZE * step);
+    flagcxCodecEncode(codec, wire, (float *)args->subs[step].stepBuff, count);
+    args->subs[step].stepBuff = wire;
+    args->subs[step].stepSize = flagcxCodecEncodedSize(codec, count);
+    args->encoded++;
+  }
+
+  if (args->posted < args->encoded) {
+    void *req = NULL;
+    flagcxNetIb.isend(resources->netSendComm,
+                      args->subs[args->posted & stepMask].stepBuff,
+                      args->subs[args->posted & stepMask].stepSize, 0,
+                      resources->hostMhandle, &req);
+    if (req) {
+      args->subs[args->posted++ & stepMask].requests[0] = req;
+    }
+  }
+
+  if (args->transmitted < args->posted) {
+    void *req = args->subs[args->transmitted & stepMask].requests[0];
+    int done = 0, sizes;
+    flagcxNetIb.test(req, &done, &sizes);
+    if (done) {
+      args->transmitted++;
+    }
+  }
+  return flagcxSuccess;
+}
+
+// Compressed receives land in hostBuffers, are decoded by the proxy thread
+// into hostStage and copied to the device from there. No flush is needed for
+// host memory.
+static flagcxResult_t proxyRecvEncoded(recvNetResources *resources, void *data,
+                                       size_t size, flagcxProxyArgs *args) {
+  flagcxCodec_t codec = (flagcxCodec_t)args->codec;
+  int stepMask = args->sendStepMask;
+
+  if (args->posted < args->chunkSteps &&
+      args->posted - args->copied < MAXSENDSTEP) {
+    int tags[8] = {0};
+    void *req = NULL;
+    int step = args->posted & stepMask;
+    args->subs[step].stepSize =
+        std::min(args->chunkSize, size - args->totalPostSize);
+    args->subs[step].stepBuff = resources->hostBuffers + CHUNCKSIZE * step;
+    int wireSize = flagcxCodecEncodedSize(
+        codec, args->subs[step].stepSize / sizeof(float));
+    flagcxNetIb.irecv(resources->netRecvComm, 1, &args->subs[step].stepBuff,
+                      &wireSize, tags, &resources->hostMhandle, &req);
+    if (req) {
+      args->subs[step].requests[0] = req;
+      args->totalPostSize += args->subs[args->posted++ & stepMask].stepSize;
+    }
+  }
+
+  if (args->transmitted < args->posted) {
+    void *req = args->subs[args->transmitted & stepMask].requests[0];
+    int done = 0, sizes;
+    flagcxNetIb.test(req, &done, &sizes);
+    if (done) {
+      args->transmitted++;
+    }
+  }
+
+  if (args->waitCopy < args->transmitted) {
+    int step = args->waitCopy & stepMask;
+    char *stage = resources->hostStage + CHUNCKSIZE * step;
+    flagcxCodecDecode(codec, (float *)stage, args->subs[step].stepBuff,
+                      args->subs[step].stepSize / sizeof(float));
+    deviceAdaptor->deviceMemcpy(
+        (char *)data + args->totalCopySize, stage, args->subs[step].stepSize,
+        flagcxMemcpyHostToDevice, resources->cpStream,
+        args->subs[step].copyArgs);
+    args->totalCopySize += args->subs[args->waitCopy++ & stepMask].stepSize;
+  }
+
+  if (args->copied < args->waitCopy) {
+    if (deviceAdaptor->streamQuery(resources->cpStream) == flagcxSuccess) {
+      args->copied++;
+    }
+  }
+  return flagcxSuccess;
+}
+
 flagcxResult_t flagcxProxySend(sendNetResources *resources, void *data,
                                size_t size, flagcxProxyArgs *args) {
-  if (args->transmitted < args->chunkSteps) {
+  if (args->transmitted < args->chunkSteps &&
+      args->codec != flagcxCodecNone) {
+    FLAGCXCHECK(proxySendEncoded(resources, data, size, args));
+  } else if (args->transmitted < args->chunkSteps) {
     int stepMask = args->sendStepMask;
 
     if (args->waitCopy < args->chunkSteps &&
@@ -57,7 +175,9 @@ flagcxResult_t flagcxProxySend(sendNetResources *resources, void *data,
 
 flagcxResult_t flagcxProxyRecv(recvNetResources *resources, void *data,
                                size_t size, flagcxProxyArgs *args) {
-  if (args->copied < args->chunkSteps) {
+  if (args->copied < args->chunkSteps && args->codec != flagcxCodecNone) {
+    FLAGCXCHECK(proxyRecvEncoded(resources, data, size, args));
+  } else if (args->copied < args->chunkSteps) {
     int stepMask = args->sendStepMask;
     if (args->posted < args->chunkSteps &&
         args->posted - args->copied < MAXSENDSTEP) {
@@ -132,6 +252,11 @@ flagcxResult_t flagcxProxyRecv(recvNetResources *resources, void *data,
 
 flagcxResult_t flagcxSendProxyFree(sendNetResources *resources) {
   flagcxNetIb.deregMr(resources->netSendComm, resources->mhandles[0]);
+  if (resources->hostBuffers) {
+    flagcxNetIb.deregMr(resources->netSendComm, resources->hostMhandle);
+    deviceAdaptor->deviceFree(resources->hostBuffers, flagcxMemHost, NULL);
+    deviceAdaptor->deviceFree(resources->hostStage, flagcxMemHost, NULL);
+  }
   flagcxNetIb.closeSend(resources->netSendComm);
   deviceAdaptor->gdrMemFree(resources->buffers[0], NULL);
   deviceAdaptor->streamDestroy(resources->cpStream);
@@ -140,6 +265,11 @@ flagcxResult_t flagcxSendProxyFree(sendNetResources *resources) {
 
 flagcxResult_t flagcxRecvProxyFree(recvNetResources *resources) {
   flagcxNetIb.deregMr(resources->netRecvComm, resources->mhandles[0]);
+  if (resources->hostBuffers) {
+    flagcxNetIb.deregMr(resources->netRecvComm, resources->hostMhandle);
+    deviceAdaptor->deviceFree(resources->hostBuffers, flagcxMemHost, NULL);
+    deviceAdaptor->deviceFree(resources->hostStage, flagcxMemHost, NULL);
+  }
   flagcxNetIb.closeRecv(resources->netRecvComm);
   flagcxNetIb.closeListen(resources->netListenComm);
   deviceAdaptor->gdrMemFree(resources->buffers[0], NULL);
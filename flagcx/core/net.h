@@ -55,6 +55,11 @@ struct sendNetResources {
   flagcxNetDeviceType netDeviceType;
   flagcxNetDeviceHandle_t* netDeviceHandle;
   flagcxStream_t cpStream; 
+  /* pinned host buffers of the compressed transfers, REGMRBUFFERSIZE each:
+   * fp32 steps and their encoded form on the wire */
+  char* hostStage;
+  char* hostBuffers;
+  void* hostMhandle;
 };
 
 struct recvNetResources {
@@ -87,6 +92,11 @@ struct recvNetResources {
   flagcxNetDeviceType netDeviceType;
   flagcxNetDeviceHandle_t* netDeviceHandle;
   flagcxStream_t cpStream; 
+  /* pinned host buffers of the compressed transfers, REGMRBUFFERSIZE each:
+   * fp32 steps and their encoded form on the wire */
+  char* hostStage;
+  char* hostBuffers;
+  void* hostMhandle;
 };
 
 enum flagcxIbCommState {
@@ -102,7 +112,7 @@ enum flagcxIbCommState {
 
 struct flagcxIbCommStage {
   enum flagcxIbCommState state;
-  int offset;
+  size_t offset;
   void* buffer;
   void* comm;
 };
@@ -364,7 +364,7 @@ flagcxResult_t flagcxPollProxyResponse(struct flagcxHeteroComm *comm,
     // Attempt to read in a new response header from the proxy thread
     struct flagcxSocket *sock = &sharedProxyState->peerSock;
     flagcxProxyRpcResponseHeader resp = {0};
-    int offset = 0;
+    size_t offset = 0;
     if (flagcxSuccess != flagcxSocketProgress(FLAGCX_SOCKET_RECV, sock, &resp,
                                               sizeof(resp), &offset)) {
       WARN("Socket recv failed while polling for opId=%p", opId);
@@ -428,6 +428,11 @@ static flagcxResult_t proxyProgressAsync(flagcxProxyAsyncOp **opHead,
         FLAGCXCHECK(flagcxNetIb.regMr(
             resources->netSendComm, resources->buffers[0],
             resources->buffSizes[0], 2, &resources->mhandles[0]));
+        if (resources->hostBuffers) {
+          FLAGCXCHECK(flagcxNetIb.regMr(
+              resources->netSendComm, resources->hostBuffers,
+              REGMRBUFFERSIZE, FLAGCX_PTR_HOST, &resources->hostMhandle));
+        }
         done = 1;
       }
     } else {
@@ -440,6 +445,11 @@ static flagcxResult_t proxyProgressAsync(flagcxProxyAsyncOp **opHead,
         FLAGCXCHECK(flagcxNetIb.regMr(
             resources->netRecvComm, resources->buffers[0],
             resources->buffSizes[0], 2, &resources->mhandles[0]));
+        if (resources->hostBuffers) {
+          FLAGCXCHECK(flagcxNetIb.regMr(
+              resources->netRecvComm, resources->hostBuffers,
+              REGMRBUFFERSIZE, FLAGCX_PTR_HOST, &resources->hostMhandle));
+        }
         done = 1;
       }
     }
@@ -103,6 +103,8 @@ struct flagcxProxyArgs {
   uint8_t /*flagcxPattern_t*/ pattern;
   uint8_t /*flagcxFunc_t*/ coll;
   uint8_t protocol;
+  uint8_t /*flagcxCodec_t*/ codec;
+  int encoded;
   int state;
   char *sharedBuff[FLAGCX_STEPS];
   int sharedSize[FLAGCX_STEPS];
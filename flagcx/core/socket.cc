@@ -9,8 +9,11 @@
 #include "debug.h"
 #include "check.h"
 #include "utils.h"
+#include "uring.h"
 #include <stdlib.h>
 #include <cstddef>
+#include <algorithm>
+#include <vector>
 
 #include <unistd.h>
 #include <ifaddrs.h>
@@ -18,21 +21,33 @@
 #include <cerrno>
 #include <string.h>
 
-static flagcxResult_t socketProgressOpt(int op, struct flagcxSocket* sock, void* ptr, int size, int* offset, int block, int* closed) {
-  int bytes = 0;
+// Upper bound on the bytes handed to a single send/recv call. Large messages
+// are streamed in chunks so that abort requests are noticed between calls and
+// the byte counts stay well within what the kernel accepts per syscall.
+FLAGCX_PARAM(SocketChunkSize, "SOCKET_CHUNK_SIZE", 1 << 22);
+
+static size_t socketChunkSize() {
+  int64_t chunkSize = flagcxParamSocketChunkSize();
+  return chunkSize > 0 ? (size_t)chunkSize : (size_t)(1 << 22);
+}
+
+static flagcxResult_t socketProgressOpt(int op, struct flagcxSocket* sock, void* ptr, size_t size, size_t* offset, int block, int* closed) {
+  ssize_t bytes = 0;
   *closed = 0;
   char* data = (char*)ptr;
   char line[SOCKET_NAME_MAXLEN+1];
+  size_t chunkSize = socketChunkSize();
   do {
-    if (op == FLAGCX_SOCKET_RECV) bytes = recv(sock->fd, data+(*offset), size-(*offset), block ? 0 : MSG_DONTWAIT);
-    if (op == FLAGCX_SOCKET_SEND) bytes = send(sock->fd, data+(*offset), size-(*offset), block ? MSG_NOSIGNAL : MSG_DONTWAIT | MSG_NOSIGNAL);
+    size_t len = std::min(size-(*offset), chunkSize);
+    if (op == FLAGCX_SOCKET_RECV) bytes = recv(sock->fd, data+(*offset), len, block ? 0 : MSG_DONTWAIT);
+    if (op == FLAGCX_SOCKET_SEND) bytes = send(sock->fd, data+(*offset), len, block ? MSG_NOSIGNAL : MSG_DONTWAIT | MSG_NOSIGNAL);
     if (op == FLAGCX_SOCKET_RECV && bytes == 0) {
       *closed = 1;
       return flagcxSuccess;
     }
     if (bytes == -1) {
       if (errno != EINTR && errno != EWOULDBLOCK && errno != EAGAIN) {
-        WARN("socketProgressOpt: Call to recv from %s failed : %s", flagcxSocketToString(&sock->addr, line), strerror(errno));
+        WARN("socketProgressOpt: Call to %s %s failed : %s", op == FLAGCX_SOCKET_RECV ? "recv from" : "send to", flagcxSocketToString(&sock->addr, line), strerror(errno));
         return flagcxRemoteError;
       } else {
         bytes = 0;
@@ -47,7 +62,7 @@ static flagcxResult_t socketProgressOpt(int op, struct flagcxSocket* sock, void*
   return flagcxSuccess;
 }
 
-static flagcxResult_t socketProgress(int op, struct flagcxSocket* sock, void* ptr, int size, int* offset) {
+static flagcxResult_t socketProgress(int op, struct flagcxSocket* sock, void* ptr, size_t size, size_t* offset) {
   int closed;
   FLAGCXCHECK(socketProgressOpt(op, sock, ptr, size, offset, 0 /*block*/, &closed));
   if (closed) {
@@ -58,12 +73,55 @@ static flagcxResult_t socketProgress(int op, struct flagcxSocket* sock, void* pt
   return flagcxSuccess;
 }
 
-static flagcxResult_t socketWait(int op, struct flagcxSocket* sock, void* ptr, int size, int* offset) {
+static flagcxResult_t socketWait(int op, struct flagcxSocket* sock, void* ptr, size_t size, size_t* offset) {
   while (*offset < size)
     FLAGCXCHECK(socketProgress(op, sock, ptr, size, offset));
   return flagcxSuccess;
 }
 
+// Same as socketProgress for sends, but gathers the bytes [offset, total) of an
+// iovec list so that small headers leave in the same syscall as their payload.
+static flagcxResult_t socketProgressIov(struct flagcxSocket* sock, const struct iovec* iov, int iovcnt, size_t total, size_t* offset) {
+  ssize_t bytes = 0;
+  char line[SOCKET_NAME_MAXLEN+1];
+  size_t chunkSize = socketChunkSize();
+  do {
+    struct iovec vec[FLAGCX_SOCKET_MAX_IOV];
+    int nvec = 0;
+    size_t skip = *offset, len = 0;
+    for (int i = 0; i < iovcnt && len < chunkSize; i++) {
+      if (skip >= iov[i].iov_len) {
+        skip -= iov[i].iov_len;
+        continue;
+      }
+      vec[nvec].iov_base = (char*)iov[i].iov_base + skip;
+      vec[nvec].iov_len = std::min(iov[i].iov_len - skip, chunkSize - len);
+      len += vec[nvec].iov_len;
+      skip = 0;
+      nvec++;
+    }
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = vec;
+    msg.msg_iovlen = nvec;
+    bytes = sendmsg(sock->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (bytes == -1) {
+      if (errno != EINTR && errno != EWOULDBLOCK && errno != EAGAIN) {
+        WARN("socketProgressIov: Call to sendmsg to %s failed : %s", flagcxSocketToString(&sock->addr, line), strerror(errno));
+        return flagcxRemoteError;
+      } else {
+        bytes = 0;
+      }
+    }
+    (*offset) += bytes;
+    if (sock->abortFlag && __atomic_load_n(sock->abortFlag, __ATOMIC_RELAXED)) {
+      INFO(FLAGCX_NET, "socketProgressIov: abort called");
+      return flagcxInternalError;
+    }
+  } while (bytes > 0 && (*offset) < total);
+  return flagcxSuccess;
+}
+
 /* Format a string representation of a (union flagcxSocketAddress *) socket address using getnameinfo()
  *
  * Output: "IPv4/IPv6 address<port>"
@@ -426,7 +484,7 @@ static flagcxResult_t socketTryAccept(struct flagcxSocket* sock) {
 static flagcxResult_t socketFinalizeAccept(struct flagcxSocket* sock) {
   uint64_t magic;
   enum flagcxSocketType type;
-  int received = 0;
+  size_t received = 0;
   const int one = 1;
   SYSCHECK(setsockopt(sock->fd, IPPROTO_TCP, TCP_NODELAY, (char*)&one, sizeof(int)), "setsockopt");
 
@@ -551,7 +609,7 @@ flagcxResult_t flagcxSocketPollConnect(struct flagcxSocket* sock) {
 }
 
 static flagcxResult_t socketFinalizeConnect(struct flagcxSocket* sock) {
-  int sent = 0;
+  size_t sent = 0;
   FLAGCXCHECK(socketProgress(FLAGCX_SOCKET_SEND, sock, &sock->magic, sizeof(sock->magic), &sent));
   if (sent == 0) return flagcxSuccess;
   FLAGCXCHECK(socketWait(FLAGCX_SOCKET_SEND, sock, &sock->magic, sizeof(sock->magic), &sent));
@@ -749,7 +807,7 @@ fail:
   goto exit;
 }
 
-flagcxResult_t flagcxSocketProgress(int op, struct flagcxSocket* sock, void* ptr, int size, int* offset) {
+flagcxResult_t flagcxSocketProgress(int op, struct flagcxSocket* sock, void* ptr, size_t size, size_t* offset) {
   if (sock == NULL) {
     WARN("flagcxSocketProgress: pass NULL socket");
     return flagcxInvalidArgument;
@@ -758,7 +816,7 @@ flagcxResult_t flagcxSocketProgress(int op, struct flagcxSocket* sock, void* ptr
   return flagcxSuccess;
 }
 
-flagcxResult_t flagcxSocketWait(int op, struct flagcxSocket* sock, void* ptr, int size, int* offset) {
+flagcxResult_t flagcxSocketWait(int op, struct flagcxSocket* sock, void* ptr, size_t size, size_t* offset) {
   if (sock == NULL) {
     WARN("flagcxSocketWait: pass NULL socket");
     return flagcxInvalidArgument;
@@ -767,8 +825,7 @@ flagcxResult_t flagcxSocketWait(int op, struct flagcxSocket* sock, void* ptr, in
   return flagcxSuccess;
 }
 
-flagcxResult_t flagcxSocketSend(struct flagcxSocket* sock, void* ptr, int size) {
-  int offset = 0;
+flagcxResult_t flagcxSocketSend(struct flagcxSocket* sock, void* ptr, size_t size) {
   if (sock == NULL) {
     WARN("flagcxSocketSend: pass NULL socket");
     return flagcxInvalidArgument;
@@ -777,12 +834,12 @@ flagcxResult_t flagcxSocketSend(struct flagcxSocket* sock, void* ptr, int size)
     WARN("flagcxSocketSend: socket state (%d) is not ready", sock->state);
     return flagcxInternalError;
   }
-  FLAGCXCHECK(socketWait(FLAGCX_SOCKET_SEND, sock, ptr, size, &offset));
+  struct flagcxSocketOp op = {FLAGCX_SOCKET_SEND, sock, ptr, size, 0};
+  FLAGCXCHECK(flagcxSocketWaitAll(&op, 1));
   return flagcxSuccess;
 }
 
-flagcxResult_t flagcxSocketRecv(struct flagcxSocket* sock, void* ptr, int size) {
-  int offset = 0;
+flagcxResult_t flagcxSocketRecv(struct flagcxSocket* sock, void* ptr, size_t size) {
   if (sock == NULL) {
     WARN("flagcxSocketRecv: pass NULL socket");
     return flagcxInvalidArgument;
@@ -791,12 +848,32 @@ flagcxResult_t flagcxSocketRecv(struct flagcxSocket* sock, void* ptr, int size)
     WARN("flagcxSocketRecv: socket state (%d) is not ready", sock->state);
     return flagcxInternalError;
   }
-  FLAGCXCHECK(socketWait(FLAGCX_SOCKET_RECV, sock, ptr, size, &offset));
+  struct flagcxSocketOp op = {FLAGCX_SOCKET_RECV, sock, ptr, size, 0};
+  FLAGCXCHECK(flagcxSocketWaitAll(&op, 1));
+  return flagcxSuccess;
+}
+
+flagcxResult_t flagcxSocketSendIov(struct flagcxSocket* sock, const struct iovec* iov, int iovcnt) {
+  size_t total = 0, offset = 0;
+  if (sock == NULL) {
+    WARN("flagcxSocketSendIov: pass NULL socket");
+    return flagcxInvalidArgument;
+  }
+  if (iovcnt < 0 || iovcnt > FLAGCX_SOCKET_MAX_IOV) {
+    WARN("flagcxSocketSendIov: invalid iovec count %d (max %d)", iovcnt, FLAGCX_SOCKET_MAX_IOV);
+    return flagcxInvalidArgument;
+  }
+  if (sock->state != flagcxSocketStateReady) {
+    WARN("flagcxSocketSendIov: socket state (%d) is not ready", sock->state);
+    return flagcxInternalError;
+  }
+  for (int i = 0; i < iovcnt; i++) total += iov[i].iov_len;
+  while (offset < total)
+    FLAGCXCHECK(socketProgressIov(sock, iov, iovcnt, total, &offset));
   return flagcxSuccess;
 }
 
-flagcxResult_t flagcxSocketSendRecv(struct flagcxSocket* sendSock, void* sendPtr, int sendSize, struct flagcxSocket* recvSock, void* recvPtr, int recvSize) {
-  int sendOffset = 0, recvOffset = 0;
+flagcxResult_t flagcxSocketSendRecv(struct flagcxSocket* sendSock, void* sendPtr, size_t sendSize, struct flagcxSocket* recvSock, void* recvPtr, size_t recvSize) {
   if (sendSock == NULL || recvSock == NULL) {
     WARN("flagcxSocketSendRecv: invalid socket %p/%p", sendSock, recvSock);
     return flagcxInternalError;
@@ -805,17 +882,146 @@ flagcxResult_t flagcxSocketSendRecv(struct flagcxSocket* sendSock, void* sendPtr
     WARN("flagcxSocketSendRecv: socket state (%d/%d) is not ready", sendSock->state, recvSock->state);
     return flagcxInternalError;
   }
-  while (sendOffset < sendSize || recvOffset < recvSize) {
-    if (sendOffset < sendSize) FLAGCXCHECK(socketProgress(FLAGCX_SOCKET_SEND, sendSock, sendPtr, sendSize, &sendOffset));
-    if (recvOffset < recvSize) FLAGCXCHECK(socketProgress(FLAGCX_SOCKET_RECV, recvSock, recvPtr, recvSize, &recvOffset));
+  struct flagcxSocketOp ops[2] = {{FLAGCX_SOCKET_SEND, sendSock, sendPtr, sendSize, 0},
+                                   {FLAGCX_SOCKET_RECV, recvSock, recvPtr, recvSize, 0}};
+  FLAGCXCHECK(flagcxSocketWaitAll(ops, 2));
+  return flagcxSuccess;
+}
+
+// io_uring backend of flagcxSocketWaitAll. Every thread lazily creates its own ring; all pending
+// operations are submitted and waited for with a single io_uring_enter, and sockets that have no
+// data yet are polled by the kernel instead of returning EAGAIN to us.
+FLAGCX_PARAM(SocketIoUring, "SOCKET_IO_URING", 0);
+
+#define SOCKET_URING_ENTRIES 64
+// Interval at which abort flags are checked while waiting in the kernel.
+#define SOCKET_URING_ABORT_POLL_NS 10000000ULL
+#define SOCKET_URING_CANCEL_DATA (~0ULL)
+
+struct socketUring {
+  struct flagcxUring ring;
+  int state = 0; // 0: not initialized, 1: ready, -1: not used
+  ~socketUring() {
+    if (state == 1) flagcxUringDestroy(&ring);
+  }
+};
+static thread_local struct socketUring socketUringLocal;
+
+static struct flagcxUring* socketUringGet() {
+  struct socketUring* local = &socketUringLocal;
+  if (local->state == 0) {
+    local->state = -1;
+    if (flagcxParamSocketIoUring() != 0) {
+      if (flagcxUringInit(&local->ring, SOCKET_URING_ENTRIES) == flagcxSuccess) {
+        local->state = 1;
+      } else {
+        INFO(FLAGCX_INIT|FLAGCX_NET, "io_uring is not available, falling back to non-blocking send/recv");
+      }
+    }
+  }
+  return local->state == 1 ? &local->ring : NULL;
+}
+
+static flagcxResult_t socketWaitAllUring(struct flagcxUring* ring, struct flagcxSocketOp* ops, int nops) {
+  flagcxResult_t ret = flagcxSuccess;
+  char line[SOCKET_NAME_MAXLEN+1];
+  size_t chunkSize = socketChunkSize();
+  std::vector<char> inflight(nops, 0);
+  int pending = 0, nInflight = 0;
+  bool abortable = false, cancelled = false;
+  for (int i = 0; i < nops; i++) {
+    if (ops[i].offset < ops[i].size) pending++;
+    if (ops[i].sock->abortFlag) abortable = true;
+  }
+
+  while (nInflight > 0 || (pending > 0 && ret == flagcxSuccess)) {
+    if (ret == flagcxSuccess) {
+      for (int i = 0; i < nops; i++) {
+        struct flagcxSocketOp* op = ops + i;
+        if (inflight[i] || op->offset == op->size) continue;
+        struct io_uring_sqe* sqe = flagcxUringGetSqe(ring);
+        if (sqe == NULL) break;
+        sqe->opcode = op->op == FLAGCX_SOCKET_SEND ? IORING_OP_SEND : IORING_OP_RECV;
+        sqe->fd = op->sock->fd;
+        sqe->addr = (uint64_t)(uintptr_t)((char*)op->ptr + op->offset);
+        sqe->len = std::min(op->size - op->offset, chunkSize);
+        sqe->msg_flags = op->op == FLAGCX_SOCKET_SEND ? MSG_NOSIGNAL : 0;
+        sqe->user_data = i;
+        inflight[i] = 1;
+        nInflight++;
+      }
+    } else if (!cancelled) {
+      // The buffers must not be touched once we return, cancel what is still in flight.
+      for (int i = 0; i < nops; i++) {
+        if (!inflight[i]) continue;
+        struct io_uring_sqe* sqe = flagcxUringGetSqe(ring);
+        if (sqe == NULL) break;
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = i;
+        sqe->user_data = SOCKET_URING_CANCEL_DATA;
+      }
+      cancelled = true;
+    }
+
+    FLAGCXCHECK(flagcxUringSubmitAndWait(ring, 1, abortable ? SOCKET_URING_ABORT_POLL_NS : 0));
+
+    struct io_uring_cqe cqe;
+    while (flagcxUringPopCqe(ring, &cqe)) {
+      if (cqe.user_data == SOCKET_URING_CANCEL_DATA) continue;
+      struct flagcxSocketOp* op = ops + cqe.user_data;
+      inflight[cqe.user_data] = 0;
+      nInflight--;
+      if (cqe.res > 0) {
+        op->offset += cqe.res;
+        if (op->offset == op->size) pending--;
+      } else if (ret != flagcxSuccess) {
+        continue;
+      } else if (cqe.res == 0 && op->op == FLAGCX_SOCKET_RECV) {
+        WARN("socketWaitAll: Connection closed by remote peer %s", flagcxSocketToString(&op->sock->addr, line, 0));
+        ret = flagcxRemoteError;
+      } else if (cqe.res < 0 && cqe.res != -EINTR && cqe.res != -EAGAIN) {
+        WARN("socketWaitAll: Call to %s %s failed : %s", op->op == FLAGCX_SOCKET_RECV ? "recv from" : "send to",
+             flagcxSocketToString(&op->sock->addr, line), strerror(-cqe.res));
+        ret = flagcxRemoteError;
+      }
+    }
+
+    for (int i = 0; abortable && ret == flagcxSuccess && i < nops; i++) {
+      if (ops[i].sock->abortFlag && __atomic_load_n(ops[i].sock->abortFlag, __ATOMIC_RELAXED)) {
+        INFO(FLAGCX_NET, "socketWaitAll: abort called");
+        ret = flagcxInternalError;
+      }
+    }
+  }
+  return ret;
+}
+
+flagcxResult_t flagcxSocketWaitAll(struct flagcxSocketOp* ops, int nops) {
+  for (int i = 0; i < nops; i++) {
+    if (ops[i].sock == NULL) {
+      WARN("flagcxSocketWaitAll: pass NULL socket");
+      return flagcxInvalidArgument;
+    }
   }
+  struct flagcxUring* ring = socketUringGet();
+  if (ring) return socketWaitAllUring(ring, ops, nops);
+
+  int pending;
+  do {
+    pending = 0;
+    for (int i = 0; i < nops; i++) {
+      struct flagcxSocketOp* op = ops + i;
+      if (op->offset < op->size) FLAGCXCHECK(socketProgress(op->op, op->sock, op->ptr, op->size, &op->offset));
+      if (op->offset < op->size) pending++;
+    }
+  } while (pending > 0);
   return flagcxSuccess;
 }
 
 
 // Receive or detect connection closed
-flagcxResult_t flagcxSocketTryRecv(struct flagcxSocket* sock, void* ptr, int size, int* closed, bool blocking) {
-  int offset = 0;
+flagcxResult_t flagcxSocketTryRecv(struct flagcxSocket* sock, void* ptr, size_t size, int* closed, bool blocking) {
+  size_t offset = 0;
   if (sock == NULL) {
     WARN("flagcxSocketTryRecv: pass NULL socket");
     return flagcxInvalidArgument;
@@ -12,6 +12,7 @@ extern "C" {
 #endif
 
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 #include <netinet/tcp.h>
 #include <netdb.h>
@@ -92,13 +93,30 @@ flagcxResult_t flagcxSocketSetFd(int fd, struct flagcxSocket* sock);
 
 #define FLAGCX_SOCKET_SEND 0
 #define FLAGCX_SOCKET_RECV 1
+#define FLAGCX_SOCKET_MAX_IOV 8
 
-flagcxResult_t flagcxSocketProgress(int op, struct flagcxSocket* sock, void* ptr, int size, int* offset);
-flagcxResult_t flagcxSocketWait(int op, struct flagcxSocket* sock, void* ptr, int size, int* offset);
-flagcxResult_t flagcxSocketSend(struct flagcxSocket* sock, void* ptr, int size);
-flagcxResult_t flagcxSocketRecv(struct flagcxSocket* sock, void* ptr, int size);
-flagcxResult_t flagcxSocketSendRecv(struct flagcxSocket* sendSock, void* sendPtr, int sendSize, struct flagcxSocket* recvSock, void* recvPtr, int recvSize);
-flagcxResult_t flagcxSocketTryRecv(struct flagcxSocket* sock, void* ptr, int size, int* closed, bool blocking);
+flagcxResult_t flagcxSocketProgress(int op, struct flagcxSocket* sock, void* ptr, size_t size, size_t* offset);
+flagcxResult_t flagcxSocketWait(int op, struct flagcxSocket* sock, void* ptr, size_t size, size_t* offset);
+flagcxResult_t flagcxSocketSend(struct flagcxSocket* sock, void* ptr, size_t size);
+flagcxResult_t flagcxSocketRecv(struct flagcxSocket* sock, void* ptr, size_t size);
+// Send a list of buffers (at most FLAGCX_SOCKET_MAX_IOV) as one stream, gathering them with sendmsg.
+flagcxResult_t flagcxSocketSendIov(struct flagcxSocket* sock, const struct iovec* iov, int iovcnt);
+flagcxResult_t flagcxSocketSendRecv(struct flagcxSocket* sendSock, void* sendPtr, size_t sendSize, struct flagcxSocket* recvSock, void* recvPtr, size_t recvSize);
+
+// A send or receive of size bytes; offset counts the bytes already transferred.
+struct flagcxSocketOp {
+  int op;
+  struct flagcxSocket* sock;
+  void* ptr;
+  size_t size;
+  size_t offset;
+};
+// Blocks until all operations have completed. Operations must not share a (socket, direction)
+// pair. With FLAGCX_SOCKET_IO_URING=1 they are submitted together to an io_uring and the thread
+// sleeps in the kernel until they complete; otherwise, or when io_uring is not available, they
+// are progressed with non-blocking send/recv calls.
+flagcxResult_t flagcxSocketWaitAll(struct flagcxSocketOp* ops, int nops);
+flagcxResult_t flagcxSocketTryRecv(struct flagcxSocket* sock, void* ptr, size_t size, int* closed, bool blocking);
 flagcxResult_t flagcxSocketClose(struct flagcxSocket* sock);
 
 #ifdef __cplusplus
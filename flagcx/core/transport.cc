@@ -1,6 +1,7 @@
 #include "adaptor.h"
 #include "bootstrap.h"
 #include "comm.h"
+#include "compress.h"
 #include "info.h"
 #include "net.h"
 #include "proxy.h"
@@ -34,6 +35,14 @@ flagcxResult_t flagcxTransportP2pSetup(struct flagcxHeteroComm *comm,
         resources->buffSizes[0] = REGMRBUFFERSIZE;
         deviceAdaptor->gdrMemAlloc((void **)&resources->buffers[0],
                                    resources->buffSizes[0], NULL);
+        if (comm->codec != flagcxCodecNone) {
+          FLAGCXCHECK(deviceAdaptor->deviceMalloc(
+              (void **)&resources->hostStage, REGMRBUFFERSIZE, flagcxMemHost,
+              NULL));
+          FLAGCXCHECK(deviceAdaptor->deviceMalloc(
+              (void **)&resources->hostBuffers, REGMRBUFFERSIZE,
+              flagcxMemHost, NULL));
+        }
         FLAGCXCHECK(flagcxProxyCallAsync(comm, &conn->proxyConn,
                                          flagcxProxyMsgConnect, handle,
                                          sizeof(flagcxIbHandle), 0, conn));
@@ -58,6 +67,14 @@ flagcxResult_t flagcxTransportP2pSetup(struct flagcxHeteroComm *comm,
         resources->buffSizes[0] = REGMRBUFFERSIZE;
         deviceAdaptor->gdrMemAlloc((void **)&resources->buffers[0],
                                    resources->buffSizes[0], NULL);
+        if (comm->codec != flagcxCodecNone) {
+          FLAGCXCHECK(deviceAdaptor->deviceMalloc(
+              (void **)&resources->hostStage, REGMRBUFFERSIZE, flagcxMemHost,
+              NULL));
+          FLAGCXCHECK(deviceAdaptor->deviceMalloc(
+              (void **)&resources->hostBuffers, REGMRBUFFERSIZE,
+              flagcxMemHost, NULL));
+        }
         FLAGCXCHECK(flagcxProxyCallAsync(comm, &conn->proxyConn,
                                          flagcxProxyMsgConnect, handle,
                                          sizeof(flagcxIbHandle), 0, conn));
@@ -0,0 +1,223 @@
+#include "tuner.h"
+#include "debug.h"
+#include "param.h"
+
+#include <algorithm>
+#include <dlfcn.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+FLAGCX_PARAM(TunerNetBw, "TUNER_NET_BW", 0);
+FLAGCX_PARAM(TunerIntraBw, "TUNER_INTRA_BW", 50);
+FLAGCX_PARAM(TunerPcieBw, "TUNER_PCIE_BW", 16);
+FLAGCX_PARAM(TunerHostNetBw, "TUNER_HOST_NET_BW", 0);
+
+// NIC bandwidth assumed when neither the topology nor FLAGCX_TUNER_NET_BW
+// gives one, GB/s
+#define FLAGCX_TUNER_DEFAULT_NET_BW 12.5
+// Latency of one step, us
+#define FLAGCX_TUNER_NET_LAT 10.0
+#define FLAGCX_TUNER_INTRA_LAT 5.0
+#define FLAGCX_TUNER_HOST_LAT 30.0
+
+struct flagcxHeteroTuner {
+  int nranks;
+  int nclusters;
+  int minClusterSize;
+  int maxClusterSize;
+  // bandwidths in bytes per us
+  double netBw;
+  double intraBw;
+  double pcieBw;
+  double hostNetBw;
+
+  void *pluginLib;
+  flagcxTuner_t *plugin;
+  void *pluginContext;
+};
+
+static void tunerLoadPlugin(struct flagcxHeteroTuner *tuner) {
+  const char *name = getenv("FLAGCX_TUNER_PLUGIN");
+  if (name == NULL || name[0] == '\0')
+    return;
+  void *lib = dlopen(name, RTLD_NOW | RTLD_LOCAL);
+  if (lib == NULL) {
+    char libName[PATH_MAX];
+    snprintf(libName, sizeof(libName), "libflagcx-tuner-%s.so", name);
+    lib = dlopen(libName, RTLD_NOW | RTLD_LOCAL);
+  }
+  if (lib == NULL) {
+    WARN("Tuner: could not load plugin %s : %s", name, dlerror());
+    return;
+  }
+  flagcxTuner_t *plugin =
+      (flagcxTuner_t *)dlsym(lib, FLAGCX_TUNER_PLUGIN_SYMBOL);
+  if (plugin == NULL) {
+    WARN("Tuner: plugin %s does not export %s", name,
+         FLAGCX_TUNER_PLUGIN_SYMBOL);
+    dlclose(lib);
+    return;
+  }
+  if (plugin->init(tuner->nranks, tuner->nclusters, flagcxDebugLog,
+                   &tuner->pluginContext) != flagcxSuccess) {
+    WARN("Tuner: plugin %s failed to initialize", plugin->name);
+    dlclose(lib);
+    return;
+  }
+  tuner->pluginLib = lib;
+  tuner->plugin = plugin;
+  INFO(FLAGCX_INIT | FLAGCX_TUNING, "Tuner: using plugin %s", plugin->name);
+}
+
+flagcxResult_t
+flagcxHeteroTunerCreate(const struct flagcxHeteroTunerTopo *topo,
+                        struct flagcxHeteroTuner **tuner) {
+  struct flagcxHeteroTuner *t = new flagcxHeteroTuner();
+  t->nranks = topo->nranks;
+  t->nclusters = topo->nclusters;
+  t->minClusterSize = *std::min_element(topo->clusterSizes,
+                                        topo->clusterSizes + topo->nclusters);
+  t->maxClusterSize = *std::max_element(topo->clusterSizes,
+                                        topo->clusterSizes + topo->nclusters);
+  double netBw = flagcxParamTunerNetBw() > 0 ? flagcxParamTunerNetBw()
+                 : topo->netBw > 0           ? topo->netBw
+                                             : FLAGCX_TUNER_DEFAULT_NET_BW;
+  // GB/s to bytes per us
+  t->netBw = netBw * 1e3;
+  t->intraBw = std::max((int64_t)flagcxParamTunerIntraBw(), (int64_t)1) * 1e3;
+  t->pcieBw = std::max((int64_t)flagcxParamTunerPcieBw(), (int64_t)1) * 1e3;
+  t->hostNetBw = flagcxParamTunerHostNetBw() > 0
+                     ? flagcxParamTunerHostNetBw() * 1e3
+                     : t->netBw;
+  INFO(FLAGCX_INIT | FLAGCX_TUNING,
+       "Tuner: %d ranks in %d clusters of %d to %d ranks, net %.1f GB/s, "
+       "intra %.1f GB/s, pcie %.1f GB/s, host net %.1f GB/s",
+       t->nranks, t->nclusters, t->minClusterSize, t->maxClusterSize,
+       t->netBw / 1e3, t->intraBw / 1e3, t->pcieBw / 1e3, t->hostNetBw / 1e3);
+  tunerLoadPlugin(t);
+  *tuner = t;
+  return flagcxSuccess;
+}
+
+flagcxResult_t flagcxHeteroTunerDestroy(struct flagcxHeteroTuner *tuner) {
+  if (tuner == NULL)
+    return flagcxSuccess;
+  if (tuner->plugin) {
+    tuner->plugin->destroy(tuner->pluginContext);
+    dlclose(tuner->pluginLib);
+  }
+  delete tuner;
+  return flagcxSuccess;
+}
+
+// Time of the inter-cluster part of the single-NIC algorithms, the cheaper of
+// the direct exchange and the ring between the inter ranks, which also have to
+// stage chunks through the host to combine them (reduce).
+static double tunerInterTime(struct flagcxHeteroTuner *t, double bytes,
+                             bool reduce) {
+  int k = t->nclusters;
+  double direct = (k - 1) * bytes / t->netBw + FLAGCX_TUNER_NET_LAT;
+  double ring = 2.0 * (k - 1) / k * bytes / t->netBw +
+                2 * (k - 1) * FLAGCX_TUNER_NET_LAT;
+  if (reduce) {
+    direct += (k + 1) * bytes / t->pcieBw;
+    ring += 3.0 * (k - 1) / k * bytes / t->pcieBw;
+  }
+  return k > 2 ? std::min(direct, ring) : direct;
+}
+
+// Estimated time in us of collective coll moving bytes with algorithm algo.
+static double tunerTime(struct flagcxHeteroTuner *t, flagcxFunc_t coll,
+                        int algo, double bytes) {
+  int n = t->nranks;
+  int k = t->nclusters;
+  double intraLat = FLAGCX_TUNER_INTRA_LAT * log2(t->maxClusterSize + 1);
+  // the smallest cluster carries the largest shards
+  double shard = bytes / t->minClusterSize;
+  switch (algo) {
+  case FLAGCX_HETERO_ALGO_HOST: {
+    // copies to and from the device, then a ring over the host network
+    double ring = (n - 1.0) / n * bytes / t->hostNetBw;
+    double steps = (n - 1) * FLAGCX_TUNER_HOST_LAT;
+    switch (coll) {
+    case flagcxFuncAllReduce:
+      return 2 * bytes / t->pcieBw + 2 * ring + 2 * steps;
+    case flagcxFuncAllGather:
+    case flagcxFuncReduceScatter:
+      return (bytes + bytes / n) / t->pcieBw + ring + steps;
+    default:
+      return 2 * bytes / t->pcieBw + bytes / t->hostNetBw +
+             log2(n) * FLAGCX_TUNER_HOST_LAT;
+    }
+  }
+  case FLAGCX_HETERO_ALGO_SINGLE_NIC:
+    switch (coll) {
+    case flagcxFuncAllReduce:
+      // reduce to the inter rank, inter-cluster allreduce, broadcast
+      return 2 * bytes / t->intraBw + tunerInterTime(t, bytes, true) +
+             2 * intraLat;
+    case flagcxFuncReduceScatter:
+      // reduce, whole buffer to every other cluster, reduce-scatter
+      return 2 * bytes / t->intraBw + (k - 1) * bytes / t->netBw +
+             k * bytes / t->pcieBw + 2 * intraLat + FLAGCX_TUNER_NET_LAT;
+    case flagcxFuncAllGather:
+      // gather, blocks of the other clusters, broadcast
+      return 2 * bytes / t->intraBw +
+             (n - t->minClusterSize) * bytes / n / t->netBw + 2 * intraLat +
+             FLAGCX_TUNER_NET_LAT;
+    case flagcxFuncReduce:
+      return bytes / t->intraBw + tunerInterTime(t, bytes, true) + intraLat;
+    default:
+      return 2 * bytes / t->intraBw + tunerInterTime(t, bytes, false) +
+             2 * intraLat;
+    }
+  case FLAGCX_HETERO_ALGO_MULTI_NIC:
+    switch (coll) {
+    case flagcxFuncAllReduce:
+      // reduce-scatter, shards with the other clusters, allgather
+      return 2 * bytes / t->intraBw + (k - 1) * shard / t->netBw +
+             (k + 1) * shard / t->pcieBw + 2 * intraLat +
+             FLAGCX_TUNER_NET_LAT;
+    case flagcxFuncReduceScatter:
+      return bytes / t->intraBw + (n - t->minClusterSize) * shard / n / t->netBw +
+             k * bytes / n / t->pcieBw + intraLat + FLAGCX_TUNER_NET_LAT;
+    default:
+      return bytes / t->intraBw + (k - 1) * bytes / n / t->netBw + intraLat +
+             FLAGCX_TUNER_NET_LAT;
+    }
+  }
+  return INFINITY;
+}
+
+int flagcxHeteroTunerGetAlgo(struct flagcxHeteroTuner *tuner,
+                             flagcxFunc_t coll, size_t nBytes, int allowed) {
+  if (tuner->plugin) {
+    int algorithm = FLAGCX_HETERO_ALGO_UNDEF;
+    int protocol = FLAGCX_PROTO_UNDEF;
+    int nChannels = 0;
+    if (tuner->plugin->getCollInfo(tuner->pluginContext, coll, nBytes, 0, 0,
+                                   1, &algorithm, &protocol,
+                                   &nChannels) == flagcxSuccess &&
+        algorithm >= 0 && algorithm < FLAGCX_HETERO_NUM_ALGORITHMS &&
+        (allowed & (1 << algorithm))) {
+      return algorithm;
+    }
+  }
+
+  int best = FLAGCX_HETERO_ALGO_UNDEF;
+  double bestTime = INFINITY;
+  for (int algo = 0; algo < FLAGCX_HETERO_NUM_ALGORITHMS; ++algo) {
+    if (!(allowed & (1 << algo)))
+      continue;
+    double time = tunerTime(tuner, coll, algo, (double)nBytes);
+    if (best == FLAGCX_HETERO_ALGO_UNDEF || time < bestTime) {
+      best = algo;
+      bestTime = time;
+    }
+  }
+  TRACE(FLAGCX_TUNING, "Tuner: coll %d %zu bytes -> algo %d (%.1f us)", coll,
+        nBytes, best, bestTime);
+  return best;
+}
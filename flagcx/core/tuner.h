@@ -0,0 +1,40 @@
+#ifndef FLAGCX_TUNER_LAYER_H_
+#define FLAGCX_TUNER_LAYER_H_
+
+#include "flagcx.h"
+#include "flagcx_common.h"
+#include "flagcx_tuner.h"
+#include <stddef.h>
+
+/*
+ * Per-communicator choice of the algorithm of the heterogeneous collectives
+ * (FLAGCX_HETERO_ALGO_*), made on every call from the collective and its size.
+ *
+ * A tuner plugin can be loaded with FLAGCX_TUNER_PLUGIN, either a path or a
+ * name resolved as libflagcx-tuner-<name>.so; it exports a flagcxTuner_t
+ * named FLAGCX_TUNER_PLUGIN_SYMBOL. Its answers take precedence. Otherwise a
+ * built-in cost model estimates the time of every algorithm from the message
+ * size, the cluster sizes and the bandwidths (FLAGCX_TUNER_*_BW, in GB/s; the
+ * NIC bandwidth defaults to the speed of the slowest NIC of the communicator).
+ */
+struct flagcxHeteroTuner;
+
+struct flagcxHeteroTunerTopo {
+  int nranks;
+  int nclusters;
+  const int *clusterSizes;
+  // GB/s, must be the same on all ranks (0: unknown)
+  float netBw;
+};
+
+flagcxResult_t
+flagcxHeteroTunerCreate(const struct flagcxHeteroTunerTopo *topo,
+                        struct flagcxHeteroTuner **tuner);
+flagcxResult_t flagcxHeteroTunerDestroy(struct flagcxHeteroTuner *tuner);
+
+// Algorithm for collective coll moving nBytes (the size of the whole buffer),
+// among the ones set in allowed (bit 1 << FLAGCX_HETERO_ALGO_*, at least one).
+int flagcxHeteroTunerGetAlgo(struct flagcxHeteroTuner *tuner,
+                             flagcxFunc_t coll, size_t nBytes, int allowed);
+
+#endif // end include guard
@@ -0,0 +1,157 @@
+#include "uring.h"
+#include "debug.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+// Headers older than the running kernel may lack the newer flags, the kernel
+// ABI values are used then and rejected at runtime by kernels that predate them.
+#ifndef IORING_SETUP_COOP_TASKRUN
+#define IORING_SETUP_COOP_TASKRUN (1U << 8)
+#endif
+#ifndef IORING_SETUP_SINGLE_ISSUER
+#define IORING_SETUP_SINGLE_ISSUER (1U << 12)
+#endif
+#ifndef IORING_SETUP_DEFER_TASKRUN
+#define IORING_SETUP_DEFER_TASKRUN (1U << 13)
+#endif
+#ifndef IORING_FEAT_EXT_ARG
+#define IORING_FEAT_EXT_ARG (1U << 8)
+#endif
+#ifndef IORING_ENTER_EXT_ARG
+#define IORING_ENTER_EXT_ARG (1U << 3)
+#endif
+
+// Layouts of struct io_uring_getevents_arg and struct __kernel_timespec.
+struct uringGeteventsArg {
+  uint64_t sigmask;
+  uint32_t sigmaskSz;
+  uint32_t pad;
+  uint64_t ts;
+};
+
+struct uringTimespec {
+  int64_t tvSec;
+  long long tvNsec;
+};
+
+static int uringSetup(unsigned entries, struct io_uring_params* params) {
+  return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, void* arg, size_t argSize) {
+  return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize);
+}
+
+flagcxResult_t flagcxUringInit(struct flagcxUring* ring, unsigned entries) {
+  struct io_uring_params params;
+  memset(ring, 0, sizeof(*ring));
+  ring->fd = -1;
+
+  // The rings are only ever used by the thread that created them, let the kernel run completion
+  // work when we enter it rather than interrupting the thread. Older kernels reject these flags.
+  const unsigned setupFlags[] = {IORING_SETUP_CLAMP | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN,
+                                 IORING_SETUP_CLAMP | IORING_SETUP_COOP_TASKRUN, IORING_SETUP_CLAMP};
+  for (unsigned flags : setupFlags) {
+    memset(&params, 0, sizeof(params));
+    params.flags = flags;
+    ring->fd = uringSetup(entries, &params);
+    if (ring->fd >= 0 || errno != EINVAL) break;
+  }
+  if (ring->fd < 0) {
+    INFO(FLAGCX_INIT, "io_uring_setup failed : %s", strerror(errno));
+    return flagcxSystemError;
+  }
+  // Without timed waits, waits that have to honor abort flags only poll the completion queue.
+  if (!(params.features & IORING_FEAT_EXT_ARG)) {
+    INFO(FLAGCX_INIT, "io_uring does not support IORING_FEAT_EXT_ARG, timed waits will poll");
+  }
+  ring->features = params.features;
+  ring->sqEntries = params.sq_entries;
+  ring->cqEntries = params.cq_entries;
+
+  ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+  ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+  if (ring->sqRing == MAP_FAILED || ring->cqRing == MAP_FAILED || ring->sqes == MAP_FAILED) {
+    WARN("io_uring mmap failed : %s", strerror(errno));
+    flagcxUringDestroy(ring);
+    return flagcxSystemError;
+  }
+
+  char* sq = (char*)ring->sqRing;
+  ring->sqHead = (unsigned*)(sq + params.sq_off.head);
+  ring->sqTail = (unsigned*)(sq + params.sq_off.tail);
+  ring->sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+  ring->sqArray = (unsigned*)(sq + params.sq_off.array);
+  char* cq = (char*)ring->cqRing;
+  ring->cqHead = (unsigned*)(cq + params.cq_off.head);
+  ring->cqTail = (unsigned*)(cq + params.cq_off.tail);
+  ring->cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+  ring->sqLocalTail = ring->sqSubmitted = *ring->sqTail;
+  INFO(FLAGCX_INIT, "io_uring ready: %u/%u entries, flags 0x%x, features 0x%x", ring->sqEntries, ring->cqEntries,
+       params.flags, params.features);
+  return flagcxSuccess;
+}
+
+void flagcxUringDestroy(struct flagcxUring* ring) {
+  if (ring->sqes && ring->sqes != MAP_FAILED) munmap(ring->sqes, ring->sqesSize);
+  if (ring->cqRing && ring->cqRing != MAP_FAILED) munmap(ring->cqRing, ring->cqRingSize);
+  if (ring->sqRing && ring->sqRing != MAP_FAILED) munmap(ring->sqRing, ring->sqRingSize);
+  if (ring->fd >= 0) close(ring->fd);
+  memset(ring, 0, sizeof(*ring));
+  ring->fd = -1;
+}
+
+struct io_uring_sqe* flagcxUringGetSqe(struct flagcxUring* ring) {
+  unsigned head = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+  if (ring->sqLocalTail - head >= ring->sqEntries) return NULL;
+  unsigned index = ring->sqLocalTail & *ring->sqMask;
+  ring->sqArray[index] = index;
+  ring->sqLocalTail++;
+  struct io_uring_sqe* sqe = ring->sqes + index;
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+flagcxResult_t flagcxUringSubmitAndWait(struct flagcxUring* ring, unsigned waitNr, uint64_t timeoutNs) {
+  __atomic_store_n(ring->sqTail, ring->sqLocalTail, __ATOMIC_RELEASE);
+  unsigned toSubmit = ring->sqLocalTail - ring->sqSubmitted;
+  int ret;
+  if (ring->features & IORING_FEAT_EXT_ARG) {
+    struct uringTimespec ts;
+    struct uringGeteventsArg arg;
+    memset(&arg, 0, sizeof(arg));
+    if (timeoutNs) {
+      ts.tvSec = timeoutNs / 1000000000;
+      ts.tvNsec = timeoutNs % 1000000000;
+      arg.ts = (uint64_t)(uintptr_t)&ts;
+    }
+    ret = uringEnter(ring->fd, toSubmit, waitNr, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+  } else {
+    // A wait that must time out cannot block, only submit and let the caller reap what is there.
+    ret = uringEnter(ring->fd, toSubmit, timeoutNs ? 0 : waitNr, IORING_ENTER_GETEVENTS, NULL, 0);
+  }
+  if (ret >= 0) {
+    ring->sqSubmitted += ret;
+    return flagcxSuccess;
+  }
+  // Timeouts, signals and a full completion queue only mean the caller has to reap and call again.
+  if (errno == ETIME || errno == EINTR || errno == EAGAIN || errno == EBUSY) return flagcxSuccess;
+  WARN("io_uring_enter failed : %s", strerror(errno));
+  return flagcxSystemError;
+}
+
+bool flagcxUringPopCqe(struct flagcxUring* ring, struct io_uring_cqe* cqe) {
+  unsigned head = *ring->cqHead;
+  if (head == __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)) return false;
+  *cqe = ring->cqes[head & *ring->cqMask];
+  __atomic_store_n(ring->cqHead, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
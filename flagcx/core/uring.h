@@ -0,0 +1,49 @@
+#ifndef FLAGCX_URING_H_
+#define FLAGCX_URING_H_
+
+#include "type.h"
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+// Minimal io_uring instance, driven through the raw system calls so that
+// liburing is needed neither at build nor at run time.
+struct flagcxUring {
+  int fd;
+  unsigned features;
+  unsigned sqEntries;
+  unsigned cqEntries;
+  unsigned* sqHead;
+  unsigned* sqTail;
+  unsigned* sqMask;
+  unsigned* sqArray;
+  unsigned* cqHead;
+  unsigned* cqTail;
+  unsigned* cqMask;
+  struct io_uring_sqe* sqes;
+  struct io_uring_cqe* cqes;
+  void* sqRing;
+  size_t sqRingSize;
+  void* cqRing;
+  size_t cqRingSize;
+  size_t sqesSize;
+  unsigned sqLocalTail; // SQEs handed out by flagcxUringGetSqe
+  unsigned sqSubmitted; // SQEs already made visible to the kernel
+};
+
+// Returns flagcxSystemError when io_uring is not available (old kernel,
+// seccomp filter, io_uring_disabled sysctl...).
+flagcxResult_t flagcxUringInit(struct flagcxUring* ring, unsigned entries);
+void flagcxUringDestroy(struct flagcxUring* ring);
+
+// Next submission entry, cleared, or NULL when the submission queue is full.
+struct io_uring_sqe* flagcxUringGetSqe(struct flagcxUring* ring);
+
+// Submits all pending entries and waits until at least waitNr completions are
+// available or timeoutNs nanoseconds have elapsed (no timeout if 0), in a
+// single io_uring_enter call.
+flagcxResult_t flagcxUringSubmitAndWait(struct flagcxUring* ring, unsigned waitNr, uint64_t timeoutNs);
+
+// Pops the oldest completion into cqe, returns false if there is none.
+bool flagcxUringPopCqe(struct flagcxUring* ring, struct io_uring_cqe* cqe);
+
+#endif
@@ -5,10 +5,20 @@
 #include "check.h"
 #include "cluster.h"
 #include "comm.h"
+#include "compress.h"
 #include "flagcx_hetero.h"
+#include "host_buffer_pool.h"
+#include "host_engine.h"
+#include "host_pipeline.h"
+#include "net.h"
 #include "param.h"
+#include "reduce_kernel.h"
+#include "tuner.h"
+#include "utils.h"
 
+#include <algorithm>
 #include <cassert>
+#include <vector>
 #include <stdio.h>
 #include <string.h>
 
@@ -92,14 +102,69 @@ bool is_homo_comm(flagcxComm_t comm) {
   return comm->comm_type == flagcxCommunicatorHomo;
 }
 
+// Creates the host adaptor comm, the segment pipeline and the engine of the
+// host algorithm if they do not exist yet. All ranks select the host algorithm
+// for the same collectives, so they all get here together.
+static flagcxResult_t hostCommInit(flagcxComm_t comm) {
+  if (comm->host_comm != NULL)
+    return flagcxSuccess;
+  FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorHost]->commInitRank(
+      &comm->host_comm, comm->nranks, NULL, comm->rank, comm->bootstrap));
+  FLAGCXCHECK(flagcxHostPipelineCreate(&comm->host_pipeline));
+  FLAGCXCHECK(flagcxHostEngineCreate(&comm->host_engine));
+  return flagcxSuccess;
+}
+
+// The environment is read once, the collectives check it on every call
 bool use_host_comm() {
-  char *useHostComm = getenv("FLAGCX_USE_HOST_COMM");
-  if (useHostComm) {
-    return std::stoi(useHostComm) == 1;
-  }
-  return false;
+  static bool useHostComm = []() {
+    char *env = getenv("FLAGCX_USE_HOST_COMM");
+    return env != NULL && strtol(env, NULL, 10) == 1;
+  }();
+  return useHostComm;
+}
+
+static bool use_bootstrap_ccl() {
+  static bool useBootstrap = getenv("USE_BOOTSTRAP_CCL") != NULL;
+  return useBootstrap;
 }
 
+// Heterogeneous collectives issued between flagcxGroupStart and
+// flagcxGroupEnd are recorded and run when the outermost group ends, see
+// c2cGroupFlush.
+enum c2cGroupColl {
+  c2cGroupBroadcast,
+  c2cGroupReduce,
+  c2cGroupGather,
+  c2cGroupScatter,
+  c2cGroupAllReduce,
+  c2cGroupAllGather,
+  c2cGroupReduceScatter,
+  c2cGroupAlltoAll,
+  c2cGroupAlltoAllv
+};
+
+struct c2cGroupOp {
+  enum c2cGroupColl coll;
+  const void *sendbuff;
+  void *recvbuff;
+  size_t count;
+  flagcxDataType_t datatype;
+  flagcxRedOp_t op;
+  int root;
+  flagcxStream_t stream;
+  // algorithm resolved by a plan, FLAGCX_HETERO_ALGO_UNDEF otherwise
+  int algo;
+  // sendcounts, sdispls, recvcounts and rdispls of an alltoallv
+  std::vector<size_t> counts;
+  bool done;
+};
+
+struct flagcxC2cGroup {
+  int depth;
+  std::vector<struct c2cGroupOp> ops;
+};
+
 flagcxResult_t flagcxHandleInit(flagcxHandlerGroup_t *handler) {
   (*handler) = NULL;
   flagcxCalloc(handler, 1);
@@ -173,6 +238,189 @@ const char *flagcxGetLastError(flagcxComm_t comm) {
   return "Not implemented.";
 }
 
+FLAGCX_PARAM(C2cProbeBytes, "C2C_PROBE_BYTES", 16 << 20);
+
+#define C2C_PROBE_ITERS 4
+// Weight of the fastest cluster, the others are scaled against it
+#define C2C_WEIGHT_SCALE 1024
+// Bound of the configured weights, keeps count * total weight in 64 bits
+#define C2C_WEIGHT_MAX (1 << 16)
+
+// Host staging throughput of this rank in GB/s, timed with round trips of
+// FLAGCX_C2C_PROBE_BYTES between the device and pinned host memory, which is
+// how the multi-NIC allreduce combines the partial results of the clusters
+// (see c2cReducePeers). 0 when the probe is disabled.
+static flagcxResult_t c2cProbeStagingBw(float *bw) {
+  *bw = 0;
+  size_t size = flagcxParamC2cProbeBytes();
+  if (size == 0)
+    return flagcxSuccess;
+  flagcxStream_t stream;
+  void *devbuff, *hostbuff;
+  FLAGCXCHECK(deviceAdaptor->streamCreate(&stream));
+  FLAGCXCHECK(
+      deviceAdaptor->deviceMalloc(&devbuff, size, flagcxMemDevice, stream));
+  FLAGCXCHECK(
+      deviceAdaptor->deviceMalloc(&hostbuff, size, flagcxMemHost, NULL));
+  uint64_t t0 = 0;
+  for (int iter = 0; iter <= C2C_PROBE_ITERS; ++iter) {
+    // the first round trip warms up the copy engines
+    if (iter == 1) {
+      FLAGCXCHECK(deviceAdaptor->streamSynchronize(stream));
+      t0 = clockNano();
+    }
+    FLAGCXCHECK(deviceAdaptor->deviceMemcpy(
+        hostbuff, devbuff, size, flagcxMemcpyDeviceToHost, stream, NULL));
+    FLAGCXCHECK(deviceAdaptor->deviceMemcpy(
+        devbuff, hostbuff, size, flagcxMemcpyHostToDevice, stream, NULL));
+  }
+  FLAGCXCHECK(deviceAdaptor->streamSynchronize(stream));
+  uint64_t elapsed = clockNano() - t0;
+  // bytes per ns are GB/s
+  if (elapsed > 0)
+    *bw = 2.0 * C2C_PROBE_ITERS * size / elapsed;
+  FLAGCXCHECK(deviceAdaptor->deviceFree(hostbuff, flagcxMemHost, NULL));
+  FLAGCXCHECK(deviceAdaptor->deviceFree(devbuff, flagcxMemDevice, stream));
+  FLAGCXCHECK(deviceAdaptor->streamDestroy(stream));
+  return flagcxSuccess;
+}
+
+// Sets comm->cluster_weights, the relative throughput of the clusters in the
+// multi-NIC allreduce. FLAGCX_C2C_CLUSTER_WEIGHTS gives them as a list of
+// nclusters positive integers, otherwise they are measured: a rank moves data
+// at the lower of the speed of its NIC (netBw, 0 if unknown) and of its host
+// staging, the ranks of a cluster share its range evenly, so a cluster runs
+// at the pace of its slowest rank times its number of ranks. Must be called by
+// all ranks.
+static flagcxResult_t c2cClusterWeights(flagcxComm_t comm,
+                                        bootstrapState *state, float netBw) {
+  int nclusters = comm->nclusters;
+  FLAGCXCHECK(flagcxCalloc(&comm->cluster_weights, nclusters));
+
+  const char *env = flagcxGetEnv("FLAGCX_C2C_CLUSTER_WEIGHTS");
+  if (env != NULL) {
+    int n = 0;
+    const char *p = env;
+    while (n < nclusters && *p != '\0') {
+      char *next;
+      long w = strtol(p, &next, 10);
+      if (next == p || w <= 0)
+        break;
+      comm->cluster_weights[n++] = (int)std::min(w, (long)C2C_WEIGHT_MAX);
+      p = *next == ',' ? next + 1 : next;
+    }
+    if (n == nclusters && *p == '\0') {
+      INFO(FLAGCX_INIT, "FLAGCX_C2C_CLUSTER_WEIGHTS set by environment to %s",
+           env);
+      return flagcxSuccess;
+    }
+    WARN("Invalid FLAGCX_C2C_CLUSTER_WEIGHTS %s, expected %d positive "
+         "integers, measuring the clusters instead",
+         env, nclusters);
+  }
+
+  // only the multi-NIC allreduce uses the weights
+  if (!(comm->hetero_algos & (1 << FLAGCX_HETERO_ALGO_MULTI_NIC))) {
+    for (int i = 0; i < nclusters; ++i) {
+      comm->cluster_weights[i] = 1;
+    }
+    return flagcxSuccess;
+  }
+
+  float *bwData;
+  FLAGCXCHECK(flagcxCalloc(&bwData, comm->nranks));
+  FLAGCXCHECK(c2cProbeStagingBw(&bwData[comm->rank]));
+  if (netBw > 0 &&
+      (bwData[comm->rank] == 0 || netBw < bwData[comm->rank])) {
+    bwData[comm->rank] = netBw;
+  }
+  FLAGCXCHECK(bootstrapAllGather(state, (void *)bwData, sizeof(float)));
+  std::vector<float> clusterBw(nclusters, 0);
+  float maxBw = 0;
+  for (int i = 0; i < nclusters; ++i) {
+    float slowest = 0;
+    for (int r = comm->cluster_offsets[i]; r < comm->cluster_offsets[i + 1];
+         ++r) {
+      if (r == comm->cluster_offsets[i] || bwData[r] < slowest)
+        slowest = bwData[r];
+    }
+    clusterBw[i] = slowest * comm->cluster_sizes[i];
+    maxBw = std::max(maxBw, clusterBw[i]);
+  }
+  free(bwData);
+  for (int i = 0; i < nclusters; ++i) {
+    // unmeasured clusters get even shares
+    comm->cluster_weights[i] =
+        maxBw > 0 ? std::max(1, (int)(C2C_WEIGHT_SCALE * clusterBw[i] / maxBw +
+                                      0.5f))
+                  : 1;
+    INFO(FLAGCX_INIT, "cluster %d: %.2f GB/s, weight %d", i, clusterBw[i],
+         comm->cluster_weights[i]);
+  }
+  return flagcxSuccess;
+}
+
+FLAGCX_PARAM(C2cGateways, "C2C_GATEWAYS", 1);
+
+// Sets the gateways of the clusters, the ranks striping the inter-cluster
+// phase of the single-NIC allreduce. The gateways of a cluster are its inter
+// rank followed, in rank order, by the first rank attached to each of its
+// other NICs (the NIC the topology finds closest to the GPU of a rank). All
+// clusters get the same number of gateways, at most FLAGCX_C2C_GATEWAYS and at
+// most the number of NICs of the cluster with the fewest. Must be called by
+// all ranks.
+static flagcxResult_t c2cSelectGateways(flagcxComm_t comm,
+                                        bootstrapState *state) {
+  struct nic {
+    uint64_t hostHash;
+    int netDev;
+  };
+  struct nic *nicData;
+  FLAGCXCHECK(flagcxCalloc(&nicData, comm->nranks));
+  nicData[comm->rank].hostHash = getHostHash();
+  nicData[comm->rank].netDev = comm->hetero_comm->netDev;
+  FLAGCXCHECK(bootstrapAllGather(state, (void *)nicData, sizeof(struct nic)));
+
+  std::vector<std::vector<int>> candidates(comm->nclusters);
+  int ngateways = std::max(1, (int)flagcxParamC2cGateways());
+  for (int i = 0; i < comm->nclusters; ++i) {
+    std::vector<int> &c = candidates[i];
+    c.push_back(comm->cluster_inter_ranks[i]);
+    for (int r = comm->cluster_offsets[i]; r < comm->cluster_offsets[i + 1];
+         ++r) {
+      bool seen = false;
+      for (int g : c) {
+        seen |= nicData[g].hostHash == nicData[r].hostHash &&
+                nicData[g].netDev == nicData[r].netDev;
+      }
+      if (!seen)
+        c.push_back(r);
+    }
+    ngateways = std::min(ngateways, (int)c.size());
+  }
+  free(nicData);
+
+  comm->ngateways = ngateways;
+  FLAGCXCHECK(
+      flagcxCalloc(&comm->cluster_gateways, comm->nclusters * ngateways));
+  for (int i = 0; i < comm->nclusters; ++i) {
+    for (int g = 0; g < ngateways; ++g) {
+      comm->cluster_gateways[i * ngateways + g] = candidates[i][g];
+    }
+  }
+  if (ngateways > 1) {
+    int me = comm->cluster_ids[comm->rank];
+    std::string ranks;
+    for (int g = 0; g < ngateways; ++g) {
+      ranks += (g ? "," : "") +
+               std::to_string(comm->cluster_gateways[me * ngateways + g]);
+    }
+    INFO(FLAGCX_INIT, "cluster %d: %d gateways (ranks %s)", me, ngateways,
+         ranks.c_str());
+  }
+  return flagcxSuccess;
+}
+
 flagcxResult_t flagcxCommInitRank(flagcxComm_t *comm, int nranks,
                                   flagcxUniqueId_t commId, int rank) {
   if (nranks < 1 || rank < 0 || rank >= nranks) {
@@ -196,8 +444,24 @@ flagcxResult_t flagcxCommInitRank(flagcxComm_t *comm, int nranks,
   (*comm)->host_comm = NULL;
   (*comm)->homo_comm = NULL;
   (*comm)->hetero_comm = NULL;
+  (*comm)->host_buffer_pool = NULL;
+  (*comm)->host_pipeline = NULL;
+  (*comm)->tuner = NULL;
+  (*comm)->c2c_group = NULL;
+  (*comm)->hetero_algos = 0;
+  (*comm)->host_colls = 0;
   (*comm)->cluster_ids = NULL;
   (*comm)->cluster_sizes = NULL;
+  (*comm)->cluster_offsets = NULL;
+  (*comm)->cluster_weights = NULL;
+  (*comm)->ngateways = 1;
+  (*comm)->cluster_gateways = NULL;
+  (*comm)->barrier_buff = NULL;
+  (*comm)->bcast_stream = NULL;
+  (*comm)->reduce_events[0] = (*comm)->reduce_events[1] = NULL;
+  (*comm)->alltoall_buff = NULL;
+  (*comm)->alltoall_buff_size = 0;
+  (*comm)->host_engine = NULL;
   (*comm)->cluster_inter_ranks = NULL;
   (*comm)->globalrank2homorank = NULL;
   (*comm)->comm_type = flagcxCommunicatorUnknown;
@@ -225,6 +489,26 @@ flagcxResult_t flagcxCommInitRank(flagcxComm_t *comm, int nranks,
   // Get current gpu vendor
   flagcxVendor vendor;
   deviceAdaptor->getVendor(vendor.internal);
+  // FLAGCX_VENDOR overrides the detected vendor, e.g. to split the ranks of a
+  // single vendor into clusters to exercise the heterogeneous paths. It is a
+  // comma-separated list of n vendors, rank r taking entry r * n / nranks, so
+  // that ranks sharing a process (and its environment) can still be split.
+  const char *vendorOverride = flagcxGetEnv("FLAGCX_VENDOR");
+  if (vendorOverride != NULL) {
+    int nvendors = 1;
+    for (const char *c = vendorOverride; *c; ++c) {
+      if (*c == ',')
+        nvendors++;
+    }
+    const char *entry = vendorOverride;
+    for (int i = (int)((int64_t)rank * nvendors / nranks); i > 0; --i) {
+      entry = strchr(entry, ',') + 1;
+    }
+    size_t len = strcspn(entry, ",");
+    len = std::min(len, (size_t)MAX_VENDOR_LEN - 1);
+    memcpy(vendor.internal, entry, len);
+    vendor.internal[len] = '\0';
+  }
   FLAGCXCHECK(flagcxCalloc(&vendorData, nranks));
   memcpy(vendorData + rank, &vendor, sizeof(flagcxVendor));
   FLAGCXCHECK(
@@ -272,6 +556,13 @@ flagcxResult_t flagcxCommInitRank(flagcxComm_t *comm, int nranks,
   clusterSizes[cid] = nranks - sum;
   (*comm)->cluster_sizes = clusterSizes;
 
+  int *clusterOffsets;
+  FLAGCXCHECK(flagcxCalloc(&clusterOffsets, (*comm)->nclusters + 1));
+  for (int i = 0; i < (*comm)->nclusters; ++i) {
+    clusterOffsets[i + 1] = clusterOffsets[i] + clusterSizes[i];
+  }
+  (*comm)->cluster_offsets = clusterOffsets;
+
   for (int i = 0; i < nranks; ++i) {
     if (clusterInterRankData[i] != -1) {
       clusterInterRanks[clusterIdData[i]] = clusterInterRankData[i];
@@ -356,11 +647,76 @@ flagcxResult_t flagcxCommInitRank(flagcxComm_t *comm, int nranks,
     FLAGCXCHECK(
         flagcxHeteroCommInitRank(&(*comm)->hetero_comm, nranks, *commId, rank));
 
-    // Init host cclAdaptor
-    if (use_host_comm() || (*comm)->has_single_rank_homo_comm) {
-      FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorHost]->commInitRank(
-          &(*comm)->host_comm, nranks, commId, rank, state));
+    // Host staging buffers, also used by the device path to combine the
+    // partial results of the clusters
+    FLAGCXCHECK(flagcxHostBufferPoolCreate(&(*comm)->host_buffer_pool));
+
+    // The host algorithm is left to the tuner unless FLAGCX_USE_HOST_COMM
+    // turns it off. Its comm, pipeline and engine are only created when
+    // FLAGCX_USE_HOST_COMM=1 forces it, otherwise on its first selection
+    // (see hostCommInit).
+    char *useHostComm = getenv("FLAGCX_USE_HOST_COMM");
+    bool hostCommDisabled =
+        useHostComm && strtol(useHostComm, NULL, 10) != 1;
+    bool hostAllowed =
+        !hostCommDisabled || (*comm)->has_single_rank_homo_comm;
+    if (hostAllowed) {
+      for (int coll = 0; coll < flagcxNumColls; coll++) {
+        int supported = 1;
+        if (cclAdaptors[flagcxCCLAdaptorHost]->collSupported != NULL) {
+          FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorHost]->collSupported(
+              (flagcxCollType_t)coll, &supported));
+        }
+        if (supported) {
+          (*comm)->host_colls |= 1 << coll;
+        }
+      }
+    }
+    if (use_host_comm()) {
+      FLAGCXCHECK(hostCommInit(*comm));
+    }
+
+    // Algorithms the environment leaves to the tuner
+    (*comm)->hetero_algos = (1 << FLAGCX_HETERO_NUM_ALGORITHMS) - 1;
+    if (!hostAllowed) {
+      (*comm)->hetero_algos &= ~(1 << FLAGCX_HETERO_ALGO_HOST);
+    } else if (use_host_comm()) {
+      (*comm)->hetero_algos = 1 << FLAGCX_HETERO_ALGO_HOST;
+    }
+    if ((*comm)->support_multi_nic >= 0) {
+      (*comm)->hetero_algos &= ~(1 << FLAGCX_HETERO_ALGO_SINGLE_NIC);
+    } else if (enableMultiNicSupport) {
+      (*comm)->hetero_algos &= ~(1 << FLAGCX_HETERO_ALGO_MULTI_NIC);
+    }
+
+    // The tuner has to pick the same algorithm on all ranks, so it models the
+    // slowest NIC of the communicator
+    float *netBwData;
+    FLAGCXCHECK(flagcxCalloc(&netBwData, nranks));
+    int ndev = 0;
+    flagcxNetProperties_t props;
+    if (flagcxNetIb.devices(&ndev) == flagcxSuccess &&
+        (*comm)->hetero_comm->netDev < ndev &&
+        flagcxNetIb.getProperties((*comm)->hetero_comm->netDev, &props) ==
+            flagcxSuccess) {
+      // Mbps to GB/s
+      netBwData[rank] = props.speed / 8000.0;
+    }
+    float myNetBw = netBwData[rank];
+    FLAGCXCHECK(bootstrapAllGather(state, (void *)netBwData, sizeof(float)));
+    struct flagcxHeteroTunerTopo topo = {nranks, (*comm)->nclusters,
+                                         (*comm)->cluster_sizes, 0};
+    for (int i = 0; i < nranks; ++i) {
+      if (netBwData[i] > 0 && (topo.netBw == 0 || netBwData[i] < topo.netBw)) {
+        topo.netBw = netBwData[i];
+      }
     }
+    free(netBwData);
+    FLAGCXCHECK(flagcxHeteroTunerCreate(&topo, &(*comm)->tuner));
+    FLAGCXCHECK(c2cClusterWeights(*comm, state, myNetBw));
+    FLAGCXCHECK(c2cSelectGateways(*comm, state));
+
+    (*comm)->c2c_group = new flagcxC2cGroup();
   }
 
   free(clusterInterRankData);
@@ -385,19 +741,42 @@ flagcxResult_t flagcxCommDestroy(flagcxComm_t comm) {
   // Destroy cluster info
   free(comm->cluster_ids);
   free(comm->cluster_sizes);
+  free(comm->cluster_offsets);
+  free(comm->cluster_weights);
+  free(comm->cluster_gateways);
   free(comm->globalrank2homorank);
+  if (comm->barrier_buff != NULL) {
+    deviceAdaptor->deviceFree(comm->barrier_buff, flagcxMemDevice, NULL);
+  }
+  if (comm->bcast_stream != NULL) {
+    deviceAdaptor->streamDestroy(comm->bcast_stream);
+  }
+  for (flagcxEvent_t event : comm->reduce_events) {
+    if (event != NULL) {
+      deviceAdaptor->eventDestroy(event);
+    }
+  }
+  if (comm->alltoall_buff != NULL) {
+    deviceAdaptor->deviceFree(comm->alltoall_buff, flagcxMemDevice, NULL);
+  }
 
   // Destroy bootstrap state and net
   bootstrapClose(comm->bootstrap);
 
   // Destroy hetero comm
   if (!is_homo_comm(comm)) {
+    // Complete the queued host-comm work before tearing down its comms
+    FLAGCXCHECK(flagcxHostEngineDestroy(comm->host_engine));
     FLAGCXCHECK(flagcxHeteroCommDestroy(comm->hetero_comm));
-    // Destroy homo comm
-    if (use_host_comm()) {
+    // Destroy host comm
+    if (comm->host_comm != NULL) {
       FLAGCXCHECK(
           cclAdaptors[flagcxCCLAdaptorHost]->commDestroy(comm->host_comm));
     }
+    FLAGCXCHECK(flagcxHeteroTunerDestroy(comm->tuner));
+    delete comm->c2c_group;
+    FLAGCXCHECK(flagcxHostPipelineDestroy(comm->host_pipeline));
+    FLAGCXCHECK(flagcxHostBufferPoolDestroy(comm->host_buffer_pool));
   }
 
   return flagcxSuccess;
@@ -464,34 +843,902 @@ flagcxResult_t flagcxCommGetAsyncError(flagcxComm_t comm,
   return flagcxNotSupported;
 }
 
+// Tag of the bootstrap messages of flagcxBarrier
+#define FLAGCX_BARRIER_TAG -6768
+
+// Barrier over the bootstrap sockets of a heterogeneous communicator, without
+// device memory. The ranks of a cluster raise an arrival flag at the inter rank
+// of their cluster, the inter ranks synchronize with a dissemination barrier
+// and lower the flags of their cluster, so that only log2(nclusters) rounds
+// cross the clusters.
+static flagcxResult_t c2cHostBarrier(flagcxComm_t comm) {
+  int cluster = comm->cluster_ids[comm->rank];
+  int interRank = comm->cluster_inter_ranks[cluster];
+  char flag = 1;
+  if (comm->rank != interRank) {
+    FLAGCXCHECK(bootstrapSend(comm->bootstrap, interRank, FLAGCX_BARRIER_TAG,
+                              &flag, sizeof(flag)));
+    FLAGCXCHECK(bootstrapRecv(comm->bootstrap, interRank, FLAGCX_BARRIER_TAG,
+                              &flag, sizeof(flag)));
+    return flagcxSuccess;
+  }
+  for (int r = 0; r < comm->nranks; ++r) {
+    if (r != interRank && comm->cluster_ids[r] == cluster) {
+      FLAGCXCHECK(bootstrapRecv(comm->bootstrap, r, FLAGCX_BARRIER_TAG, &flag,
+                                sizeof(flag)));
+    }
+  }
+  FLAGCXCHECK(bootstrapIntraNodeBarrier(comm->bootstrap,
+                                        comm->cluster_inter_ranks, cluster,
+                                        comm->nclusters, FLAGCX_BARRIER_TAG));
+  for (int r = 0; r < comm->nranks; ++r) {
+    if (r != interRank && comm->cluster_ids[r] == cluster) {
+      FLAGCXCHECK(bootstrapSend(comm->bootstrap, r, FLAGCX_BARRIER_TAG, &flag,
+                                sizeof(flag)));
+    }
+  }
+  return flagcxSuccess;
+}
+
 flagcxResult_t flagcxBarrier(flagcxComm_t comm, flagcxStream_t stream) {
-  void *barrierBuff;
-  deviceAdaptor->deviceMalloc(&barrierBuff, comm->nranks, flagcxMemDevice,
-                              stream);
-  deviceAdaptor->deviceMemset(barrierBuff, 0, comm->nranks, flagcxMemDevice,
+  FLAGCXCHECK(flagcxEnsureCommReady(comm));
+  // the barrier also covers the work already enqueued on stream
+  deviceAdaptor->streamSynchronize(stream);
+  if (is_homo_comm(comm)) {
+    return bootstrapBarrier(comm->bootstrap, comm->rank, comm->nranks,
+                            FLAGCX_BARRIER_TAG);
+  }
+  // the host engine shares the bootstrap sockets
+  FLAGCXCHECK(flagcxHostEngineDrain(comm->host_engine));
+  return c2cHostBarrier(comm);
+}
+
+flagcxResult_t flagcxStreamBarrier(flagcxComm_t comm, flagcxStream_t stream) {
+  FLAGCXCHECK(flagcxEnsureCommReady(comm));
+  // two flags, sent from the first one and received into the second one
+  if (comm->barrier_buff == NULL) {
+    FLAGCXCHECK(deviceAdaptor->deviceMalloc(&comm->barrier_buff, 2,
+                                            flagcxMemDevice, stream));
+    FLAGCXCHECK(deviceAdaptor->deviceMemset(comm->barrier_buff, 0, 2,
+                                            flagcxMemDevice, stream));
+  }
+  void *flag = comm->barrier_buff;
+  if (is_homo_comm(comm)) {
+    return cclAdaptors[flagcxCCLAdaptorDevice]->allReduce(
+        flag, flag, 1, flagcxChar, flagcxMax, comm->homo_comm, stream);
+  }
+
+  // arrival of the cluster at its inter rank
+  if (comm->homo_ranks > 1) {
+    FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->reduce(
+        flag, flag, 1, flagcxChar, flagcxMax, comm->homo_inter_rank,
+        comm->homo_comm, stream));
+  }
+  // dissemination barrier between the inter ranks. The proxies send as soon
+  // as a round is posted, so a round waits for the arrival of the cluster and
+  // for the previous round before telling the next inter rank.
+  if (comm->homo_inter_rank == comm->homo_rank) {
+    void *peerflag = static_cast<void *>(static_cast<char *>(flag) + 1);
+    int me = comm->cluster_ids[comm->rank];
+    int k = comm->nclusters;
+    for (int mask = 1; mask < k; mask <<= 1) {
+      // TODO: use stream wait rather than stream sync to avoid cpu blocking
+      FLAGCXCHECK(deviceAdaptor->streamSynchronize(stream));
+      flagcxGroupStart(comm);
+      FLAGCXCHECK(flagcxHeteroSend(flag, 1, flagcxChar,
+                                   comm->cluster_inter_ranks[(me + mask) % k],
+                                   comm->hetero_comm, stream));
+      FLAGCXCHECK(
+          flagcxHeteroRecv(peerflag, 1, flagcxChar,
+                           comm->cluster_inter_ranks[(me - mask + k) % k],
+                           comm->hetero_comm, stream));
+      flagcxGroupEnd(comm);
+    }
+  }
+  // release of the cluster
+  if (comm->homo_ranks > 1) {
+    FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->broadcast(
+        flag, flag, 1, flagcxChar, comm->homo_inter_rank, comm->homo_comm,
+        stream));
+  }
+  return flagcxSuccess;
+}
+
+#define HETERO_ALGO_MASK(algo) (1 << (algo))
+#define HETERO_ALGO_DEVICE                                                     \
+  (HETERO_ALGO_MASK(FLAGCX_HETERO_ALGO_SINGLE_NIC) |                           \
+   HETERO_ALGO_MASK(FLAGCX_HETERO_ALGO_MULTI_NIC))
+
+// Picks the algorithm of a heterogeneous collective among the ones it
+// implements (allowed) and the environment permits, asking the tuner only when
+// there is a choice left.
+static int heteroAlgo(flagcxComm_t comm, flagcxFunc_t coll, size_t nBytes,
+                      int allowed) {
+  int algos = allowed & comm->hetero_algos;
+  if (algos == 0) {
+    // forced to an algorithm this collective does not implement
+    algos = allowed;
+  }
+  if ((algos & (algos - 1)) == 0) {
+    return __builtin_ctz(algos);
+  }
+  return flagcxHeteroTunerGetAlgo(comm->tuner, coll, nBytes, algos);
+}
+
+// Codec the inter-cluster transfers of datatype use in the current
+// collective, see c2cCompressScope.
+static flagcxCodec_t c2cCodec(flagcxComm_t comm, flagcxDataType_t datatype) {
+  if (!comm->hetero_comm->compress || datatype != flagcxFloat)
+    return flagcxCodecNone;
+  return (flagcxCodec_t)comm->hetero_comm->codec;
+}
+
+// Replaces the count elements of host memory data with what a peer decodes
+// when they are sent as messages of piececount elements, the last one taking
+// the remainder. wire holds the encoded size of a message.
+static void c2cCodecRoundTripHost(flagcxCodec_t codec, void *data,
+                                  size_t count, size_t piececount,
+                                  void *wire) {
+  float *values = static_cast<float *>(data);
+  for (size_t begin = 0; begin < count; begin += piececount) {
+    size_t n = std::min(piececount, count - begin);
+    flagcxCodecEncode(codec, wire, values + begin, n);
+    flagcxCodecDecode(codec, values + begin, wire, n);
+  }
+}
+
+// Device version of c2cCodecRoundTripHost: values kept by the rank that sends
+// them compressed are replaced by what the receivers decode, so that all ranks
+// end up with the same bits. Nothing to do without compression.
+static flagcxResult_t c2cCodecRoundTrip(void *buff, size_t count,
+                                        size_t piececount,
+                                        flagcxDataType_t datatype,
+                                        flagcxComm_t comm,
+                                        flagcxStream_t stream) {
+  flagcxCodec_t codec = c2cCodec(comm, datatype);
+  if (codec == flagcxCodecNone || count == 0)
+    return flagcxSuccess;
+  piececount = std::min(piececount, count);
+  size_t size = count * sizeof(float);
+  void *hostbuff;
+  FLAGCXCHECK(flagcxHostBufferAcquire(
+      comm->host_buffer_pool,
+      size + flagcxCodecEncodedSize(codec, piececount), &hostbuff));
+  char *host = static_cast<char *>(hostbuff);
+  FLAGCXCHECK(deviceAdaptor->deviceMemcpy(
+      host, buff, size, flagcxMemcpyDeviceToHost, stream, NULL));
+  FLAGCXCHECK(deviceAdaptor->streamSynchronize(stream));
+  c2cCodecRoundTripHost(codec, host, count, piececount, host + size);
+  FLAGCXCHECK(deviceAdaptor->deviceMemcpy(
+      buff, host, size, flagcxMemcpyHostToDevice, stream, NULL));
+  FLAGCXCHECK(deviceAdaptor->streamSynchronize(stream));
+  FLAGCXCHECK(flagcxHostBufferRelease(comm->host_buffer_pool, hostbuff));
+  return flagcxSuccess;
+}
+
+FLAGCX_PARAM(C2cReduceChunkSize, "C2C_REDUCE_CHUNK_SIZE", 1 << 20);
+
+// Reduces the partial results received from the other clusters (npeers
+// consecutive blocks of count elements in peerbuff) into buff. The device
+// adaptors have no element-wise kernel, so the blocks are staged through a
+// pinned host buffer and combined by the host reduction kernels. The staging
+// is cut into segments of FLAGCX_C2C_REDUCE_CHUNK_SIZE bytes per block: the
+// copy to the host of segment i + 1 and the copy back of segment i - 1 run
+// while segment i is reduced, so the time approaches the largest of the
+// copies and the reduction rather than their sum. The operands are combined
+// in order, buff being operand own and the peer blocks the others. With
+// roundTrip, buff is the same message the peers received compressed and is
+// replaced by what they decoded first: ranks reducing the same operands then
+// compute the same bits.
+static flagcxResult_t c2cReducePeers(void *buff, void *peerbuff, int npeers,
+                                     size_t count, flagcxDataType_t datatype,
+                                     flagcxRedOp_t op, flagcxComm_t comm,
+                                     flagcxStream_t stream, int own = 0,
+                                     bool roundTrip = false) {
+  if (npeers == 0 || count == 0)
+    return flagcxSuccess;
+  size_t typesize = getFlagcxDataTypeSize(datatype);
+  size_t size = count * typesize;
+  flagcxCodec_t codec =
+      roundTrip ? c2cCodec(comm, datatype) : flagcxCodecNone;
+  // segments hold whole fp8 blocks, encoding them one by one is the same as
+  // encoding the message
+  size_t align = FLAGCX_CODEC_FP8_BLOCK;
+  size_t segcount = std::max(
+      (size_t)std::max(flagcxParamC2cReduceChunkSize(), (int64_t)0) /
+          typesize / align * align,
+      align);
+  size_t nsegs = (count + segcount - 1) / segcount;
+  size_t wiresize = codec == flagcxCodecNone
+                        ? 0
+                        : flagcxCodecEncodedSize(codec,
+                                                 std::min(segcount, count));
+  void *hostbuff;
+  FLAGCXCHECK(flagcxHostBufferAcquire(comm->host_buffer_pool,
+                                      (npeers + 1) * size + wiresize,
+                                      &hostbuff));
+  char *host = static_cast<char *>(hostbuff);
+  for (flagcxEvent_t &event : comm->reduce_events) {
+    if (event == NULL) {
+      FLAGCXCHECK(deviceAdaptor->eventCreate(&event));
+    }
+  }
+
+  // block 0 of host is the own one, block j + 1 peer block j
+  auto copyIn = [&](size_t seg) -> flagcxResult_t {
+    size_t begin = seg * segcount;
+    size_t bytes = (std::min(count, begin + segcount) - begin) * typesize;
+    for (int j = 0; j <= npeers; ++j) {
+      const char *src = j == 0 ? static_cast<const char *>(buff)
+                               : static_cast<const char *>(peerbuff) +
+                                     (j - 1) * size;
+      FLAGCXCHECK(deviceAdaptor->deviceMemcpy(
+          host + j * size + begin * typesize,
+          const_cast<char *>(src) + begin * typesize, bytes,
+          flagcxMemcpyDeviceToHost, stream, NULL));
+    }
+    return deviceAdaptor->eventRecord(comm->reduce_events[seg % 2], stream);
+  };
+
+  // operand k is the own block at k == own, peer block k or k - 1 otherwise
+  char *acc = own == 0 ? host : host + size;
+  FLAGCXCHECK(copyIn(0));
+  for (size_t seg = 0; seg < nsegs; ++seg) {
+    if (seg + 1 < nsegs) {
+      FLAGCXCHECK(copyIn(seg + 1));
+    }
+    FLAGCXCHECK(deviceAdaptor->eventSynchronize(comm->reduce_events[seg % 2]));
+    size_t begin = seg * segcount;
+    size_t n = std::min(count, begin + segcount) - begin;
+    size_t offset = begin * typesize;
+    if (codec != flagcxCodecNone) {
+      c2cCodecRoundTripHost(codec, host + offset, n, n,
+                            host + (npeers + 1) * size);
+    }
+    for (int k = 1; k <= npeers; ++k) {
+      char *operand = k == own ? host : host + (k < own ? k + 1 : k) * size;
+      FLAGCXCHECK(flagcxHostReduce(acc + offset, acc + offset,
+                                   operand + offset, n, datatype, op));
+    }
+    FLAGCXCHECK(deviceAdaptor->deviceMemcpy(
+        static_cast<char *>(buff) + offset, acc + offset, n * typesize,
+        flagcxMemcpyHostToDevice, stream, NULL));
+  }
+  FLAGCXCHECK(deviceAdaptor->streamSynchronize(stream));
+  FLAGCXCHECK(flagcxHostBufferRelease(comm->host_buffer_pool, hostbuff));
+  return flagcxSuccess;
+}
+
+// Range [*begin, *end) of the shard of rank out of nranks when count elements
+// are split by c2cReduceScatterRange: count / nranks elements each, the last
+// rank also takes the remainder.
+static void c2cShardRange(size_t count, int nranks, int rank, size_t *begin,
+                          size_t *end) {
+  size_t shardcount = count / nranks;
+  *begin = shardcount * rank;
+  *end = rank == nranks - 1 ? count : *begin + shardcount;
+}
+
+// Range [*begin, *end) of the count elements of the multi-NIC allreduce that
+// cluster reduces, proportional to its weight (see c2cClusterWeights).
+static void c2cClusterRange(flagcxComm_t comm, size_t count, int cluster,
+                            size_t *begin, size_t *end) {
+  uint64_t before = 0, total = 0;
+  for (int i = 0; i < comm->nclusters; ++i) {
+    if (i < cluster)
+      before += comm->cluster_weights[i];
+    total += comm->cluster_weights[i];
+  }
+  *begin = count * before / total;
+  *end = count * (before + comm->cluster_weights[cluster]) / total;
+}
+
+// Intra-cluster reduce-scatter of count elements, the shard of this rank
+// (see c2cShardRange) is written to shardbuff.
+static flagcxResult_t c2cReduceScatterRange(const void *sendbuff,
+                                            void *shardbuff, size_t count,
+                                            flagcxDataType_t datatype,
+                                            flagcxRedOp_t op,
+                                            flagcxComm_t comm,
+                                            flagcxStream_t stream) {
+  size_t shardcount = count / comm->homo_ranks;
+  size_t tailcount = count - shardcount * comm->homo_ranks;
+  size_t typesize = getFlagcxDataTypeSize(datatype);
+  if (shardcount > 0) {
+    FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->reduceScatter(
+        sendbuff, shardbuff, shardcount, datatype, op, comm->homo_comm,
+        stream));
+  }
+  if (tailcount > 0) {
+    FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->reduce(
+        static_cast<const void *>(static_cast<const char *>(sendbuff) +
+                                  shardcount * comm->homo_ranks * typesize),
+        static_cast<void *>(static_cast<char *>(shardbuff) +
+                            shardcount * typesize),
+        tailcount, datatype, op, comm->homo_ranks - 1, comm->homo_comm,
+        stream));
+  }
+  return flagcxSuccess;
+}
+
+// Inverse of c2cReduceScatterRange: every rank holds its shard of the count
+// elements of buff in place, the shards are gathered on all ranks.
+static flagcxResult_t c2cAllGatherRange(void *buff, size_t count,
+                                        flagcxDataType_t datatype,
+                                        flagcxComm_t comm,
+                                        flagcxStream_t stream) {
+  size_t shardcount = count / comm->homo_ranks;
+  size_t tailcount = count - shardcount * comm->homo_ranks;
+  size_t typesize = getFlagcxDataTypeSize(datatype);
+  if (shardcount > 0) {
+    FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->allGather(
+        static_cast<void *>(static_cast<char *>(buff) +
+                            shardcount * comm->homo_rank * typesize),
+        buff, shardcount, datatype, comm->homo_comm, stream));
+  }
+  if (tailcount > 0) {
+    void *tail = static_cast<void *>(static_cast<char *>(buff) +
+                                     shardcount * comm->homo_ranks * typesize);
+    FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->broadcast(
+        tail, tail, tailcount, datatype, comm->homo_ranks - 1, comm->homo_comm,
+        stream));
+  }
+  return flagcxSuccess;
+}
+
+// Posts the hetero sends (or receives) of the elements [begin, end) of a
+// range of count elements, held in buff, to (or from) the ranks
+// [start, start + nranks) of another cluster, each of which owns the part of
+// the range given by c2cShardRange(count, nranks, .). Clusters of different
+// sizes split the range differently, a shard overlaps one or several shards
+// of the other cluster. The messages are further split at cuts, if any (see
+// c2cCodecCuts).
+static flagcxResult_t
+c2cExchangeRange(bool send, void *buff, size_t begin, size_t end, size_t count,
+                 int start, int nranks, flagcxDataType_t datatype,
+                 flagcxComm_t comm, flagcxStream_t stream,
+                 const std::vector<size_t> *cuts = NULL) {
+  size_t typesize = getFlagcxDataTypeSize(datatype);
+  for (int i = 0; i < nranks; ++i) {
+    size_t peer_begin, peer_end;
+    c2cShardRange(count, nranks, i, &peer_begin, &peer_end);
+    size_t lo = std::max(begin, peer_begin);
+    size_t hi = std::min(end, peer_end);
+    while (lo < hi) {
+      size_t next = hi;
+      if (cuts != NULL) {
+        auto cut = std::upper_bound(cuts->begin(), cuts->end(), lo);
+        if (cut != cuts->end())
+          next = std::min(hi, *cut);
+      }
+      void *ptr = static_cast<void *>(static_cast<char *>(buff) +
+                                      (lo - begin) * typesize);
+      if (send) {
+        FLAGCXCHECK(flagcxHeteroSend(ptr, next - lo, datatype, start + i,
+                                     comm->hetero_comm, stream));
+      } else {
+        FLAGCXCHECK(flagcxHeteroRecv(ptr, next - lo, datatype, start + i,
+                                     comm->hetero_comm, stream));
+      }
+      lo = next;
+    }
+  }
+  return flagcxSuccess;
+}
+
+// Shard boundaries of all clusters in a range of count elements, sorted. The
+// fp8 codec scales blocks of every message, a message decodes the same on all
+// clusters only if they all receive it in the same pieces: with it the
+// multi-NIC exchanges are split at these cuts. Empty otherwise.
+static void c2cCodecCuts(flagcxComm_t comm, size_t count,
+                         flagcxDataType_t datatype,
+                         std::vector<size_t> *cuts) {
+  cuts->clear();
+  if (c2cCodec(comm, datatype) != flagcxCodecFp8)
+    return;
+  for (int i = 0; i < comm->nclusters; ++i) {
+    for (int r = 1; r < comm->cluster_sizes[i]; ++r) {
+      size_t begin, end;
+      c2cShardRange(count, comm->cluster_sizes[i], r, &begin, &end);
+      cuts->push_back(begin);
+    }
+  }
+  std::sort(cuts->begin(), cuts->end());
+  cuts->erase(std::unique(cuts->begin(), cuts->end()), cuts->end());
+}
+
+// Algorithms moving data between the representative ranks of the clusters
+// (one per cluster) on the single-NIC paths. Direct has every representative
+// talk to all others, ring and tree bound the bytes each one sends and
+// receives independently of the number of clusters.
+#define C2C_INTER_DIRECT 0
+#define C2C_INTER_RING 1
+#define C2C_INTER_TREE 2
+
+FLAGCX_PARAM(C2cInterAlgo, "C2C_INTER_ALGO", -1);
+FLAGCX_PARAM(C2cInterRingThreshold, "C2C_INTER_RING_THRESHOLD", 1 << 20);
+
+// Algorithm for nreps representatives exchanging size bytes, set with
+// FLAGCX_C2C_INTER_ALGO. By default two clusters talk directly, more use the
+// tree below FLAGCX_C2C_INTER_RING_THRESHOLD bytes and the ring above.
+static int c2cInterAlgo(int nreps, size_t size) {
+  int64_t algo = flagcxParamC2cInterAlgo();
+  if (algo >= C2C_INTER_DIRECT && algo <= C2C_INTER_TREE)
+    return algo;
+  if (nreps <= 2)
+    return C2C_INTER_DIRECT;
+  return size >= (size_t)flagcxParamC2cInterRingThreshold() ? C2C_INTER_RING
+                                                            : C2C_INTER_TREE;
+}
+
+// One step of the inter-cluster algorithms: a send and a receive, either of
+// which is skipped when its peer is negative, waited for before returning.
+static flagcxResult_t c2cSendRecv(const void *sendbuff, size_t sendcount,
+                                  int sendpeer, void *recvbuff,
+                                  size_t recvcount, int recvpeer,
+                                  flagcxDataType_t datatype, flagcxComm_t comm,
+                                  flagcxStream_t stream) {
+  flagcxGroupStart(comm);
+  if (sendpeer >= 0 && sendcount > 0) {
+    FLAGCXCHECK(flagcxHeteroSend(sendbuff, sendcount, datatype, sendpeer,
+                                 comm->hetero_comm, stream));
+  }
+  if (recvpeer >= 0 && recvcount > 0) {
+    FLAGCXCHECK(flagcxHeteroRecv(recvbuff, recvcount, datatype, recvpeer,
+                                 comm->hetero_comm, stream));
+  }
+  flagcxGroupEnd(comm);
+
+  // TODO: use stream wait rather than stream sync to avoid cpu blocking
+  deviceAdaptor->streamSynchronize(stream);
+  return flagcxSuccess;
+}
+
+static void *c2cChunk(void *buff, size_t count, int nreps, int chunk,
+                      flagcxDataType_t datatype, size_t *chunkcount) {
+  size_t begin, end;
+  c2cShardRange(count, nreps, chunk, &begin, &end);
+  *chunkcount = end - begin;
+  return static_cast<void *>(static_cast<char *>(buff) +
+                             begin * getFlagcxDataTypeSize(datatype));
+}
+
+// Ring reduce-scatter of the count elements of buff over the representatives
+// reps[0..nreps-1], me being the index of this rank. Afterwards chunk
+// (me + 1) % nreps (see c2cShardRange) of buff is fully reduced.
+static flagcxResult_t c2cRingReduceScatter(void *buff, size_t count,
+                                           flagcxDataType_t datatype,
+                                           flagcxRedOp_t op, const int *reps,
+                                           int nreps, int me,
+                                           flagcxComm_t comm,
+                                           flagcxStream_t stream) {
+  int next = reps[(me + 1) % nreps];
+  int prev = reps[(me - 1 + nreps) % nreps];
+  // the last chunk is the largest one
+  size_t maxcount = count - count / nreps * (nreps - 1);
+  void *tmpbuff;
+  FLAGCXCHECK(deviceAdaptor->deviceMalloc(
+      &tmpbuff, maxcount * getFlagcxDataTypeSize(datatype), flagcxMemDevice,
+      stream));
+  for (int step = 0; step < nreps - 1; ++step) {
+    size_t sendcount, recvcount;
+    void *sendchunk = c2cChunk(buff, count, nreps,
+                               (me - step + nreps) % nreps, datatype,
+                               &sendcount);
+    void *recvchunk = c2cChunk(buff, count, nreps,
+                               (me - step - 1 + nreps) % nreps, datatype,
+                               &recvcount);
+    FLAGCXCHECK(c2cSendRecv(sendchunk, sendcount, next, tmpbuff, recvcount,
+                            prev, datatype, comm, stream));
+    FLAGCXCHECK(c2cReducePeers(recvchunk, tmpbuff, 1, recvcount, datatype, op,
+                               comm, stream));
+  }
+  FLAGCXCHECK(deviceAdaptor->deviceFree(tmpbuff, flagcxMemDevice, stream));
+  return flagcxSuccess;
+}
+
+// Ring allgather of the chunks of buff, every representative starting with
+// chunk (me + shift) % nreps.
+static flagcxResult_t c2cRingAllGather(void *buff, size_t count, int shift,
+                                       flagcxDataType_t datatype,
+                                       const int *reps, int nreps, int me,
+                                       flagcxComm_t comm,
+                                       flagcxStream_t stream) {
+  int next = reps[(me + 1) % nreps];
+  int prev = reps[(me - 1 + nreps) % nreps];
+  for (int step = 0; step < nreps - 1; ++step) {
+    size_t sendcount, recvcount;
+    void *sendchunk = c2cChunk(buff, count, nreps,
+                               (me + shift - step + nreps) % nreps, datatype,
+                               &sendcount);
+    void *recvchunk = c2cChunk(buff, count, nreps,
+                               (me + shift - step - 1 + nreps) % nreps,
+                               datatype, &recvcount);
+    FLAGCXCHECK(c2cSendRecv(sendchunk, sendcount, next, recvchunk, recvcount,
+                            prev, datatype, comm, stream));
+  }
+  return flagcxSuccess;
+}
+
+// Binary tree rooted at representative root, in ranks relative to the root.
+static int c2cTreeParent(int rel) { return rel == 0 ? -1 : (rel - 1) / 2; }
+
+static int c2cTreeChildren(int rel, int nreps, int *children) {
+  int nchildren = 0;
+  for (int child = 2 * rel + 1; child <= 2 * rel + 2 && child < nreps;
+       ++child) {
+    children[nchildren++] = child;
+  }
+  return nchildren;
+}
+
+// Reduces the count elements of buff on all representatives into buff on
+// reps[root], buff on the other representatives is overwritten.
+static flagcxResult_t c2cInterReduce(void *buff, size_t count,
+                                     flagcxDataType_t datatype,
+                                     flagcxRedOp_t op, const int *reps,
+                                     int nreps, int me, int root,
+                                     flagcxComm_t comm, flagcxStream_t stream) {
+  if (count == 0)
+    return flagcxSuccess;
+  size_t size = count * getFlagcxDataTypeSize(datatype);
+  int algo = c2cInterAlgo(nreps, size);
+  if (algo == C2C_INTER_RING) {
+    // reduce-scatter, then every representative sends its chunk to the root
+    FLAGCXCHECK(c2cRingReduceScatter(buff, count, datatype, op, reps, nreps,
+                                     me, comm, stream));
+    flagcxGroupStart(comm);
+    for (int i = 0; i < nreps; ++i) {
+      size_t chunkcount;
+      void *chunk =
+          c2cChunk(buff, count, nreps, (i + 1) % nreps, datatype, &chunkcount);
+      if (chunkcount == 0 || i == root)
+        continue;
+      if (me == root) {
+        FLAGCXCHECK(flagcxHeteroRecv(chunk, chunkcount, datatype, reps[i],
+                                     comm->hetero_comm, stream));
+      } else if (me == i) {
+        FLAGCXCHECK(flagcxHeteroSend(chunk, chunkcount, datatype, reps[root],
+                                     comm->hetero_comm, stream));
+      }
+    }
+    flagcxGroupEnd(comm);
+
+    // TODO: use stream wait rather than stream sync to avoid cpu blocking
+    deviceAdaptor->streamSynchronize(stream);
+    return flagcxSuccess;
+  }
+
+  // direct: every representative is a child of the root
+  int rel = (me - root + nreps) % nreps;
+  int children[2];
+  int nchildren = 0;
+  int parent = -1;
+  if (algo == C2C_INTER_TREE) {
+    nchildren = c2cTreeChildren(rel, nreps, children);
+    parent = c2cTreeParent(rel);
+  } else if (rel == 0) {
+    nchildren = nreps - 1;
+  } else {
+    parent = 0;
+  }
+  if (nchildren > 0) {
+    void *peerbuff;
+    deviceAdaptor->deviceMalloc(&peerbuff, nchildren * size, flagcxMemDevice,
+                                stream);
+    flagcxGroupStart(comm);
+    for (int i = 0; i < nchildren; ++i) {
+      int child = algo == C2C_INTER_TREE ? children[i] : i + 1;
+      FLAGCXCHECK(flagcxHeteroRecv(
+          static_cast<void *>(static_cast<char *>(peerbuff) + i * size), count,
+          datatype, reps[(child + root) % nreps], comm->hetero_comm, stream));
+    }
+    flagcxGroupEnd(comm);
+
+    // TODO: use stream wait rather than stream sync to avoid cpu blocking
+    deviceAdaptor->streamSynchronize(stream);
+
+    FLAGCXCHECK(c2cReducePeers(buff, peerbuff, nchildren, count, datatype, op,
+                               comm, stream));
+    deviceAdaptor->deviceFree(peerbuff, flagcxMemDevice, stream);
+  }
+  if (parent >= 0) {
+    FLAGCXCHECK(c2cSendRecv(buff, count, reps[(parent + root) % nreps], NULL,
+                            0, -1, datatype, comm, stream));
+  }
+  return flagcxSuccess;
+}
+
+FLAGCX_PARAM(C2cBcastChunkSize, "C2C_BCAST_CHUNK_SIZE", 1 << 22);
+
+// Number of chunks the pipelined broadcasts cut count elements into, all of
+// chunkcount elements but the last one.
+static size_t c2cBcastChunks(size_t count, flagcxDataType_t datatype,
+                             size_t *chunkcount) {
+  *chunkcount = std::max((size_t)flagcxParamC2cBcastChunkSize() /
+                             getFlagcxDataTypeSize(datatype),
+                         (size_t)1);
+  return (count + *chunkcount - 1) / *chunkcount;
+}
+
+// Broadcasts the count elements of buff on reps[root] to buff on the other
+// representatives, along a chain (ring algorithm), the binary tree or
+// directly from the root. The buffer is pipelined in chunks of
+// FLAGCX_C2C_BCAST_CHUNK_SIZE bytes: every representative forwards chunk k to
+// its children while it receives chunk k + 1 from its parent. When intraRoot
+// is not negative, every chunk is also broadcast from the representative,
+// homo rank intraRoot, to the rest of its cluster on comm->bcast_stream, while
+// the next chunk goes over the network; the other ranks of the cluster issue
+// the same broadcasts.
+static flagcxResult_t c2cInterBroadcast(void *buff, size_t count,
+                                        flagcxDataType_t datatype,
+                                        const int *reps, int nreps, int me,
+                                        int root, int intraRoot,
+                                        flagcxComm_t comm,
+                                        flagcxStream_t stream) {
+  if (count == 0)
+    return flagcxSuccess;
+  size_t size = count * getFlagcxDataTypeSize(datatype);
+  int algo = c2cInterAlgo(nreps, size);
+  int rel = (me - root + nreps) % nreps;
+  int parent = -1;
+  std::vector<int> children;
+  if (algo == C2C_INTER_TREE) {
+    int treeChildren[2];
+    int nchildren = c2cTreeChildren(rel, nreps, treeChildren);
+    children.assign(treeChildren, treeChildren + nchildren);
+    parent = c2cTreeParent(rel);
+  } else if (algo == C2C_INTER_RING) {
+    if (rel + 1 < nreps)
+      children.push_back(rel + 1);
+    parent = rel - 1;
+  } else if (rel == 0) {
+    for (int i = 1; i < nreps; ++i)
+      children.push_back(i);
+  } else {
+    parent = 0;
+  }
+
+  bool intra = intraRoot >= 0 && comm->homo_ranks > 1;
+  if (intra && comm->bcast_stream == NULL) {
+    FLAGCXCHECK(deviceAdaptor->streamCreate(&comm->bcast_stream));
+  }
+  // the proxies read the chunks of the root as soon as the sends are posted
+  FLAGCXCHECK(deviceAdaptor->streamSynchronize(stream));
+
+  size_t chunkcount;
+  size_t nchunks = c2cBcastChunks(count, datatype, &chunkcount);
+  size_t chunksize = chunkcount * getFlagcxDataTypeSize(datatype);
+  char *buffer = static_cast<char *>(buff);
+  for (size_t step = 0; step <= nchunks; ++step) {
+    // the root has every chunk from the start, the other representatives
+    // pass on the chunk they received at the previous step
+    bool has_ready = parent < 0 ? step < nchunks : step > 0;
+    size_t ready = parent < 0 ? step : step - 1;
+    bool receiving = parent >= 0 && step < nchunks;
+    if (!has_ready && !receiving)
+      continue;
+
+    // intra-cluster bcast of the ready chunk, it only reads the buffer on the
+    // representative so it runs alongside the transfers below
+    if (has_ready && intra) {
+      FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->broadcast(
+          buffer + ready * chunksize, buffer + ready * chunksize,
+          std::min(chunkcount, count - ready * chunkcount), datatype,
+          intraRoot, comm->homo_comm, comm->bcast_stream));
+    }
+
+    flagcxGroupStart(comm);
+    if (has_ready) {
+      for (int child : children) {
+        FLAGCXCHECK(flagcxHeteroSend(
+            static_cast<void *>(buffer + ready * chunksize),
+            std::min(chunkcount, count - ready * chunkcount), datatype,
+            reps[(child + root) % nreps], comm->hetero_comm, stream));
+      }
+    }
+    if (receiving) {
+      FLAGCXCHECK(flagcxHeteroRecv(
+          static_cast<void *>(buffer + step * chunksize),
+          std::min(chunkcount, count - step * chunkcount), datatype,
+          reps[(parent + root) % nreps], comm->hetero_comm, stream));
+    }
+    flagcxGroupEnd(comm);
+
+    // TODO: use stream wait rather than stream sync to avoid cpu blocking
+    deviceAdaptor->streamSynchronize(stream);
+    if (has_ready && intra) {
+      FLAGCXCHECK(deviceAdaptor->streamSynchronize(comm->bcast_stream));
+    }
+  }
+  return flagcxSuccess;
+}
+
+// Allreduce of the count elements of buff over the representatives.
+static flagcxResult_t c2cInterAllReduce(void *buff, size_t count,
+                                        flagcxDataType_t datatype,
+                                        flagcxRedOp_t op, const int *reps,
+                                        int nreps, int me, flagcxComm_t comm,
+                                        flagcxStream_t stream) {
+  if (count == 0)
+    return flagcxSuccess;
+  size_t size = count * getFlagcxDataTypeSize(datatype);
+  int algo = c2cInterAlgo(nreps, size);
+  // the rank holding a reduced chunk keeps what the others decode of it
+  if (algo == C2C_INTER_RING) {
+    FLAGCXCHECK(c2cRingReduceScatter(buff, count, datatype, op, reps, nreps,
+                                     me, comm, stream));
+    size_t chunkcount;
+    void *chunk =
+        c2cChunk(buff, count, nreps, (me + 1) % nreps, datatype, &chunkcount);
+    FLAGCXCHECK(c2cCodecRoundTrip(chunk, chunkcount, chunkcount, datatype,
+                                  comm, stream));
+    return c2cRingAllGather(buff, count, 1, datatype, reps, nreps, me, comm,
+                            stream);
+  }
+  if (algo == C2C_INTER_TREE) {
+    FLAGCXCHECK(c2cInterReduce(buff, count, datatype, op, reps, nreps, me, 0,
+                               comm, stream));
+    if (me == 0) {
+      size_t chunkcount;
+      c2cBcastChunks(count, datatype, &chunkcount);
+      FLAGCXCHECK(c2cCodecRoundTrip(buff, count, chunkcount, datatype, comm,
+                                    stream));
+    }
+    return c2cInterBroadcast(buff, count, datatype, reps, nreps, me, 0, -1,
+                             comm, stream);
+  }
+
+  // direct: every representative receives the buffers of all others and
+  // reduces them with what they decode of its own, in the same order
+  int npeers = nreps - 1;
+  void *peerbuff;
+  deviceAdaptor->deviceMalloc(&peerbuff, npeers * size, flagcxMemDevice,
                               stream);
-  flagcxAllReduce(barrierBuff, barrierBuff, comm->nranks, flagcxChar, flagcxMax,
-                  comm, stream);
-  deviceAdaptor->deviceFree(barrierBuff, flagcxMemDevice, stream);
+  int cid = 0;
+  flagcxGroupStart(comm);
+  for (int i = 0; i < nreps; ++i) {
+    if (i == me)
+      continue;
+    FLAGCXCHECK(flagcxHeteroRecv(
+        static_cast<void *>(static_cast<char *>(peerbuff) + cid * size), count,
+        datatype, reps[i], comm->hetero_comm, stream));
+    FLAGCXCHECK(flagcxHeteroSend(buff, count, datatype, reps[i],
+                                 comm->hetero_comm, stream));
+    cid += 1;
+  }
+  flagcxGroupEnd(comm);
+
+  // TODO: use stream wait rather than stream sync to avoid cpu blocking
   deviceAdaptor->streamSynchronize(stream);
+
+  FLAGCXCHECK(c2cReducePeers(buff, peerbuff, npeers, count, datatype, op, comm,
+                             stream, me, true));
+  deviceAdaptor->deviceFree(peerbuff, flagcxMemDevice, stream);
   return flagcxSuccess;
 }
 
-flagcxResult_t flagcxReduce(const void *sendbuff, void *recvbuff, size_t count,
-                            flagcxDataType_t datatype, flagcxRedOp_t op,
-                            int root, flagcxComm_t comm,
-                            flagcxStream_t stream) {
+// Records the collective when comm is inside a group, returns whether it did.
+static bool c2cGroupRecord(flagcxComm_t comm, enum c2cGroupColl coll,
+                           const void *sendbuff, void *recvbuff, size_t count,
+                           flagcxDataType_t datatype, flagcxRedOp_t op,
+                           int root, flagcxStream_t stream,
+                           int algo = FLAGCX_HETERO_ALGO_UNDEF) {
+  if (comm->c2c_group == NULL || comm->c2c_group->depth == 0)
+    return false;
+  struct c2cGroupOp rec;
+  rec.coll = coll;
+  rec.sendbuff = sendbuff;
+  rec.recvbuff = recvbuff;
+  rec.count = count;
+  rec.datatype = datatype;
+  rec.op = op;
+  rec.root = root;
+  rec.stream = stream;
+  rec.algo = algo;
+  rec.done = false;
+  comm->c2c_group->ops.push_back(rec);
+  return true;
+}
+
+// Copy of the host-comm path, ordered after the work queued on stream and
+// complete on return.
+static flagcxResult_t hostCopy(void *dst, const void *src, size_t size,
+                               flagcxMemcpyType_t type, flagcxStream_t stream) {
+  FLAGCXCHECK(deviceAdaptor->deviceMemcpy(dst, const_cast<void *>(src), size,
+                                          type, stream, NULL));
+  return deviceAdaptor->streamSynchronize(stream);
+}
+
+// Compresses the inter-cluster fp32 transfers issued in its scope to the codec
+// of FLAGCX_C2C_COMPRESS, if any. The collectives using it also round the
+// values they send and keep through the codec (see c2cCodecRoundTrip), so that
+// their results are the same bits on all ranks.
+struct c2cCompressScope {
+  flagcxHeteroComm_t comm;
+  c2cCompressScope(flagcxHeteroComm_t comm) : comm(comm) {
+    comm->compress = 1;
+  }
+  ~c2cCompressScope() { comm->compress = 0; }
+};
+
+// Algorithm of the heterogeneous collective coll, count being the count
+// argument of the collective, among the ones the collective implements. The
+// host algorithm is only offered if the host adaptor implements coll, except
+// with single-rank homo comms where it is the only one and the adaptor reports
+// the error.
+static int collAlgo(flagcxComm_t comm, flagcxCollType_t coll, size_t count,
+                    flagcxDataType_t datatype) {
+  const int hostOnly = HETERO_ALGO_MASK(FLAGCX_HETERO_ALGO_HOST);
+  const int host = comm->host_colls & (1 << coll) ? hostOnly : 0;
+  const int singleNic = HETERO_ALGO_MASK(FLAGCX_HETERO_ALGO_SINGLE_NIC);
+  size_t size = count * getFlagcxDataTypeSize(datatype);
+  switch (coll) {
+  case flagcxCollBroadcast:
+    return heteroAlgo(comm, flagcxFuncBroadcast, size, host | singleNic);
+  case flagcxCollReduce:
+    return heteroAlgo(comm, flagcxFuncReduce, size,
+                      comm->has_single_rank_homo_comm ? hostOnly
+                                                      : host | singleNic);
+  case flagcxCollAllReduce:
+    return heteroAlgo(comm, flagcxFuncAllReduce, size,
+                      comm->has_single_rank_homo_comm
+                          ? hostOnly
+                          : host | HETERO_ALGO_DEVICE);
+  case flagcxCollReduceScatter:
+    return heteroAlgo(comm, flagcxFuncReduceScatter, comm->nranks * size,
+                      comm->has_single_rank_homo_comm
+                          ? hostOnly
+                          : host | HETERO_ALGO_DEVICE);
+  case flagcxCollAllGather: {
+    // the multi-NIC allgather needs clusters of equal sizes
+    int allowed = host | HETERO_ALGO_DEVICE;
+    for (int i = 1; i < comm->nclusters; ++i) {
+      if (comm->cluster_sizes[i] != comm->cluster_sizes[0]) {
+        allowed &= ~HETERO_ALGO_MASK(FLAGCX_HETERO_ALGO_MULTI_NIC);
+      }
+    }
+    return heteroAlgo(comm, flagcxFuncAllGather, comm->nranks * size,
+                      allowed);
+  }
+  default:
+    return FLAGCX_HETERO_ALGO_UNDEF;
+  }
+}
+
+static flagcxResult_t runReduce(const void *sendbuff, void *recvbuff,
+                                size_t count, flagcxDataType_t datatype,
+                                flagcxRedOp_t op, int root, flagcxComm_t comm,
+                                flagcxStream_t stream, int algo) {
   FLAGCXCHECK(flagcxEnsureCommReady(comm));
   if (is_homo_comm(comm)) {
     return cclAdaptors[flagcxCCLAdaptorDevice]->reduce(
         sendbuff, recvbuff, count, datatype, op, root, comm->homo_comm, stream);
   } else {
-    char *useBootstrap = getenv("USE_BOOTSTRAP_CCL");
-    if (useBootstrap) {
+    if (c2cGroupRecord(comm, c2cGroupReduce, sendbuff, recvbuff, count,
+                       datatype, op, root, stream, algo)) {
+      return flagcxSuccess;
+    }
+    if (use_bootstrap_ccl()) {
       // TODO: to be implemented.
       return flagcxNotSupported;
     }
-    if (use_host_comm() || comm->has_single_rank_homo_comm) {
+    // plans resolve the algorithm once
+    if (algo == FLAGCX_HETERO_ALGO_UNDEF) {
+      algo = collAlgo(comm, flagcxCollReduce, count, datatype);
+    }
+    if (algo == FLAGCX_HETERO_ALGO_HOST) {
+      FLAGCXCHECK(hostCommInit(comm));
+      // queued to the worker of the host engine
+      if (flagcxHostEngineDefers(comm->host_engine)) {
+        return flagcxHostEngineEnqueue(
+            comm->host_engine,
+            [=](flagcxStream_t s) {
+              return runReduce(sendbuff, recvbuff, count, datatype, op, root,
+                               comm, s, algo);
+            },
+            stream);
+      }
       // c2c validation
       if (comm->has_single_rank_homo_comm) {
         WARN("Host comm is required to perform C2C reduce op when "
@@ -503,36 +1750,38 @@ flagcxResult_t flagcxReduce(const void *sendbuff, void *recvbuff, size_t count,
       void *buff_out;
       size_t size = count * getFlagcxDataTypeSize(datatype);
 
-      // step 1: malloc host buffer
+      // step 1: acquire host buffer
       timers[TIMER_COLL_ALLOC] = clockNano();
-      deviceAdaptor->deviceMalloc(&buff_in, size, flagcxMemHost, NULL);
-      deviceAdaptor->deviceMalloc(&buff_out, size, flagcxMemHost, NULL);
+      FLAGCXCHECK(
+          flagcxHostBufferAcquire(comm->host_buffer_pool, size, &buff_in));
+      FLAGCXCHECK(
+          flagcxHostBufferAcquire(comm->host_buffer_pool, size, &buff_out));
       timers[TIMER_COLL_ALLOC] = clockNano() - timers[TIMER_COLL_ALLOC];
 
       // step 2: memcpy d2h
       timers[TIMER_COLL_MEM_D2H] = clockNano();
-      deviceAdaptor->deviceMemcpy(buff_in, const_cast<void *>(sendbuff), size,
-                                  flagcxMemcpyDeviceToHost, NULL, NULL);
+      FLAGCXCHECK(hostCopy(buff_in, sendbuff, size, flagcxMemcpyDeviceToHost,
+                           stream));
       timers[TIMER_COLL_MEM_D2H] = clockNano() - timers[TIMER_COLL_MEM_D2H];
 
       // step 3: reduce
       timers[TIMER_COLL_COMM] = clockNano();
-      cclAdaptors[flagcxCCLAdaptorHost]->reduce(
-          buff_in, buff_out, count, datatype, op, root, comm->host_comm, NULL);
+      FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorHost]->reduce(
+          buff_in, buff_out, count, datatype, op, root, comm->host_comm, NULL));
       timers[TIMER_COLL_COMM] = clockNano() - timers[TIMER_COLL_COMM];
 
       // step 4: memcpy h2d
       timers[TIMER_COLL_MEM_H2D] = clockNano();
       if(comm->rank == root) {
-        deviceAdaptor->deviceMemcpy(recvbuff, buff_out, size,
-                                  flagcxMemcpyHostToDevice, NULL, NULL);
+        FLAGCXCHECK(hostCopy(recvbuff, buff_out, size, flagcxMemcpyHostToDevice,
+                             stream));
       }
       timers[TIMER_COLL_MEM_H2D] = clockNano() - timers[TIMER_COLL_MEM_H2D];
 
-      // step 5: free host buffer
+      // step 5: release host buffer
       timers[TIMER_COLL_FREE] = clockNano();
-      deviceAdaptor->deviceFree(buff_in, flagcxMemHost, NULL);
-      deviceAdaptor->deviceFree(buff_out, flagcxMemHost, NULL);
+      FLAGCXCHECK(flagcxHostBufferRelease(comm->host_buffer_pool, buff_in));
+      FLAGCXCHECK(flagcxHostBufferRelease(comm->host_buffer_pool, buff_out));
       timers[TIMER_COLL_FREE] = clockNano() - timers[TIMER_COLL_FREE];
 
       timers[TIMER_COLL_TOTAL] = clockNano() - timers[TIMER_COLL_TOTAL];
@@ -554,97 +1803,57 @@ flagcxResult_t flagcxReduce(const void *sendbuff, void *recvbuff, size_t count,
         return flagcxInvalidArgument;
       }
 
-      bool is_root_cluster =
-          (comm->cluster_ids[comm->rank] == comm->cluster_ids[root]);
-      // allocate a bounce buffer for the homo_inter_rank of non-root clusters
-      // and homo ranks of root cluster This buffer is used to avoid the
-      // overwrite of recvbuffer
-      void *fwdbuff;
-      if (is_root_cluster ||
-          (!is_root_cluster && comm->homo_rank == comm->homo_inter_rank)) {
+      int root_cluster = comm->cluster_ids[root];
+      bool is_root_cluster = (comm->cluster_ids[comm->rank] == root_cluster);
+      int offset = comm->cluster_offsets[root_cluster];
+      // the root represents its cluster, the homo_inter_rank the other ones
+      std::vector<int> reps(comm->cluster_inter_ranks,
+                            comm->cluster_inter_ranks + comm->nclusters);
+      reps[root_cluster] = root;
+      int rep_homo_rank =
+          is_root_cluster ? root - offset : comm->homo_inter_rank;
+      bool is_rep = comm->rank == reps[comm->cluster_ids[comm->rank]];
+
+      // allocate a bounce buffer for the representatives of non-root clusters,
+      // the root reduces straight into recvbuff
+      void *fwdbuff = recvbuff;
+      if (is_rep && !is_root_cluster) {
         deviceAdaptor->deviceMalloc(&fwdbuff,
                                     getFlagcxDataTypeSize(datatype) * count,
                                     flagcxMemDevice, stream);
-        deviceAdaptor->deviceMemset(fwdbuff, 0,
-                                    getFlagcxDataTypeSize(datatype) * count,
-                                    flagcxMemDevice, stream);
       }
 
       // intra-cluster reduce
       FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->reduce(
-          sendbuff, fwdbuff, count, datatype, op, comm->homo_inter_rank,
+          sendbuff, fwdbuff, count, datatype, op, rep_homo_rank,
           comm->homo_comm, stream));
 
-      if (is_root_cluster && comm->homo_inter_rank != comm->homo_rank) {
-        if (op == flagcxSum) {
-          deviceAdaptor->deviceMemset(fwdbuff, 0,
-                                      count * getFlagcxDataTypeSize(datatype),
-                                      flagcxMemDevice, stream);
+      // inter-cluster reduce between the representatives
+      if (is_rep) {
+        // TODO: use stream wait rather than stream sync to avoid cpu blocking
+        deviceAdaptor->streamSynchronize(stream);
+
+        FLAGCXCHECK(c2cInterReduce(fwdbuff, count, datatype, op, reps.data(),
+                                   comm->nclusters,
+                                   comm->cluster_ids[comm->rank], root_cluster,
+                                   comm, stream));
+        if (!is_root_cluster) {
+          deviceAdaptor->deviceFree(fwdbuff, flagcxMemDevice, stream);
         }
       }
-
-      // TODO: use stream wait rather than stream sync to avoid cpu blocking
-      deviceAdaptor->streamSynchronize(stream);
-
-      // inter-cluster sendrecv
-      int cid = 0;
-      flagcxGroupStart(comm);
-      for (int i = 0; i < comm->nclusters; ++i) {
-        if (comm->cluster_ids[comm->rank] == i)
-          continue;
-        if (is_root_cluster) {
-          // TODO: better to add an assertation ensuring that comm->ncluster <=
-          // comm->homo_ranks
-          int homo_rank_to_recv_from_cluster =
-              (comm->homo_inter_rank - cid - 1 + comm->homo_ranks) %
-              comm->homo_ranks;
-          if (comm->homo_rank == homo_rank_to_recv_from_cluster) {
-            FLAGCXCHECK(flagcxHeteroRecv(fwdbuff, count, datatype,
-                                         comm->cluster_inter_ranks[i],
-                                         comm->hetero_comm, stream));
-          }
-        } else {
-          int homo_rank_to_send_to_cluster =
-              (comm->globalrank2homorank[comm->cluster_inter_ranks[i]] - cid -
-               1 + comm->cluster_sizes[i]) %
-              comm->cluster_sizes[i];
-          int global_rank_to_send_to_cluster =
-              homo_rank_to_send_to_cluster -
-              comm->globalrank2homorank[comm->cluster_inter_ranks[i]] +
-              comm->cluster_inter_ranks[i];
-          if (comm->homo_inter_rank == comm->homo_rank) {
-            FLAGCXCHECK(flagcxHeteroSend(fwdbuff, count, datatype,
-                                         global_rank_to_send_to_cluster,
-                                         comm->hetero_comm, stream));
-          }
-        }
-        cid += 1;
-      }
-      flagcxGroupEnd(comm);
-
-      // TODO: use stream wait rather than stream sync to avoid cpu blocking
-      deviceAdaptor->streamSynchronize(stream);
-
-      // intra-cluster reduce for root cluster
-      if (is_root_cluster) {
-        int offset = 0;
-        for (int i = 0; i < comm->cluster_ids[comm->rank]; ++i) {
-          offset += comm->cluster_sizes[i];
-        }
-        FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->reduce(
-            fwdbuff, recvbuff, count, datatype, op, root - offset,
-            comm->homo_comm, stream));
-      }
-
-      if (is_root_cluster ||
-          (!is_root_cluster && comm->homo_rank == comm->homo_inter_rank)) {
-        deviceAdaptor->deviceFree(fwdbuff, flagcxMemDevice, stream);
-      }
     }
   }
   return flagcxSuccess;
 }
 
+flagcxResult_t flagcxReduce(const void *sendbuff, void *recvbuff, size_t count,
+                            flagcxDataType_t datatype, flagcxRedOp_t op,
+                            int root, flagcxComm_t comm,
+                            flagcxStream_t stream) {
+  return runReduce(sendbuff, recvbuff, count, datatype, op, root, comm, stream,
+                   FLAGCX_HETERO_ALGO_UNDEF);
+}
+
 flagcxResult_t flagcxGather(const void *sendbuff, void *recvbuff, size_t count,
                             flagcxDataType_t datatype, int root,
                             flagcxComm_t comm, flagcxStream_t stream) {
@@ -653,21 +1862,86 @@ flagcxResult_t flagcxGather(const void *sendbuff, void *recvbuff, size_t count,
     return cclAdaptors[flagcxCCLAdaptorDevice]->gather(
         sendbuff, recvbuff, count, datatype, root, comm->homo_comm, stream);
   } else {
-    char *useBootstrap = getenv("USE_BOOTSTRAP_CCL");
-    if (useBootstrap) {
+    if (c2cGroupRecord(comm, c2cGroupGather, sendbuff, recvbuff, count,
+                       datatype, flagcxSum, root, stream)) {
+      return flagcxSuccess;
+    }
+    if (use_bootstrap_ccl()) {
       // TODO: to be implemented.
       return flagcxNotSupported;
     }
     if (use_host_comm()) {
-      // TODO: to be implemented.
-      return flagcxNotSupported;
+      // queued to the worker of the host engine
+      if (flagcxHostEngineDefers(comm->host_engine)) {
+        return flagcxHostEngineEnqueue(
+            comm->host_engine,
+            [=](flagcxStream_t s) {
+              return flagcxGather(sendbuff, recvbuff, count, datatype, root,
+                                  comm, s);
+            },
+            stream);
+      }
+      uint64_t timers[TIMERS_COLL_COUNT] = {0};
+      timers[TIMER_COLL_TOTAL] = clockNano();
+      void *buff_in;
+      void *buff_out = NULL;
+      size_t size = count * getFlagcxDataTypeSize(datatype);
+      size_t totalSize = comm->nranks * size;
+
+      // step 1: acquire host buffer
+      timers[TIMER_COLL_ALLOC] = clockNano();
+      FLAGCXCHECK(
+          flagcxHostBufferAcquire(comm->host_buffer_pool, size, &buff_in));
+      if (comm->rank == root) {
+        FLAGCXCHECK(flagcxHostBufferAcquire(comm->host_buffer_pool,
+                                            totalSize, &buff_out));
+      }
+      timers[TIMER_COLL_ALLOC] = clockNano() - timers[TIMER_COLL_ALLOC];
+
+      // step 2: memcpy d2h
+      timers[TIMER_COLL_MEM_D2H] = clockNano();
+      FLAGCXCHECK(hostCopy(buff_in, sendbuff, size, flagcxMemcpyDeviceToHost,
+                           stream));
+      timers[TIMER_COLL_MEM_D2H] = clockNano() - timers[TIMER_COLL_MEM_D2H];
+
+      // step 3: gather
+      timers[TIMER_COLL_COMM] = clockNano();
+      FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorHost]->gather(
+          buff_in, buff_out, count, datatype, root, comm->host_comm, NULL));
+      timers[TIMER_COLL_COMM] = clockNano() - timers[TIMER_COLL_COMM];
+
+      // step 4: memcpy h2d
+      timers[TIMER_COLL_MEM_H2D] = clockNano();
+      if (comm->rank == root) {
+        FLAGCXCHECK(hostCopy(recvbuff, buff_out, totalSize,
+                             flagcxMemcpyHostToDevice, stream));
+      }
+      timers[TIMER_COLL_MEM_H2D] = clockNano() - timers[TIMER_COLL_MEM_H2D];
+
+      // step 5: release host buffer
+      timers[TIMER_COLL_FREE] = clockNano();
+      FLAGCXCHECK(flagcxHostBufferRelease(comm->host_buffer_pool, buff_in));
+      if (comm->rank == root) {
+        FLAGCXCHECK(flagcxHostBufferRelease(comm->host_buffer_pool, buff_out));
+      }
+      timers[TIMER_COLL_FREE] = clockNano() - timers[TIMER_COLL_FREE];
+
+      timers[TIMER_COLL_TOTAL] = clockNano() - timers[TIMER_COLL_TOTAL];
+      INFO(FLAGCX_COLL,
+           "Flagcx timings - %s Gather: rank %d nranks %d total %.2fms "
+           "(memory alloc "
+           "%.2fms, memory free %.2fms, memory d2h %.2fms, memory h2d %.2fms, "
+           "comm %.2fms)",
+           cclAdaptors[flagcxCCLAdaptorHost]->name, comm->rank, comm->nranks,
+           timers[TIMER_COLL_TOTAL] / 1e6, timers[TIMER_COLL_ALLOC] / 1e6,
+           timers[TIMER_COLL_FREE] / 1e6, timers[TIMER_COLL_MEM_D2H] / 1e6,
+           timers[TIMER_COLL_MEM_H2D] / 1e6, timers[TIMER_COLL_COMM] / 1e6);
+
+      return flagcxSuccess;
     } else {
       bool is_root_cluster =
           (comm->cluster_ids[comm->rank] == comm->cluster_ids[root]);
-      int offset = 0;
-      for (int i = 0; i < comm->cluster_ids[comm->rank]; ++i) {
-        offset += comm->cluster_sizes[i];
-      }
+      int offset = comm->cluster_offsets[comm->cluster_ids[comm->rank]];
 
       // allocate a bounce buffer for the homo_inter_rank of non-root clusters
       void *fwdbuff;
@@ -799,23 +2073,88 @@ flagcxResult_t flagcxScatter(const void *sendbuff, void *recvbuff, size_t count,
     return cclAdaptors[flagcxCCLAdaptorDevice]->scatter(
         sendbuff, recvbuff, count, datatype, root, comm->homo_comm, stream);
   } else {
-    char *useBootstrap = getenv("USE_BOOTSTRAP_CCL");
-    if (useBootstrap) {
+    if (c2cGroupRecord(comm, c2cGroupScatter, sendbuff, recvbuff, count,
+                       datatype, flagcxSum, root, stream)) {
+      return flagcxSuccess;
+    }
+    if (use_bootstrap_ccl()) {
       // TODO: to be implemented.
       return flagcxNotSupported;
     }
     if (use_host_comm()) {
-      // TODO: to be implemented
-      return flagcxNotSupported;
+      // queued to the worker of the host engine
+      if (flagcxHostEngineDefers(comm->host_engine)) {
+        return flagcxHostEngineEnqueue(
+            comm->host_engine,
+            [=](flagcxStream_t s) {
+              return flagcxScatter(sendbuff, recvbuff, count, datatype, root,
+                                   comm, s);
+            },
+            stream);
+      }
+      uint64_t timers[TIMERS_COLL_COUNT] = {0};
+      timers[TIMER_COLL_TOTAL] = clockNano();
+      void *buff_in = NULL;
+      void *buff_out;
+      size_t size = count * getFlagcxDataTypeSize(datatype);
+      size_t totalSize = comm->nranks * size;
+
+      // step 1: acquire host buffer
+      timers[TIMER_COLL_ALLOC] = clockNano();
+      if (comm->rank == root) {
+        FLAGCXCHECK(flagcxHostBufferAcquire(comm->host_buffer_pool,
+                                            totalSize, &buff_in));
+      }
+      FLAGCXCHECK(
+          flagcxHostBufferAcquire(comm->host_buffer_pool, size, &buff_out));
+      timers[TIMER_COLL_ALLOC] = clockNano() - timers[TIMER_COLL_ALLOC];
+
+      // step 2: memcpy d2h
+      timers[TIMER_COLL_MEM_D2H] = clockNano();
+      if (comm->rank == root) {
+        FLAGCXCHECK(hostCopy(buff_in, sendbuff, totalSize,
+                             flagcxMemcpyDeviceToHost, stream));
+      }
+      timers[TIMER_COLL_MEM_D2H] = clockNano() - timers[TIMER_COLL_MEM_D2H];
+
+      // step 3: scatter
+      timers[TIMER_COLL_COMM] = clockNano();
+      FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorHost]->scatter(
+          buff_in, buff_out, count, datatype, root, comm->host_comm, NULL));
+      timers[TIMER_COLL_COMM] = clockNano() - timers[TIMER_COLL_COMM];
+
+      // step 4: memcpy h2d
+      timers[TIMER_COLL_MEM_H2D] = clockNano();
+      FLAGCXCHECK(hostCopy(recvbuff, buff_out, size, flagcxMemcpyHostToDevice,
+                           stream));
+      timers[TIMER_COLL_MEM_H2D] = clockNano() - timers[TIMER_COLL_MEM_H2D];
+
+      // step 5: release host buffer
+      timers[TIMER_COLL_FREE] = clockNano();
+      if (comm->rank == root) {
+        FLAGCXCHECK(flagcxHostBufferRelease(comm->host_buffer_pool, buff_in));
+      }
+      FLAGCXCHECK(flagcxHostBufferRelease(comm->host_buffer_pool, buff_out));
+      timers[TIMER_COLL_FREE] = clockNano() - timers[TIMER_COLL_FREE];
+
+      timers[TIMER_COLL_TOTAL] = clockNano() - timers[TIMER_COLL_TOTAL];
+      INFO(FLAGCX_COLL,
+           "Flagcx timings - %s Scatter: rank %d nranks %d total %.2fms "
+           "(memory alloc "
+           "%.2fms, memory free %.2fms, memory d2h %.2fms, memory h2d %.2fms, "
+           "comm %.2fms)",
+           cclAdaptors[flagcxCCLAdaptorHost]->name, comm->rank, comm->nranks,
+           timers[TIMER_COLL_TOTAL] / 1e6, timers[TIMER_COLL_ALLOC] / 1e6,
+           timers[TIMER_COLL_FREE] / 1e6, timers[TIMER_COLL_MEM_D2H] / 1e6,
+           timers[TIMER_COLL_MEM_H2D] / 1e6, timers[TIMER_COLL_COMM] / 1e6);
+
+      return flagcxSuccess;
     } else {
       bool is_root_cluster =
           (comm->cluster_ids[comm->rank] == comm->cluster_ids[root]);
       bool fwd_root =
           comm->cluster_inter_ranks[comm->cluster_ids[root]] != root;
-      int offset = 0;
-      for (int i = 0; i < comm->cluster_ids[comm->rank]; ++i) {
-        offset += comm->cluster_sizes[i];
-      }
+      int offset = comm->cluster_offsets[comm->cluster_ids[comm->rank]];
 
       // allocate a bounce buffer for the homo_inter_rank of non-root clusters
       void *fwdbuff;
@@ -937,86 +2276,186 @@ flagcxResult_t flagcxScatter(const void *sendbuff, void *recvbuff, size_t count,
   return flagcxSuccess;
 }
 
-flagcxResult_t flagcxBroadcast(const void *sendbuff, void *recvbuff,
-                               size_t count, flagcxDataType_t datatype,
-                               int root, flagcxComm_t comm,
-                               flagcxStream_t stream) {
+static flagcxResult_t runBroadcast(const void *sendbuff, void *recvbuff,
+                                   size_t count, flagcxDataType_t datatype,
+                                   int root, flagcxComm_t comm,
+                                   flagcxStream_t stream, int algo) {
   FLAGCXCHECK(flagcxEnsureCommReady(comm));
   if (is_homo_comm(comm)) {
     return cclAdaptors[flagcxCCLAdaptorDevice]->broadcast(
         sendbuff, recvbuff, count, datatype, root, comm->homo_comm, stream);
   } else {
-    char *useBootstrap = getenv("USE_BOOTSTRAP_CCL");
-    if (useBootstrap) {
-      // TODO: to be implemented.
-      return flagcxNotSupported;
+    if (c2cGroupRecord(comm, c2cGroupBroadcast, sendbuff, recvbuff, count,
+                       datatype, flagcxSum, root, stream, algo)) {
+      return flagcxSuccess;
     }
-    if (use_host_comm()) {
+    if (use_bootstrap_ccl()) {
       // TODO: to be implemented.
       return flagcxNotSupported;
-    } else {
-      bool is_root_cluster =
-          (comm->cluster_ids[comm->rank] == comm->cluster_ids[root]);
-      int offset = 0;
-      for (int i = 0; i < comm->cluster_ids[root]; ++i) {
-        offset += comm->cluster_sizes[i];
+    }
+    // plans resolve the algorithm once
+    if (algo == FLAGCX_HETERO_ALGO_UNDEF) {
+      algo = collAlgo(comm, flagcxCollBroadcast, count, datatype);
+    }
+    if (algo == FLAGCX_HETERO_ALGO_HOST) {
+      FLAGCXCHECK(hostCommInit(comm));
+      // queued to the worker of the host engine
+      if (flagcxHostEngineDefers(comm->host_engine)) {
+        return flagcxHostEngineEnqueue(
+            comm->host_engine,
+            [=](flagcxStream_t s) {
+              return runBroadcast(sendbuff, recvbuff, count, datatype, root,
+                                  comm, s, algo);
+            },
+            stream);
       }
+      uint64_t timers[TIMERS_COLL_COUNT] = {0};
+      timers[TIMER_COLL_TOTAL] = clockNano();
+      void *buff;
+      size_t size = count * getFlagcxDataTypeSize(datatype);
 
-      // cluster w/ the root rank: intra-cluster bcast
-      if (is_root_cluster && comm->homo_ranks > 1) {
-        FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->broadcast(
-            sendbuff, recvbuff, count, datatype, root - offset, comm->homo_comm,
-            stream));
+      // step 1: acquire host buffer
+      timers[TIMER_COLL_ALLOC] = clockNano();
+      FLAGCXCHECK(flagcxHostBufferAcquire(comm->host_buffer_pool, size, &buff));
+      timers[TIMER_COLL_ALLOC] = clockNano() - timers[TIMER_COLL_ALLOC];
+
+      // step 2: memcpy d2h
+      timers[TIMER_COLL_MEM_D2H] = clockNano();
+      if (comm->rank == root) {
+        FLAGCXCHECK(hostCopy(buff, sendbuff, size, flagcxMemcpyDeviceToHost,
+                             stream));
       }
+      timers[TIMER_COLL_MEM_D2H] = clockNano() - timers[TIMER_COLL_MEM_D2H];
 
-      // TODO: use stream wait rather than stream sync to avoid cpu blocking
-      deviceAdaptor->streamSynchronize(stream);
+      // step 3: broadcast (in place)
+      timers[TIMER_COLL_COMM] = clockNano();
+      FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorHost]->broadcast(
+          buff, buff, count, datatype, root, comm->host_comm, NULL));
+      timers[TIMER_COLL_COMM] = clockNano() - timers[TIMER_COLL_COMM];
 
-      // inter-cluster sendrecv
-      flagcxGroupStart(comm);
-      if (comm->homo_inter_rank == comm->homo_rank) {
-        if (comm->cluster_ids[comm->rank] == comm->cluster_ids[root]) {
-          for (int i = 0; i < comm->nclusters; ++i) {
-            if (i == comm->cluster_ids[root]) {
-              continue;
-            }
-            FLAGCXCHECK(flagcxHeteroSend(recvbuff, count, datatype,
-                                         comm->cluster_inter_ranks[i],
-                                         comm->hetero_comm, stream));
-          }
-        } else {
-          FLAGCXCHECK(flagcxHeteroRecv(
-              recvbuff, count, datatype,
-              comm->cluster_inter_ranks[comm->cluster_ids[root]],
-              comm->hetero_comm, stream));
-        }
-      }
-      flagcxGroupEnd(comm);
+      // step 4: memcpy h2d
+      timers[TIMER_COLL_MEM_H2D] = clockNano();
+      FLAGCXCHECK(hostCopy(recvbuff, buff, size, flagcxMemcpyHostToDevice,
+                           stream));
+      timers[TIMER_COLL_MEM_H2D] = clockNano() - timers[TIMER_COLL_MEM_H2D];
 
-      // TODO: use stream wait rather than stream sync to avoid cpu blocking
-      deviceAdaptor->streamSynchronize(stream);
+      // step 5: release host buffer
+      timers[TIMER_COLL_FREE] = clockNano();
+      FLAGCXCHECK(flagcxHostBufferRelease(comm->host_buffer_pool, buff));
+      timers[TIMER_COLL_FREE] = clockNano() - timers[TIMER_COLL_FREE];
 
-      // intra-cluster bcast
-      if (!is_root_cluster && comm->homo_ranks > 1) {
-        FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->broadcast(
-            recvbuff, recvbuff, count, datatype, comm->homo_inter_rank,
-            comm->homo_comm, stream));
+      timers[TIMER_COLL_TOTAL] = clockNano() - timers[TIMER_COLL_TOTAL];
+      INFO(FLAGCX_COLL,
+           "Flagcx timings - %s Broadcast: rank %d nranks %d total %.2fms "
+           "(memory alloc "
+           "%.2fms, memory free %.2fms, memory d2h %.2fms, memory h2d %.2fms, "
+           "comm %.2fms)",
+           cclAdaptors[flagcxCCLAdaptorHost]->name, comm->rank, comm->nranks,
+           timers[TIMER_COLL_TOTAL] / 1e6, timers[TIMER_COLL_ALLOC] / 1e6,
+           timers[TIMER_COLL_FREE] / 1e6, timers[TIMER_COLL_MEM_D2H] / 1e6,
+           timers[TIMER_COLL_MEM_H2D] / 1e6, timers[TIMER_COLL_COMM] / 1e6);
+
+      return flagcxSuccess;
+    } else {
+      int root_cluster = comm->cluster_ids[root];
+      bool is_root_cluster = (comm->cluster_ids[comm->rank] == root_cluster);
+      int offset = comm->cluster_offsets[root_cluster];
+      // the root represents its cluster, the homo_inter_rank the other ones
+      std::vector<int> reps(comm->cluster_inter_ranks,
+                            comm->cluster_inter_ranks + comm->nclusters);
+      reps[root_cluster] = root;
+      int rep_homo_rank =
+          is_root_cluster ? root - offset : comm->homo_inter_rank;
+
+      // c2cInterBroadcast synchronizes the stream before the root sends
+      if (comm->rank == root && sendbuff != recvbuff) {
+        FLAGCXCHECK(deviceAdaptor->deviceMemcpy(
+            recvbuff, const_cast<void *>(sendbuff),
+            count * getFlagcxDataTypeSize(datatype),
+            flagcxMemcpyDeviceToDevice, stream, NULL));
+      }
+
+      if (comm->rank == reps[comm->cluster_ids[comm->rank]]) {
+        // pipelined inter-cluster bcast between the representatives, each
+        // chunk is broadcast within the cluster while the next one is
+        // transferred
+        FLAGCXCHECK(c2cInterBroadcast(recvbuff, count, datatype, reps.data(),
+                                      comm->nclusters,
+                                      comm->cluster_ids[comm->rank],
+                                      root_cluster, rep_homo_rank, comm,
+                                      stream));
+      } else {
+        // intra-cluster bcast of the chunks from the representative
+        size_t chunkcount;
+        size_t nchunks = c2cBcastChunks(count, datatype, &chunkcount);
+        size_t chunksize = chunkcount * getFlagcxDataTypeSize(datatype);
+        char *buffer = static_cast<char *>(recvbuff);
+        for (size_t i = 0; i < nchunks; ++i) {
+          FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->broadcast(
+              buffer + i * chunksize, buffer + i * chunksize,
+              std::min(chunkcount, count - i * chunkcount), datatype,
+              rep_homo_rank, comm->homo_comm, stream));
+        }
       }
     }
   }
   return flagcxSuccess;
 }
 
-flagcxResult_t flagcxAllReduce(const void *sendbuff, void *recvbuff,
+flagcxResult_t flagcxBroadcast(const void *sendbuff, void *recvbuff,
                                size_t count, flagcxDataType_t datatype,
-                               flagcxRedOp_t op, flagcxComm_t comm,
+                               int root, flagcxComm_t comm,
                                flagcxStream_t stream) {
+  return runBroadcast(sendbuff, recvbuff, count, datatype, root, comm, stream,
+                      FLAGCX_HETERO_ALGO_UNDEF);
+}
+
+struct hostAllReduceArgs {
+  flagcxDataType_t datatype;
+  flagcxRedOp_t op;
+  flagcxComm_t comm;
+};
+
+// One segment of the pipelined host-comm allreduce.
+static flagcxResult_t hostAllReduceSegment(void *hostIn, void *hostOut,
+                                           size_t offset, size_t bytes,
+                                           void *args) {
+  struct hostAllReduceArgs *a = (struct hostAllReduceArgs *)args;
+  return cclAdaptors[flagcxCCLAdaptorHost]->allReduce(
+      (char *)hostIn + offset, (char *)hostOut + offset,
+      bytes / getFlagcxDataTypeSize(a->datatype), a->datatype, a->op,
+      a->comm->host_comm, NULL);
+}
+
+static flagcxResult_t runAllReduce(const void *sendbuff, void *recvbuff,
+                                   size_t count, flagcxDataType_t datatype,
+                                   flagcxRedOp_t op, flagcxComm_t comm,
+                                   flagcxStream_t stream, int algo) {
   FLAGCXCHECK(flagcxEnsureCommReady(comm));
   if (is_homo_comm(comm)) {
     return cclAdaptors[flagcxCCLAdaptorDevice]->allReduce(
         sendbuff, recvbuff, count, datatype, op, comm->homo_comm, stream);
   } else {
-    if (use_host_comm() || comm->has_single_rank_homo_comm) {
+    if (c2cGroupRecord(comm, c2cGroupAllReduce, sendbuff, recvbuff, count,
+                       datatype, op, 0, stream, algo)) {
+      return flagcxSuccess;
+    }
+    // plans resolve the algorithm once
+    if (algo == FLAGCX_HETERO_ALGO_UNDEF) {
+      algo = collAlgo(comm, flagcxCollAllReduce, count, datatype);
+    }
+    if (algo == FLAGCX_HETERO_ALGO_HOST) {
+      FLAGCXCHECK(hostCommInit(comm));
+      // queued to the worker of the host engine
+      if (flagcxHostEngineDefers(comm->host_engine)) {
+        return flagcxHostEngineEnqueue(
+            comm->host_engine,
+            [=](flagcxStream_t s) {
+              return runAllReduce(sendbuff, recvbuff, count, datatype, op, comm,
+                                  s, algo);
+            },
+            stream);
+      }
       // c2c validation
       if (comm->has_single_rank_homo_comm) {
         WARN("Host comm is required to perform C2C allreduce op when "
@@ -1029,34 +2468,47 @@ flagcxResult_t flagcxAllReduce(const void *sendbuff, void *recvbuff,
       void *buff_out;
       size_t size = count * getFlagcxDataTypeSize(datatype);
 
-      // step 1: malloc host buffer
+      // step 1: acquire host buffer
       timers[TIMER_COLL_ALLOC] = clockNano();
-      deviceAdaptor->deviceMalloc(&buff_in, size, flagcxMemHost, NULL);
-      deviceAdaptor->deviceMalloc(&buff_out, size, flagcxMemHost, NULL);
+      FLAGCXCHECK(
+          flagcxHostBufferAcquire(comm->host_buffer_pool, size, &buff_in));
+      FLAGCXCHECK(
+          flagcxHostBufferAcquire(comm->host_buffer_pool, size, &buff_out));
       timers[TIMER_COLL_ALLOC] = clockNano() - timers[TIMER_COLL_ALLOC];
 
-      // step 2: memcpy d2h
-      timers[TIMER_COLL_MEM_D2H] = clockNano();
-      deviceAdaptor->deviceMemcpy(buff_in, const_cast<void *>(sendbuff), size,
-                                  flagcxMemcpyDeviceToHost, NULL, NULL);
-      timers[TIMER_COLL_MEM_D2H] = clockNano() - timers[TIMER_COLL_MEM_D2H];
-
-      // step 3: allreduce
-      timers[TIMER_COLL_COMM] = clockNano();
-      cclAdaptors[flagcxCCLAdaptorHost]->allReduce(
-          buff_in, buff_out, count, datatype, op, comm->host_comm, NULL);
-      timers[TIMER_COLL_COMM] = clockNano() - timers[TIMER_COLL_COMM];
-
-      // step 4: memcpy h2d
-      timers[TIMER_COLL_MEM_H2D] = clockNano();
-      deviceAdaptor->deviceMemcpy(recvbuff, buff_out, size,
-                                  flagcxMemcpyHostToDevice, NULL, NULL);
-      timers[TIMER_COLL_MEM_H2D] = clockNano() - timers[TIMER_COLL_MEM_H2D];
+      if (flagcxHostPipelineEnabled(comm->host_pipeline, size)) {
+        // steps 2-4 overlapped segment by segment, accounted as comm
+        timers[TIMER_COLL_COMM] = clockNano();
+        struct hostAllReduceArgs args = {datatype, op, comm};
+        FLAGCXCHECK(flagcxHostPipelineRun(
+            comm->host_pipeline, sendbuff, recvbuff, buff_in, buff_out, size,
+            getFlagcxDataTypeSize(datatype), hostAllReduceSegment, &args,
+            stream));
+        timers[TIMER_COLL_COMM] = clockNano() - timers[TIMER_COLL_COMM];
+      } else {
+        // step 2: memcpy d2h
+        timers[TIMER_COLL_MEM_D2H] = clockNano();
+        FLAGCXCHECK(hostCopy(buff_in, sendbuff, size, flagcxMemcpyDeviceToHost,
+                             stream));
+        timers[TIMER_COLL_MEM_D2H] = clockNano() - timers[TIMER_COLL_MEM_D2H];
+
+        // step 3: allreduce
+        timers[TIMER_COLL_COMM] = clockNano();
+        FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorHost]->allReduce(
+            buff_in, buff_out, count, datatype, op, comm->host_comm, NULL));
+        timers[TIMER_COLL_COMM] = clockNano() - timers[TIMER_COLL_COMM];
+
+        // step 4: memcpy h2d
+        timers[TIMER_COLL_MEM_H2D] = clockNano();
+        FLAGCXCHECK(hostCopy(recvbuff, buff_out, size, flagcxMemcpyHostToDevice,
+                             stream));
+        timers[TIMER_COLL_MEM_H2D] = clockNano() - timers[TIMER_COLL_MEM_H2D];
+      }
 
-      // step 5: free host buffer
+      // step 5: release host buffer
       timers[TIMER_COLL_FREE] = clockNano();
-      deviceAdaptor->deviceFree(buff_in, flagcxMemHost, NULL);
-      deviceAdaptor->deviceFree(buff_out, flagcxMemHost, NULL);
+      FLAGCXCHECK(flagcxHostBufferRelease(comm->host_buffer_pool, buff_in));
+      FLAGCXCHECK(flagcxHostBufferRelease(comm->host_buffer_pool, buff_out));
       timers[TIMER_COLL_FREE] = clockNano() - timers[TIMER_COLL_FREE];
 
       timers[TIMER_COLL_TOTAL] = clockNano() - timers[TIMER_COLL_TOTAL];
@@ -1076,118 +2528,180 @@ flagcxResult_t flagcxAllReduce(const void *sendbuff, void *recvbuff,
         return flagcxInvalidArgument;
       }
 
-      if (comm->support_multi_nic < 0) {
-        // intra-cluster reduce
-        FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->reduce(
-            sendbuff, recvbuff, count, datatype, op, comm->homo_inter_rank,
-            comm->homo_comm, stream));
+      // peer data is decoded to fp32 before it is reduced
+      c2cCompressScope compress(comm->hetero_comm);
+      int npeers = comm->nclusters - 1;
+      void *peerbuff;
+
+      if (algo == FLAGCX_HETERO_ALGO_SINGLE_NIC) {
+        // the buffer is striped over the gateways of the clusters (see
+        // c2cSelectGateways), stripe g goes through gateway g of every cluster
+        size_t typesize = getFlagcxDataTypeSize(datatype);
+        int ngw = comm->ngateways;
+        int my_cluster = comm->cluster_ids[comm->rank];
+        const int *gateways = comm->cluster_gateways + my_cluster * ngw;
+        int my_stripe = -1;
+
+        // intra-cluster reduce of every stripe to its gateway
+        for (int g = 0; g < ngw; ++g) {
+          size_t begin, end;
+          c2cShardRange(count, ngw, g, &begin, &end);
+          if (gateways[g] == comm->rank)
+            my_stripe = g;
+          if (end == begin)
+            continue;
+          FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->reduce(
+              static_cast<const void *>(static_cast<const char *>(sendbuff) +
+                                        begin * typesize),
+              static_cast<void *>(static_cast<char *>(recvbuff) +
+                                  begin * typesize),
+              end - begin, datatype, op, comm->globalrank2homorank[gateways[g]],
+              comm->homo_comm, stream));
+        }
 
-        if (comm->homo_inter_rank != comm->homo_rank) {
-          if (op == flagcxSum) {
-            deviceAdaptor->deviceMemset(recvbuff, 0,
-                                        count * getFlagcxDataTypeSize(datatype),
-                                        flagcxMemDevice, stream);
+        // cross-cluster allreduce of the stripe of this gateway, between the
+        // gateways of the same stripe
+        if (my_stripe >= 0) {
+          size_t begin, end;
+          c2cShardRange(count, ngw, my_stripe, &begin, &end);
+          std::vector<int> reps(comm->nclusters);
+          for (int i = 0; i < comm->nclusters; ++i) {
+            reps[i] = comm->cluster_gateways[i * ngw + my_stripe];
           }
+          // TODO: use stream wait rather than stream sync to avoid cpu
+          // blocking
+          deviceAdaptor->streamSynchronize(stream);
+
+          FLAGCXCHECK(c2cInterAllReduce(
+              static_cast<void *>(static_cast<char *>(recvbuff) +
+                                  begin * typesize),
+              end - begin, datatype, op, reps.data(), comm->nclusters,
+              my_cluster, comm, stream));
+        }
+
+        // intra-cluster broadcast of every stripe from its gateway
+        for (int g = 0; g < ngw; ++g) {
+          size_t begin, end;
+          c2cShardRange(count, ngw, g, &begin, &end);
+          if (end == begin)
+            continue;
+          void *stripe = static_cast<void *>(static_cast<char *>(recvbuff) +
+                                             begin * typesize);
+          FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->broadcast(
+              stripe, stripe, end - begin, datatype,
+              comm->globalrank2homorank[gateways[g]], comm->homo_comm,
+              stream));
         }
+      } else {
+        // every cluster splits the buffer over its own ranks, so that all
+        // ranks of clusters of any size carry a part of the cross-cluster
+        // traffic, and reduces the range of the buffer given by its weight
+        // (see c2cClusterRange) for all clusters
+        size_t typesize = getFlagcxDataTypeSize(datatype);
+        int my_cluster = comm->cluster_ids[comm->rank];
+        size_t begin, end;
+        c2cShardRange(count, comm->homo_ranks, comm->homo_rank, &begin, &end);
+        void *shard = static_cast<void *>(static_cast<char *>(recvbuff) +
+                                          begin * typesize);
+        // part of the shard reduced by cluster i
+        std::vector<size_t> lo(comm->nclusters), hi(comm->nclusters);
+        for (int i = 0; i < comm->nclusters; ++i) {
+          c2cClusterRange(comm, count, i, &lo[i], &hi[i]);
+          lo[i] = std::max(begin, lo[i]);
+          hi[i] = std::max(lo[i], std::min(end, hi[i]));
+        }
+        size_t owncount = hi[my_cluster] - lo[my_cluster];
+        void *own = static_cast<void *>(static_cast<char *>(recvbuff) +
+                                        lo[my_cluster] * typesize);
+
+        // intra-cluster reducescatter
+        FLAGCXCHECK(c2cReduceScatterRange(sendbuff, shard, count, datatype, op,
+                                          comm, stream));
+
+        deviceAdaptor->deviceMalloc(&peerbuff, npeers * owncount * typesize,
+                                    flagcxMemDevice, stream);
 
         // TODO: use stream wait rather than stream sync to avoid cpu blocking
         deviceAdaptor->streamSynchronize(stream);
 
-        // inter-cluster sendrecv
+        // inter-cluster reducescatter, every rank sends the parts of its shard
+        // reduced by the other clusters to the ranks owning them there, and
+        // receives the part it reduces from the ranks of the other clusters
         int cid = 0;
+        int start = 0;
         flagcxGroupStart(comm);
         for (int i = 0; i < comm->nclusters; ++i) {
-          if (comm->cluster_ids[comm->rank] == i)
+          if (i == my_cluster) {
+            start += comm->cluster_sizes[i];
             continue;
-          // TODO: better to add an assertation ensuring that comm->ncluster <=
-          // comm->homo_ranks
-          int homo_rank_to_recv_from_cluster =
-              (comm->homo_inter_rank - cid - 1 + comm->homo_ranks) %
-              comm->homo_ranks;
-          if (comm->homo_rank == homo_rank_to_recv_from_cluster) {
-            FLAGCXCHECK(flagcxHeteroRecv(recvbuff, count, datatype,
-                                         comm->cluster_inter_ranks[i],
-                                         comm->hetero_comm, stream));
           }
-          int homo_rank_to_send_to_cluster =
-              (comm->globalrank2homorank[comm->cluster_inter_ranks[i]] - cid -
-               1 + comm->cluster_sizes[i]) %
-              comm->cluster_sizes[i];
-          int global_rank_to_send_to_cluster =
-              homo_rank_to_send_to_cluster -
-              comm->globalrank2homorank[comm->cluster_inter_ranks[i]] +
-              comm->cluster_inter_ranks[i];
-          if (comm->homo_inter_rank == comm->homo_rank) {
-            FLAGCXCHECK(flagcxHeteroSend(recvbuff, count, datatype,
-                                         global_rank_to_send_to_cluster,
-                                         comm->hetero_comm, stream));
+          if (owncount > 0) {
+            FLAGCXCHECK(c2cExchangeRange(
+                false,
+                static_cast<void *>(static_cast<char *>(peerbuff) +
+                                    cid * owncount * typesize),
+                lo[my_cluster], hi[my_cluster], count, start,
+                comm->cluster_sizes[i], datatype, comm, stream));
+          }
+          if (hi[i] > lo[i]) {
+            FLAGCXCHECK(c2cExchangeRange(
+                true,
+                static_cast<void *>(static_cast<char *>(recvbuff) +
+                                    lo[i] * typesize),
+                lo[i], hi[i], count, start, comm->cluster_sizes[i], datatype,
+                comm, stream));
           }
+          start += comm->cluster_sizes[i];
           cid += 1;
         }
-        flagcxGroupEnd(comm);
-
-        // TODO: use stream wait rather than stream sync to avoid cpu blocking
-        deviceAdaptor->streamSynchronize(stream);
-
-        // intra-cluster allreduce
-        FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->allReduce(
-            recvbuff, recvbuff, count, datatype, op, comm->homo_comm, stream));
-      } else {
-        // ensure that all clusters have same sizes
-        for (int i = 0; i < comm->nclusters; ++i) {
-          assert(comm->cluster_sizes[0] == comm->cluster_sizes[i]);
-        }
+        flagcxGroupEnd(comm);
 
-        size_t recvcount = count / comm->homo_ranks;
-        size_t offset_step = recvcount * getFlagcxDataTypeSize(datatype);
+        // TODO: use stream wait rather than stream sync to avoid cpu blocking
+        deviceAdaptor->streamSynchronize(stream);
 
-        // intra-cluster reducescatter
-        FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->reduceScatter(
-            sendbuff,
-            static_cast<void *>(static_cast<char *>(recvbuff) +
-                                offset_step * comm->homo_rank),
-            recvcount, datatype, op, comm->homo_comm, stream));
-
-        if (op == flagcxSum) {
-          deviceAdaptor->deviceMemset(recvbuff, 0,
-                                      offset_step * comm->homo_rank,
-                                      flagcxMemDevice, stream);
-          deviceAdaptor->deviceMemset(
+        // cross-cluster reduce of the own part
+        FLAGCXCHECK(c2cReducePeers(own, peerbuff, npeers, owncount, datatype,
+                                   op, comm, stream));
+        deviceAdaptor->deviceFree(peerbuff, flagcxMemDevice, stream);
+
+        // the other clusters get the own part compressed, keep what they
+        // decode, message by message
+        std::vector<size_t> cuts;
+        c2cCodecCuts(comm, count, datatype, &cuts);
+        for (size_t piece = lo[my_cluster]; piece < hi[my_cluster];) {
+          auto cut = std::upper_bound(cuts.begin(), cuts.end(), piece);
+          size_t next = cut == cuts.end() ? hi[my_cluster]
+                                          : std::min(hi[my_cluster], *cut);
+          FLAGCXCHECK(c2cCodecRoundTrip(
               static_cast<void *>(static_cast<char *>(recvbuff) +
-                                  offset_step * (comm->homo_rank + 1)),
-              0, offset_step * (comm->homo_ranks - comm->homo_rank - 1),
-              flagcxMemDevice, stream);
+                                  piece * typesize),
+              next - piece, next - piece, datatype, comm, stream));
+          piece = next;
         }
 
-        // TODO: use stream wait rather than stream sync to avoid cpu blocking
-        deviceAdaptor->streamSynchronize(stream);
-
-        // inter-cluster sendrecv
-        int cid = 0;
-        int start = 0;
+        // inter-cluster allgather, the reduced parts go back to the ranks of
+        // the other clusters holding them in their shards
+        start = 0;
         flagcxGroupStart(comm);
         for (int i = 0; i < comm->nclusters; ++i) {
-          if (comm->cluster_ids[comm->rank] == i) {
+          if (i == my_cluster) {
             start += comm->cluster_sizes[i];
             continue;
-          } else {
-            cid = (comm->cluster_ids[comm->rank] - i + comm->nclusters) %
-                  comm->nclusters;
           }
-          int recv_from_cluster_homo_rank =
-              (comm->homo_rank - cid + comm->homo_ranks) % comm->homo_ranks;
-          FLAGCXCHECK(flagcxHeteroRecv(
-              static_cast<void *>(static_cast<char *>(recvbuff) +
-                                  offset_step * recv_from_cluster_homo_rank),
-              recvcount, datatype, recv_from_cluster_homo_rank + start,
-              comm->hetero_comm, stream));
-          int send_to_cluster_homo_rank =
-              (comm->homo_rank + cid) % comm->homo_ranks;
-          FLAGCXCHECK(flagcxHeteroSend(
-              static_cast<void *>(static_cast<char *>(recvbuff) +
-                                  offset_step * comm->homo_rank),
-              recvcount, datatype, send_to_cluster_homo_rank + start,
-              comm->hetero_comm, stream));
+          if (owncount > 0) {
+            FLAGCXCHECK(c2cExchangeRange(true, own, lo[my_cluster],
+                                         hi[my_cluster], count, start,
+                                         comm->cluster_sizes[i], datatype,
+                                         comm, stream, &cuts));
+          }
+          if (hi[i] > lo[i]) {
+            FLAGCXCHECK(c2cExchangeRange(
+                false,
+                static_cast<void *>(static_cast<char *>(recvbuff) +
+                                    lo[i] * typesize),
+                lo[i], hi[i], count, start, comm->cluster_sizes[i], datatype,
+                comm, stream, &cuts));
+          }
           start += comm->cluster_sizes[i];
         }
         flagcxGroupEnd(comm);
@@ -1195,25 +2709,52 @@ flagcxResult_t flagcxAllReduce(const void *sendbuff, void *recvbuff,
         // TODO: use stream wait rather than stream sync to avoid cpu blocking
         deviceAdaptor->streamSynchronize(stream);
 
-        // intra-cluster allreduce
-        FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->allReduce(
-            recvbuff, recvbuff, count, datatype, op, comm->homo_comm, stream));
+        // intra-cluster allgather
+        FLAGCXCHECK(c2cAllGatherRange(recvbuff, count, datatype, comm, stream));
       }
     }
   }
   return flagcxSuccess;
 }
 
-flagcxResult_t flagcxReduceScatter(const void *sendbuff, void *recvbuff,
-                                   size_t recvcount, flagcxDataType_t datatype,
-                                   flagcxRedOp_t op, flagcxComm_t comm,
-                                   flagcxStream_t stream) {
+flagcxResult_t flagcxAllReduce(const void *sendbuff, void *recvbuff,
+                               size_t count, flagcxDataType_t datatype,
+                               flagcxRedOp_t op, flagcxComm_t comm,
+                               flagcxStream_t stream) {
+  return runAllReduce(sendbuff, recvbuff, count, datatype, op, comm, stream,
+                      FLAGCX_HETERO_ALGO_UNDEF);
+}
+
+static flagcxResult_t runReduceScatter(const void *sendbuff, void *recvbuff,
+                                       size_t recvcount,
+                                       flagcxDataType_t datatype,
+                                       flagcxRedOp_t op, flagcxComm_t comm,
+                                       flagcxStream_t stream, int algo) {
   FLAGCXCHECK(flagcxEnsureCommReady(comm));
   if (is_homo_comm(comm)) {
     return cclAdaptors[flagcxCCLAdaptorDevice]->reduceScatter(
         sendbuff, recvbuff, recvcount, datatype, op, comm->homo_comm, stream);
   } else {
-    if (use_host_comm() || comm->has_single_rank_homo_comm) {
+    if (c2cGroupRecord(comm, c2cGroupReduceScatter, sendbuff, recvbuff,
+                       recvcount, datatype, op, 0, stream, algo)) {
+      return flagcxSuccess;
+    }
+    // plans resolve the algorithm once
+    if (algo == FLAGCX_HETERO_ALGO_UNDEF) {
+      algo = collAlgo(comm, flagcxCollReduceScatter, recvcount, datatype);
+    }
+    if (algo == FLAGCX_HETERO_ALGO_HOST) {
+      FLAGCXCHECK(hostCommInit(comm));
+      // queued to the worker of the host engine
+      if (flagcxHostEngineDefers(comm->host_engine)) {
+        return flagcxHostEngineEnqueue(
+            comm->host_engine,
+            [=](flagcxStream_t s) {
+              return runReduceScatter(sendbuff, recvbuff, recvcount, datatype,
+                                      op, comm, s, algo);
+            },
+            stream);
+      }
       // c2c validation
       if (comm->has_single_rank_homo_comm) {
         WARN("Host comm is required to perform C2C reducescatter op when "
@@ -1227,17 +2768,18 @@ flagcxResult_t flagcxReduceScatter(const void *sendbuff, void *recvbuff,
       size_t recv_size = recvcount * getFlagcxDataTypeSize(datatype);
       size_t send_size = comm->nranks * recv_size;
 
-      // step 1: malloc host buffer
+      // step 1: acquire host buffer
       timers[TIMER_COLL_ALLOC] = clockNano();
-      deviceAdaptor->deviceMalloc(&buff_in, send_size, flagcxMemHost, NULL);
-      deviceAdaptor->deviceMalloc(&buff_out, recv_size, flagcxMemHost, NULL);
+      FLAGCXCHECK(
+          flagcxHostBufferAcquire(comm->host_buffer_pool, send_size, &buff_in));
+      FLAGCXCHECK(flagcxHostBufferAcquire(comm->host_buffer_pool,
+                                          recv_size, &buff_out));
       timers[TIMER_COLL_ALLOC] = clockNano() - timers[TIMER_COLL_ALLOC];
 
       // step 2: memcpy d2h
       timers[TIMER_COLL_MEM_D2H] = clockNano();
-      deviceAdaptor->deviceMemcpy(buff_in, const_cast<void *>(sendbuff),
-                                  send_size, flagcxMemcpyDeviceToHost, NULL,
-                                  NULL);
+      FLAGCXCHECK(hostCopy(buff_in, sendbuff, send_size,
+                           flagcxMemcpyDeviceToHost, stream));
       timers[TIMER_COLL_MEM_D2H] = clockNano() - timers[TIMER_COLL_MEM_D2H];
 
       // step 3: reducescatter
@@ -1248,14 +2790,14 @@ flagcxResult_t flagcxReduceScatter(const void *sendbuff, void *recvbuff,
 
       // step 4: memcpy h2d
       timers[TIMER_COLL_MEM_H2D] = clockNano();
-      deviceAdaptor->deviceMemcpy(recvbuff, buff_out, recv_size,
-                                  flagcxMemcpyHostToDevice, NULL, NULL);
+      FLAGCXCHECK(hostCopy(recvbuff, buff_out, recv_size,
+                           flagcxMemcpyHostToDevice, stream));
       timers[TIMER_COLL_MEM_H2D] = clockNano() - timers[TIMER_COLL_MEM_H2D];
 
-      // step 5: free host buffer
+      // step 5: release host buffer
       timers[TIMER_COLL_FREE] = clockNano();
-      deviceAdaptor->deviceFree(buff_in, flagcxMemHost, NULL);
-      deviceAdaptor->deviceFree(buff_out, flagcxMemHost, NULL);
+      FLAGCXCHECK(flagcxHostBufferRelease(comm->host_buffer_pool, buff_in));
+      FLAGCXCHECK(flagcxHostBufferRelease(comm->host_buffer_pool, buff_out));
       timers[TIMER_COLL_FREE] = clockNano() - timers[TIMER_COLL_FREE];
 
       timers[TIMER_COLL_TOTAL] = clockNano() - timers[TIMER_COLL_TOTAL];
@@ -1275,13 +2817,14 @@ flagcxResult_t flagcxReduceScatter(const void *sendbuff, void *recvbuff,
         return flagcxInvalidArgument;
       }
 
-      // create a tmp buffer
       void *tmpbuff;
       size_t count = comm->nranks * recvcount;
       size_t size = count * getFlagcxDataTypeSize(datatype);
-      deviceAdaptor->deviceMalloc(&tmpbuff, size, flagcxMemDevice, stream);
 
-      if (comm->support_multi_nic < 0) {
+      if (algo == FLAGCX_HETERO_ALGO_SINGLE_NIC) {
+        // create a tmp buffer
+        deviceAdaptor->deviceMalloc(&tmpbuff, size, flagcxMemDevice, stream);
+
         // intra-cluster reduce
         FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->reduce(
             sendbuff, tmpbuff, count, datatype, op, comm->homo_inter_rank,
@@ -1334,88 +2877,109 @@ flagcxResult_t flagcxReduceScatter(const void *sendbuff, void *recvbuff,
         deviceAdaptor->streamSynchronize(stream);
 
         // intra-cluster reducescatter
-        int offset = 0;
-        for (int i = 0; i < comm->cluster_ids[comm->rank]; ++i) {
-          offset += comm->cluster_sizes[i];
-        }
+        int offset = comm->cluster_offsets[comm->cluster_ids[comm->rank]];
         FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->reduceScatter(
             static_cast<const void *>(static_cast<const char *>(tmpbuff) +
                                       offset * recvcount *
                                           getFlagcxDataTypeSize(datatype)),
             recvbuff, recvcount, datatype, op, comm->homo_comm, stream));
       } else {
-        // ensure that all clusters have same sizes
+        size_t typesize = getFlagcxDataTypeSize(datatype);
+        int npeers = comm->nclusters - 1;
+        int my_cluster = comm->cluster_ids[comm->rank];
+        // the block of cluster i holds the cluster_sizes[i] * recvcount
+        // elements of its ranks, every cluster splits each block over its own
+        // ranks so that all ranks of clusters of any size carry a part of the
+        // cross-cluster traffic
+        size_t my_block = comm->homo_ranks * recvcount;
+        int my_start = 0;
+        size_t tmpcount = 0;
         for (int i = 0; i < comm->nclusters; ++i) {
-          assert(comm->cluster_sizes[0] == comm->cluster_sizes[i]);
+          if (i < my_cluster)
+            my_start += comm->cluster_sizes[i];
+          if (i == my_cluster)
+            continue;
+          size_t begin, end;
+          c2cShardRange(comm->cluster_sizes[i] * recvcount, comm->homo_ranks,
+                        comm->homo_rank, &begin, &end);
+          tmpcount += end - begin;
         }
 
-        size_t tmpcount = count / comm->homo_ranks;
-        size_t offset_step = tmpcount * getFlagcxDataTypeSize(datatype);
-
-        // intra-cluster reducescatter
-        FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->reduceScatter(
-            sendbuff,
-            static_cast<void *>(static_cast<char *>(tmpbuff) +
-                                offset_step * comm->homo_rank),
-            tmpcount, datatype, op, comm->homo_comm, stream));
-
-        if (op == flagcxSum) {
-          deviceAdaptor->deviceMemset(tmpbuff, 0, offset_step * comm->homo_rank,
-                                      flagcxMemDevice, stream);
-          deviceAdaptor->deviceMemset(
-              static_cast<void *>(static_cast<char *>(tmpbuff) +
-                                  offset_step * (comm->homo_rank + 1)),
-              0, offset_step * (comm->homo_ranks - comm->homo_rank - 1),
-              flagcxMemDevice, stream);
+        // create a tmp buffer holding the shards of the blocks of the other
+        // clusters followed by the partial results received from them
+        deviceAdaptor->deviceMalloc(&tmpbuff,
+                                    (tmpcount + npeers * recvcount) * typesize,
+                                    flagcxMemDevice, stream);
+        void *peerbuff = static_cast<void *>(static_cast<char *>(tmpbuff) +
+                                             tmpcount * typesize);
+
+        // intra-cluster reducescatter, the block of this cluster goes straight
+        // to recvbuff
+        FLAGCXCHECK(c2cReduceScatterRange(
+            static_cast<const void *>(static_cast<const char *>(sendbuff) +
+                                      my_start * recvcount * typesize),
+            recvbuff, my_block, datatype, op, comm, stream));
+        size_t offset = 0;
+        int start = 0;
+        for (int i = 0; i < comm->nclusters; ++i) {
+          if (i != my_cluster) {
+            size_t block = comm->cluster_sizes[i] * recvcount;
+            size_t begin, end;
+            c2cShardRange(block, comm->homo_ranks, comm->homo_rank, &begin,
+                          &end);
+            FLAGCXCHECK(c2cReduceScatterRange(
+                static_cast<const void *>(static_cast<const char *>(sendbuff) +
+                                          start * recvcount * typesize),
+                static_cast<void *>(static_cast<char *>(tmpbuff) +
+                                    offset * typesize),
+                block, datatype, op, comm, stream));
+            offset += end - begin;
+          }
+          start += comm->cluster_sizes[i];
         }
 
         // TODO: use stream wait rather than stream sync to avoid cpu blocking
         deviceAdaptor->streamSynchronize(stream);
 
-        // inter-cluster sendrecv
+        // inter-cluster sendrecv, the shards of the block of another cluster
+        // go to the ranks owning their elements, the ranks of the other
+        // clusters holding the shards of recvbuff send them back
         int cid = 0;
-        int start = 0;
+        offset = 0;
+        start = 0;
         flagcxGroupStart(comm);
         for (int i = 0; i < comm->nclusters; ++i) {
-          if (comm->cluster_ids[comm->rank] == i) {
+          if (i == my_cluster) {
             start += comm->cluster_sizes[i];
             continue;
-          } else {
-            cid = (comm->cluster_ids[comm->rank] - i + comm->nclusters) %
-                  comm->nclusters;
           }
-          int recv_from_cluster_homo_rank =
-              (comm->homo_rank - cid + comm->homo_ranks) % comm->homo_ranks;
-          FLAGCXCHECK(flagcxHeteroRecv(
+          size_t block = comm->cluster_sizes[i] * recvcount;
+          size_t begin, end;
+          c2cShardRange(block, comm->homo_ranks, comm->homo_rank, &begin, &end);
+          FLAGCXCHECK(c2cExchangeRange(
+              false,
+              static_cast<void *>(static_cast<char *>(peerbuff) +
+                                  cid * recvcount * typesize),
+              comm->homo_rank * recvcount, (comm->homo_rank + 1) * recvcount,
+              my_block, start, comm->cluster_sizes[i], datatype, comm, stream));
+          FLAGCXCHECK(c2cExchangeRange(
+              true,
               static_cast<void *>(static_cast<char *>(tmpbuff) +
-                                  offset_step * recv_from_cluster_homo_rank),
-              tmpcount, datatype, recv_from_cluster_homo_rank + start,
-              comm->hetero_comm, stream));
-          int send_to_cluster_homo_rank =
-              (comm->homo_rank + cid) % comm->homo_ranks;
-          FLAGCXCHECK(flagcxHeteroSend(
-              static_cast<void *>(static_cast<char *>(tmpbuff) +
-                                  offset_step * comm->homo_rank),
-              tmpcount, datatype, send_to_cluster_homo_rank + start,
-              comm->hetero_comm, stream));
+                                  offset * typesize),
+              begin, end, block, start, comm->cluster_sizes[i], datatype, comm,
+              stream));
+          offset += end - begin;
           start += comm->cluster_sizes[i];
+          cid += 1;
         }
         flagcxGroupEnd(comm);
 
         // TODO: use stream wait rather than stream sync to avoid cpu blocking
         deviceAdaptor->streamSynchronize(stream);
 
-        // intra-cluster reducescatter
-        int offset = 0;
-        for (int i = 0; i < comm->cluster_ids[comm->rank]; ++i) {
-          offset += comm->cluster_sizes[i];
-        }
-
-        FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->reduceScatter(
-            static_cast<const void *>(static_cast<const char *>(tmpbuff) +
-                                      offset * recvcount *
-                                          getFlagcxDataTypeSize(datatype)),
-            recvbuff, recvcount, datatype, op, comm->homo_comm, stream));
+        // cross-cluster reduce
+        FLAGCXCHECK(c2cReducePeers(recvbuff, peerbuff, npeers, recvcount,
+                                   datatype, op, comm, stream));
       }
 
       deviceAdaptor->deviceFree(tmpbuff, flagcxMemDevice, stream);
@@ -1424,15 +2988,43 @@ flagcxResult_t flagcxReduceScatter(const void *sendbuff, void *recvbuff,
   return flagcxSuccess;
 }
 
-flagcxResult_t flagcxAllGather(const void *sendbuff, void *recvbuff,
-                               size_t sendcount, flagcxDataType_t datatype,
-                               flagcxComm_t comm, flagcxStream_t stream) {
+flagcxResult_t flagcxReduceScatter(const void *sendbuff, void *recvbuff,
+                                   size_t recvcount, flagcxDataType_t datatype,
+                                   flagcxRedOp_t op, flagcxComm_t comm,
+                                   flagcxStream_t stream) {
+  return runReduceScatter(sendbuff, recvbuff, recvcount, datatype, op, comm,
+                          stream, FLAGCX_HETERO_ALGO_UNDEF);
+}
+
+static flagcxResult_t runAllGather(const void *sendbuff, void *recvbuff,
+                                   size_t sendcount, flagcxDataType_t datatype,
+                                   flagcxComm_t comm, flagcxStream_t stream,
+                                   int algo) {
   FLAGCXCHECK(flagcxEnsureCommReady(comm));
   if (is_homo_comm(comm)) {
     return cclAdaptors[flagcxCCLAdaptorDevice]->allGather(
         sendbuff, recvbuff, sendcount, datatype, comm->homo_comm, stream);
   } else {
-    if (use_host_comm()) {
+    if (c2cGroupRecord(comm, c2cGroupAllGather, sendbuff, recvbuff,
+                       sendcount, datatype, flagcxSum, 0, stream, algo)) {
+      return flagcxSuccess;
+    }
+    // plans resolve the algorithm once
+    if (algo == FLAGCX_HETERO_ALGO_UNDEF) {
+      algo = collAlgo(comm, flagcxCollAllGather, sendcount, datatype);
+    }
+    if (algo == FLAGCX_HETERO_ALGO_HOST) {
+      FLAGCXCHECK(hostCommInit(comm));
+      // queued to the worker of the host engine
+      if (flagcxHostEngineDefers(comm->host_engine)) {
+        return flagcxHostEngineEnqueue(
+            comm->host_engine,
+            [=](flagcxStream_t s) {
+              return runAllGather(sendbuff, recvbuff, sendcount, datatype, comm,
+                                  s, algo);
+            },
+            stream);
+      }
       uint64_t timers[TIMERS_COLL_COUNT] = {0};
       timers[TIMER_COLL_TOTAL] = clockNano();
       void *buff_in;
@@ -1440,34 +3032,36 @@ flagcxResult_t flagcxAllGather(const void *sendbuff, void *recvbuff,
       size_t size = sendcount * getFlagcxDataTypeSize(datatype);
       size_t totalSize = comm->nranks * size;
 
-      // step 1: malloc host buffer
+      // step 1: acquire host buffer
       timers[TIMER_COLL_ALLOC] = clockNano();
-      deviceAdaptor->deviceMalloc(&buff_in, size, flagcxMemHost, NULL);
-      deviceAdaptor->deviceMalloc(&buff_out, totalSize, flagcxMemHost, NULL);
+      FLAGCXCHECK(
+          flagcxHostBufferAcquire(comm->host_buffer_pool, size, &buff_in));
+      FLAGCXCHECK(flagcxHostBufferAcquire(comm->host_buffer_pool,
+                                          totalSize, &buff_out));
       timers[TIMER_COLL_ALLOC] = clockNano() - timers[TIMER_COLL_ALLOC];
 
       // step 2: memcpy d2h
       timers[TIMER_COLL_MEM_D2H] = clockNano();
-      deviceAdaptor->deviceMemcpy(buff_in, const_cast<void *>(sendbuff), size,
-                                  flagcxMemcpyDeviceToHost, NULL, NULL);
+      FLAGCXCHECK(hostCopy(buff_in, sendbuff, size, flagcxMemcpyDeviceToHost,
+                           stream));
       timers[TIMER_COLL_MEM_D2H] = clockNano() - timers[TIMER_COLL_MEM_D2H];
 
       // step 3: allgather
       timers[TIMER_COLL_COMM] = clockNano();
-      cclAdaptors[flagcxCCLAdaptorHost]->allGather(
-          buff_in, buff_out, sendcount, datatype, comm->host_comm, NULL);
+      FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorHost]->allGather(
+          buff_in, buff_out, sendcount, datatype, comm->host_comm, NULL));
       timers[TIMER_COLL_COMM] = clockNano() - timers[TIMER_COLL_COMM];
 
       // step 4: memcpy h2d
       timers[TIMER_COLL_MEM_H2D] = clockNano();
-      deviceAdaptor->deviceMemcpy(recvbuff, buff_out, totalSize,
-                                  flagcxMemcpyHostToDevice, NULL, NULL);
+      FLAGCXCHECK(hostCopy(recvbuff, buff_out, totalSize,
+                           flagcxMemcpyHostToDevice, stream));
       timers[TIMER_COLL_MEM_H2D] = clockNano() - timers[TIMER_COLL_MEM_H2D];
 
-      // step 5: free host buffer
+      // step 5: release host buffer
       timers[TIMER_COLL_FREE] = clockNano();
-      deviceAdaptor->deviceFree(buff_in, flagcxMemHost, NULL);
-      deviceAdaptor->deviceFree(buff_out, flagcxMemHost, NULL);
+      FLAGCXCHECK(flagcxHostBufferRelease(comm->host_buffer_pool, buff_in));
+      FLAGCXCHECK(flagcxHostBufferRelease(comm->host_buffer_pool, buff_out));
       timers[TIMER_COLL_FREE] = clockNano() - timers[TIMER_COLL_FREE];
 
       timers[TIMER_COLL_TOTAL] = clockNano() - timers[TIMER_COLL_TOTAL];
@@ -1481,12 +3075,10 @@ flagcxResult_t flagcxAllGather(const void *sendbuff, void *recvbuff,
            timers[TIMER_COLL_FREE] / 1e6, timers[TIMER_COLL_MEM_D2H] / 1e6,
            timers[TIMER_COLL_MEM_H2D] / 1e6, timers[TIMER_COLL_COMM] / 1e6);
     } else {
-      int offset = 0;
-      for (int i = 0; i < comm->cluster_ids[comm->rank]; ++i) {
-        offset += comm->cluster_sizes[i];
-      }
+      c2cCompressScope compress(comm->hetero_comm);
+      int offset = comm->cluster_offsets[comm->cluster_ids[comm->rank]];
 
-      if (comm->support_multi_nic < 0) {
+      if (algo == FLAGCX_HETERO_ALGO_SINGLE_NIC) {
         // intra-cluster gather
         if (comm->homo_ranks > 1) {
           FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->gather(
@@ -1500,8 +3092,15 @@ flagcxResult_t flagcxAllGather(const void *sendbuff, void *recvbuff,
         // TODO: use stream wait rather than stream sync to avoid cpu blocking
         deviceAdaptor->streamSynchronize(stream);
 
-        // inter-cluster sendrecv
+        // inter-cluster sendrecv, the cluster keeps what the others decode of
+        // its part
         if (comm->homo_inter_rank == comm->homo_rank) {
+          size_t clustercount =
+              sendcount * comm->cluster_sizes[comm->cluster_ids[comm->rank]];
+          FLAGCXCHECK(c2cCodecRoundTrip(
+              (void *)((char *)recvbuff +
+                       getFlagcxDataTypeSize(datatype) * offset * sendcount),
+              clustercount, clustercount, datatype, comm, stream));
           int offset_recv = 0;
           flagcxGroupStart(comm);
           for (int i = 0; i < comm->nclusters; ++i) {
@@ -1551,7 +3150,12 @@ flagcxResult_t flagcxAllGather(const void *sendbuff, void *recvbuff,
         // TODO: use stream wait rather than stream sync to avoid cpu blocking
         deviceAdaptor->streamSynchronize(stream);
 
-        // inter-cluster sendrecv
+        // inter-cluster sendrecv, the cluster keeps what the others decode of
+        // the part of every rank
+        FLAGCXCHECK(c2cCodecRoundTrip(
+            (void *)((char *)recvbuff +
+                     getFlagcxDataTypeSize(datatype) * offset * sendcount),
+            sendcount * comm->homo_ranks, sendcount, datatype, comm, stream));
         int offset_recv = 0;
         flagcxGroupStart(comm);
         for (int i = 0; i < comm->nclusters; ++i) {
@@ -1602,6 +3206,166 @@ flagcxResult_t flagcxAllGather(const void *sendbuff, void *recvbuff,
   return flagcxSuccess;
 }
 
+flagcxResult_t flagcxAllGather(const void *sendbuff, void *recvbuff,
+                               size_t sendcount, flagcxDataType_t datatype,
+                               flagcxComm_t comm, flagcxStream_t stream) {
+  return runAllGather(sendbuff, recvbuff, sendcount, datatype, comm, stream,
+                      FLAGCX_HETERO_ALGO_UNDEF);
+}
+
+FLAGCX_PARAM(C2cAlltoAllAggThreshold, "C2C_ALLTOALL_AGG_THRESHOLD", 1 << 20);
+
+// Inter-cluster part of the alltoall aggregated by the homo_inter_ranks, for
+// blocks of size bytes: every cluster gathers the blocks its ranks send to
+// each other cluster on its inter rank, which transposes them so that they
+// are grouped by destination rank and exchanges a single message with every
+// other inter rank, then scatters the blocks received to the local ranks.
+static flagcxResult_t c2cAlltoAllAggregated(const void *sendbuff,
+                                            void *recvbuff, size_t count,
+                                            flagcxDataType_t datatype,
+                                            flagcxComm_t comm,
+                                            flagcxStream_t stream) {
+  size_t size = count * getFlagcxDataTypeSize(datatype);
+  int me = comm->cluster_ids[comm->rank];
+  int nlocal = comm->homo_ranks;
+  bool is_inter = comm->homo_inter_rank == comm->homo_rank;
+  const char *buffer_in = static_cast<const char *>(sendbuff);
+  char *buffer_out = static_cast<char *>(recvbuff);
+
+  const int *offsets = comm->cluster_offsets;
+  // the blocks of the other clusters, nlocal per remote rank, are laid out by
+  // cluster in the staging buffers of the inter rank
+  size_t nremote = comm->nranks - nlocal;
+  char *gatherbuff = NULL;
+  char *packbuff = NULL;
+  char *unpackbuff = NULL;
+  if (nlocal > 1 && is_inter) {
+    // the previous calls synchronized their stream before returning, so the
+    // buffers are idle
+    size_t stagesize = nlocal * nremote * size;
+    if (comm->alltoall_buff_size < 3 * stagesize) {
+      if (comm->alltoall_buff != NULL) {
+        FLAGCXCHECK(deviceAdaptor->deviceFree(comm->alltoall_buff,
+                                              flagcxMemDevice, stream));
+        comm->alltoall_buff = NULL;
+        comm->alltoall_buff_size = 0;
+      }
+      FLAGCXCHECK(deviceAdaptor->deviceMalloc(
+          &comm->alltoall_buff, 3 * stagesize, flagcxMemDevice, stream));
+      comm->alltoall_buff_size = 3 * stagesize;
+    }
+    gatherbuff = static_cast<char *>(comm->alltoall_buff);
+    packbuff = gatherbuff + stagesize;
+    unpackbuff = packbuff + stagesize;
+  }
+
+  // intra-cluster gather of the blocks sent to every other cluster, as
+  // [local rank][remote rank]
+  std::vector<const char *> sendblocks(comm->nclusters, NULL);
+  size_t remote = 0;
+  for (int c = 0; c < comm->nclusters; ++c) {
+    if (c == me) {
+      continue;
+    }
+    int csize = comm->cluster_sizes[c];
+    if (nlocal > 1) {
+      if (is_inter) {
+        sendblocks[c] = gatherbuff + nlocal * remote * size;
+      }
+      FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->gather(
+          static_cast<const void *>(buffer_in + offsets[c] * size),
+          const_cast<char *>(sendblocks[c]), count * csize, datatype,
+          comm->homo_inter_rank, comm->homo_comm, stream));
+    } else {
+      sendblocks[c] = buffer_in + offsets[c] * size;
+    }
+    remote += csize;
+  }
+
+  if (is_inter) {
+    // transpose to [remote rank][local rank], nothing to do when either
+    // cluster has a single rank; one strided copy per row or per column of
+    // the blocks, whichever there are fewer of
+    remote = 0;
+    for (int c = 0; c < comm->nclusters; ++c) {
+      if (c == me) {
+        continue;
+      }
+      int csize = comm->cluster_sizes[c];
+      if (nlocal > 1 && csize > 1) {
+        char *pack = packbuff + nlocal * remote * size;
+        const char *blocks = sendblocks[c];
+        if (nlocal <= csize) {
+          for (int h = 0; h < nlocal; ++h) {
+            FLAGCXCHECK(deviceAdaptor->deviceMemcpy2D(
+                pack + h * size, nlocal * size, blocks + h * csize * size,
+                size, size, csize, flagcxMemcpyDeviceToDevice, stream));
+          }
+        } else {
+          for (int r = 0; r < csize; ++r) {
+            FLAGCXCHECK(deviceAdaptor->deviceMemcpy2D(
+                pack + r * nlocal * size, size, blocks + r * size,
+                csize * size, size, nlocal, flagcxMemcpyDeviceToDevice,
+                stream));
+          }
+        }
+        sendblocks[c] = pack;
+      }
+      remote += csize;
+    }
+
+    // TODO: use stream wait rather than stream sync to avoid cpu blocking
+    FLAGCXCHECK(deviceAdaptor->streamSynchronize(stream));
+
+    // inter-cluster sendrecv, one message per pair of clusters; what cluster
+    // c sends is grouped by local rank, nlocal > 1 receives it in the staging
+    // buffer as [local rank][rank of c]
+    flagcxGroupStart(comm);
+    remote = 0;
+    for (int c = 0; c < comm->nclusters; ++c) {
+      if (c == me) {
+        continue;
+      }
+      int csize = comm->cluster_sizes[c];
+      int peer = comm->cluster_inter_ranks[c];
+      FLAGCXCHECK(flagcxHeteroSend(static_cast<const void *>(sendblocks[c]),
+                                   count * nlocal * csize, datatype, peer,
+                                   comm->hetero_comm, stream));
+      void *recvblocks = nlocal > 1
+                             ? static_cast<void *>(unpackbuff +
+                                                   nlocal * remote * size)
+                             : static_cast<void *>(buffer_out +
+                                                   offsets[c] * size);
+      FLAGCXCHECK(flagcxHeteroRecv(recvblocks, count * nlocal * csize,
+                                   datatype, peer, comm->hetero_comm, stream));
+      remote += csize;
+    }
+    flagcxGroupEnd(comm);
+  }
+
+  // intra-cluster scatter of the blocks received from every other cluster
+  if (nlocal > 1) {
+    remote = 0;
+    for (int c = 0; c < comm->nclusters; ++c) {
+      if (c == me) {
+        continue;
+      }
+      int csize = comm->cluster_sizes[c];
+      FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->scatter(
+          is_inter ? static_cast<const void *>(unpackbuff +
+                                               nlocal * remote * size)
+                   : NULL,
+          static_cast<void *>(buffer_out + offsets[c] * size), count * csize,
+          datatype, comm->homo_inter_rank, comm->homo_comm, stream));
+      remote += csize;
+    }
+  }
+
+  // TODO: use stream wait rather than stream sync to avoid cpu blocking
+  FLAGCXCHECK(deviceAdaptor->streamSynchronize(stream));
+  return flagcxSuccess;
+}
+
 flagcxResult_t flagcxAlltoAll(const void *sendbuff, void *recvbuff,
                               size_t count, flagcxDataType_t datatype,
                               flagcxComm_t comm, flagcxStream_t stream) {
@@ -1610,41 +3374,57 @@ flagcxResult_t flagcxAlltoAll(const void *sendbuff, void *recvbuff,
     return cclAdaptors[flagcxCCLAdaptorDevice]->alltoAll(
         sendbuff, recvbuff, count, datatype, comm->homo_comm, stream);
   } else {
+    if (c2cGroupRecord(comm, c2cGroupAlltoAll, sendbuff, recvbuff, count,
+                       datatype, flagcxSum, 0, stream)) {
+      return flagcxSuccess;
+    }
     if (use_host_comm()) {
+      // queued to the worker of the host engine
+      if (flagcxHostEngineDefers(comm->host_engine)) {
+        return flagcxHostEngineEnqueue(
+            comm->host_engine,
+            [=](flagcxStream_t s) {
+              return flagcxAlltoAll(sendbuff, recvbuff, count, datatype, comm,
+                                    s);
+            },
+            stream);
+      }
       uint64_t timers[TIMERS_COLL_COUNT] = {0};
       timers[TIMER_COLL_TOTAL] = clockNano();
       void *buff_in;
       void *buff_out;
       size_t size = comm->nranks * count * getFlagcxDataTypeSize(datatype);
 
-      // step 1: malloc host buffer
+      // step 1: acquire host buffer
       timers[TIMER_COLL_ALLOC] = clockNano();
-      deviceAdaptor->deviceMalloc(&buff_in, size, flagcxMemHost, NULL);
-      deviceAdaptor->deviceMalloc(&buff_out, size, flagcxMemHost, NULL);
+      FLAGCXCHECK(
+          flagcxHostBufferAcquire(comm->host_buffer_pool, size, &buff_in));
+      FLAGCXCHECK(
+          flagcxHostBufferAcquire(comm->host_buffer_pool, size, &buff_out));
       timers[TIMER_COLL_ALLOC] = clockNano() - timers[TIMER_COLL_ALLOC];
 
       // step 2: memcpy d2h
       timers[TIMER_COLL_MEM_D2H] = clockNano();
-      deviceAdaptor->deviceMemcpy(buff_in, const_cast<void *>(sendbuff), size,
-                                  flagcxMemcpyDeviceToHost, NULL, NULL);
+      FLAGCXCHECK(hostCopy(buff_in, sendbuff, size, flagcxMemcpyDeviceToHost,
+                           stream));
       timers[TIMER_COLL_MEM_D2H] = clockNano() - timers[TIMER_COLL_MEM_D2H];
 
       // step 3: alltoall
       timers[TIMER_COLL_COMM] = clockNano();
-      cclAdaptors[flagcxCCLAdaptorHost]->alltoAll(
-          buff_in, buff_out, count, datatype, comm->host_comm, NULL);
+      FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorHost]->alltoAll(
+          buff_in, buff_out, count, datatype, comm->host_comm, NULL));
       timers[TIMER_COLL_COMM] = clockNano() - timers[TIMER_COLL_COMM];
 
       // step 4: memcpy h2d
       timers[TIMER_COLL_MEM_H2D] = clockNano();
-      deviceAdaptor->deviceMemcpy(recvbuff, buff_out, size,
-                                  flagcxMemcpyHostToDevice, NULL, NULL);
+      FLAGCXCHECK(hostCopy(recvbuff, buff_out, size, flagcxMemcpyHostToDevice,
+                           stream));
       timers[TIMER_COLL_MEM_H2D] = clockNano() - timers[TIMER_COLL_MEM_H2D];
 
-      // step 5: free host buffer
+      // step 5: release host buffer
       timers[TIMER_COLL_FREE] = clockNano();
-      deviceAdaptor->deviceFree(buff_in, flagcxMemHost, NULL);
-      deviceAdaptor->deviceFree(buff_out, flagcxMemHost, NULL);
+      FLAGCXCHECK(flagcxHostBufferRelease(comm->host_buffer_pool, buff_in));
+      FLAGCXCHECK(flagcxHostBufferRelease(comm->host_buffer_pool, buff_out));
       timers[TIMER_COLL_FREE] = clockNano() - timers[TIMER_COLL_FREE];
 
       timers[TIMER_COLL_TOTAL] = clockNano() - timers[TIMER_COLL_TOTAL];
@@ -1658,15 +3438,12 @@ flagcxResult_t flagcxAlltoAll(const void *sendbuff, void *recvbuff,
            timers[TIMER_COLL_FREE] / 1e6, timers[TIMER_COLL_MEM_D2H] / 1e6,
            timers[TIMER_COLL_MEM_H2D] / 1e6, timers[TIMER_COLL_COMM] / 1e6);
     } else {
-      int size = count * getFlagcxDataTypeSize(datatype);
+      size_t size = count * getFlagcxDataTypeSize(datatype);
       const char *buffer_in = static_cast<const char *>(sendbuff);
       char *buffer_out = static_cast<char *>(recvbuff);
 
       // intra-cluster alltoall
-      int offset = 0;
-      for (int i = 0; i < comm->cluster_ids[comm->rank]; ++i) {
-        offset += comm->cluster_sizes[i];
-      }
+      int offset = comm->cluster_offsets[comm->cluster_ids[comm->rank]];
       if (comm->homo_ranks > 1) {
         FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->alltoAll(
             static_cast<const void *>(buffer_in + offset * size),
@@ -1674,11 +3451,18 @@ flagcxResult_t flagcxAlltoAll(const void *sendbuff, void *recvbuff,
             comm->homo_comm, stream))
       }
 
+      // small blocks are aggregated by the inter ranks, one message per pair
+      // of clusters instead of one per pair of ranks
+      if (size < (size_t)flagcxParamC2cAlltoAllAggThreshold()) {
+        FLAGCXCHECK(c2cAlltoAllAggregated(sendbuff, recvbuff, count, datatype,
+                                          comm, stream));
+        return flagcxSuccess;
+      }
+
       // TODO: use stream wait rather than stream sync to avoid cpu blocking
       deviceAdaptor->streamSynchronize(stream);
 
-      // inter-cluster sendrecv
-      // TODO: use cluster_inter_rank to perform hetero sendrecv operation
+      // inter-cluster sendrecv between every pair of ranks
       flagcxGroupStart(comm);
       for (int r = 0; r < comm->nranks; ++r) {
         if (comm->cluster_ids[comm->rank] != comm->cluster_ids[r]) {
@@ -1711,18 +3495,119 @@ flagcxResult_t flagcxAlltoAllv(const void *sendbuff, size_t *sendcounts,
         sendbuff, sendcounts, sdispls, recvbuff, recvcounts, rdispls, datatype,
         comm->homo_comm, stream);
   } else {
+    if (c2cGroupRecord(comm, c2cGroupAlltoAllv, sendbuff, recvbuff, 0,
+                       datatype, flagcxSum, 0, stream)) {
+      // the counts and displacements are only read when the group ends
+      std::vector<size_t> &counts = comm->c2c_group->ops.back().counts;
+      counts.insert(counts.end(), sendcounts, sendcounts + comm->nranks);
+      counts.insert(counts.end(), sdispls, sdispls + comm->nranks);
+      counts.insert(counts.end(), recvcounts, recvcounts + comm->nranks);
+      counts.insert(counts.end(), rdispls, rdispls + comm->nranks);
+      return flagcxSuccess;
+    }
     if (use_host_comm()) {
-      // TODO: to be implemented
-      return flagcxNotSupported;
+      int nranks = comm->nranks;
+      // queued to the worker of the host engine, with a copy of the counts
+      // and displacements
+      if (flagcxHostEngineDefers(comm->host_engine)) {
+        std::vector<size_t> counts(sendcounts, sendcounts + nranks);
+        counts.insert(counts.end(), sdispls, sdispls + nranks);
+        counts.insert(counts.end(), recvcounts, recvcounts + nranks);
+        counts.insert(counts.end(), rdispls, rdispls + nranks);
+        return flagcxHostEngineEnqueue(
+            comm->host_engine,
+            [=](flagcxStream_t s) mutable {
+              size_t *c = counts.data();
+              return flagcxAlltoAllv(sendbuff, c, c + nranks, recvbuff,
+                                     c + 2 * nranks, c + 3 * nranks, datatype,
+                                     comm, s);
+            },
+            stream);
+      }
+      uint64_t timers[TIMERS_COLL_COUNT] = {0};
+      timers[TIMER_COLL_TOTAL] = clockNano();
+      size_t typesize = getFlagcxDataTypeSize(datatype);
+      char *buff_in;
+      char *buff_out;
+
+      // the host buffers hold the extents of the peers back to back, only
+      // the elements exchanged are staged
+      std::vector<size_t> host_sdispls(nranks), host_rdispls(nranks);
+      size_t sendtotal = 0, recvtotal = 0;
+      for (int r = 0; r < nranks; ++r) {
+        host_sdispls[r] = sendtotal;
+        host_rdispls[r] = recvtotal;
+        sendtotal += sendcounts[r];
+        recvtotal += recvcounts[r];
+      }
+
+      // step 1: acquire host buffer
+      timers[TIMER_COLL_ALLOC] = clockNano();
+      FLAGCXCHECK(flagcxHostBufferAcquire(comm->host_buffer_pool,
+                                          sendtotal * typesize,
+                                          (void **)&buff_in));
+      FLAGCXCHECK(flagcxHostBufferAcquire(comm->host_buffer_pool,
+                                          recvtotal * typesize,
+                                          (void **)&buff_out));
+      timers[TIMER_COLL_ALLOC] = clockNano() - timers[TIMER_COLL_ALLOC];
+
+      // step 2: memcpy d2h of the send extents
+      timers[TIMER_COLL_MEM_D2H] = clockNano();
+      for (int r = 0; r < nranks; ++r) {
+        if (sendcounts[r] == 0)
+          continue;
+        FLAGCXCHECK(deviceAdaptor->deviceMemcpy(
+            buff_in + host_sdispls[r] * typesize,
+            const_cast<char *>(static_cast<const char *>(sendbuff)) +
+                sdispls[r] * typesize,
+            sendcounts[r] * typesize, flagcxMemcpyDeviceToHost, stream,
+            NULL));
+      }
+      FLAGCXCHECK(deviceAdaptor->streamSynchronize(stream));
+      timers[TIMER_COLL_MEM_D2H] = clockNano() - timers[TIMER_COLL_MEM_D2H];
+
+      // step 3: alltoallv, peers without data are skipped
+      timers[TIMER_COLL_COMM] = clockNano();
+      FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorHost]->alltoAllv(
+          buff_in, sendcounts, host_sdispls.data(), buff_out, recvcounts,
+          host_rdispls.data(), datatype, comm->host_comm, NULL));
+      timers[TIMER_COLL_COMM] = clockNano() - timers[TIMER_COLL_COMM];
+
+      // step 4: memcpy h2d of the receive extents
+      timers[TIMER_COLL_MEM_H2D] = clockNano();
+      for (int r = 0; r < nranks; ++r) {
+        if (recvcounts[r] == 0)
+          continue;
+        FLAGCXCHECK(deviceAdaptor->deviceMemcpy(
+            static_cast<char *>(recvbuff) + rdispls[r] * typesize,
+            buff_out + host_rdispls[r] * typesize, recvcounts[r] * typesize,
+            flagcxMemcpyHostToDevice, stream, NULL));
+      }
+      FLAGCXCHECK(deviceAdaptor->streamSynchronize(stream));
+      timers[TIMER_COLL_MEM_H2D] = clockNano() - timers[TIMER_COLL_MEM_H2D];
+
+      // step 5: release host buffer
+      timers[TIMER_COLL_FREE] = clockNano();
+      FLAGCXCHECK(flagcxHostBufferRelease(comm->host_buffer_pool, buff_in));
+      FLAGCXCHECK(flagcxHostBufferRelease(comm->host_buffer_pool, buff_out));
+      timers[TIMER_COLL_FREE] = clockNano() - timers[TIMER_COLL_FREE];
+
+      timers[TIMER_COLL_TOTAL] = clockNano() - timers[TIMER_COLL_TOTAL];
+      INFO(FLAGCX_COLL,
+           "Flagcx timings - %s AlltoAllv: rank %d nranks %d total %.2fms "
+           "(memory alloc "
+           "%.2fms, memory free %.2fms, memory d2h %.2fms, memory h2d %.2fms, "
+           "comm %.2fms)",
+           cclAdaptors[flagcxCCLAdaptorHost]->name, comm->rank, comm->nranks,
+           timers[TIMER_COLL_TOTAL] / 1e6, timers[TIMER_COLL_ALLOC] / 1e6,
+           timers[TIMER_COLL_FREE] / 1e6, timers[TIMER_COLL_MEM_D2H] / 1e6,
+           timers[TIMER_COLL_MEM_H2D] / 1e6, timers[TIMER_COLL_COMM] / 1e6);
     } else {
       int size = getFlagcxDataTypeSize(datatype);
       const char *buffer_in = static_cast<const char *>(sendbuff);
       char *buffer_out = static_cast<char *>(recvbuff);
 
-      int offset = 0;
-      for (int i = 0; i < comm->cluster_ids[comm->rank]; ++i) {
-        offset += comm->cluster_sizes[i];
-      }
+      int offset = comm->cluster_offsets[comm->cluster_ids[comm->rank]];
 
       // intra/inter-cluster sendrecv
       flagcxGroupStart(comm);
@@ -1770,40 +3655,53 @@ flagcxResult_t flagcxSend(const void *sendbuff, size_t count,
         sendbuff, count, datatype, peer, comm->homo_comm, stream);
   } else {
     if (use_host_comm()) {
+      // queued to the worker of the host engine
+      if (flagcxHostEngineDefers(comm->host_engine)) {
+        return flagcxHostEngineEnqueue(
+            comm->host_engine,
+            [=](flagcxStream_t s) {
+              return flagcxSend(sendbuff, count, datatype, peer, comm, s);
+            },
+            stream);
+      }
       uint64_t timers[TIMERS_COLL_COUNT] = {0};
       timers[TIMER_COLL_TOTAL] = clockNano();
       void *buff_in;
       size_t size = count * getFlagcxDataTypeSize(datatype);
 
-      // step 1: malloc host buffer
+      // step 1: acquire host buffer
       timers[TIMER_COLL_ALLOC] = clockNano();
-      deviceAdaptor->deviceMalloc(&buff_in, size, flagcxMemHost, NULL);
+      FLAGCXCHECK(
+          flagcxHostBufferAcquire(comm->host_buffer_pool, size, &buff_in));
       timers[TIMER_COLL_ALLOC] = clockNano() - timers[TIMER_COLL_ALLOC];
 
       // step 2: memcpy d2h
       timers[TIMER_COLL_MEM_D2H] = clockNano();
-      deviceAdaptor->deviceMemcpy(buff_in, const_cast<void *>(sendbuff), size,
-                                  flagcxMemcpyDeviceToHost, NULL, NULL);
+      FLAGCXCHECK(hostCopy(buff_in, sendbuff, size, flagcxMemcpyDeviceToHost,
+                           stream));
       timers[TIMER_COLL_MEM_D2H] = clockNano() - timers[TIMER_COLL_MEM_D2H];
 
       // step 3: send
       timers[TIMER_COLL_COMM] = clockNano();
-      cclAdaptors[flagcxCCLAdaptorHost]->send(buff_in, count, datatype, peer,
-                                              comm->host_comm, NULL);
+      FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorHost]->send(
+          buff_in, count, datatype, peer, comm->host_comm, NULL));
       timers[TIMER_COLL_COMM] = clockNano() - timers[TIMER_COLL_COMM];
 
-      // buff_in will be freed in gloo adaptor send function?
-      // TODO: check if buff_in should be freed here
-      // deviceAdaptor->deviceFree(buff_in, flagcxMemHost, NULL);
+      // step 4: release host buffer, deferred to the end of the group if the
+      // send was posted inside one
+      timers[TIMER_COLL_FREE] = clockNano();
+      FLAGCXCHECK(flagcxHostBufferRelease(comm->host_buffer_pool, buff_in));
+      timers[TIMER_COLL_FREE] = clockNano() - timers[TIMER_COLL_FREE];
 
       timers[TIMER_COLL_TOTAL] = clockNano() - timers[TIMER_COLL_TOTAL];
       INFO(FLAGCX_COLL,
            "Flagcx timings - %s Send: rank %d nranks %d total %.2fms (memory "
            "alloc "
-           "%.2fms, memory d2h %.2fms, comm %.2fms)",
+           "%.2fms, memory free %.2fms, memory d2h %.2fms, comm %.2fms)",
            cclAdaptors[flagcxCCLAdaptorHost]->name, comm->rank, comm->nranks,
            timers[TIMER_COLL_TOTAL] / 1e6, timers[TIMER_COLL_ALLOC] / 1e6,
-           timers[TIMER_COLL_MEM_D2H] / 1e6, timers[TIMER_COLL_COMM] / 1e6);
+           timers[TIMER_COLL_FREE] / 1e6, timers[TIMER_COLL_MEM_D2H] / 1e6,
+           timers[TIMER_COLL_COMM] / 1e6);
     } else {
       // TODO: use stream wait rather than stream sync to avoid cpu blocking
       deviceAdaptor->streamSynchronize(stream);
@@ -1824,31 +3722,41 @@ flagcxResult_t flagcxRecv(void *recvbuff, size_t count,
         recvbuff, count, datatype, peer, comm->homo_comm, stream);
   } else {
     if (use_host_comm()) {
+      // queued to the worker of the host engine
+      if (flagcxHostEngineDefers(comm->host_engine)) {
+        return flagcxHostEngineEnqueue(
+            comm->host_engine,
+            [=](flagcxStream_t s) {
+              return flagcxRecv(recvbuff, count, datatype, peer, comm, s);
+            },
+            stream);
+      }
       uint64_t timers[TIMERS_COLL_COUNT] = {0};
       timers[TIMER_COLL_TOTAL] = clockNano();
       void *buff_out;
       size_t size = count * getFlagcxDataTypeSize(datatype);
 
-      // step 1: malloc host buffer
+      // step 1: acquire host buffer
       timers[TIMER_COLL_ALLOC] = clockNano();
-      deviceAdaptor->deviceMalloc(&buff_out, size, flagcxMemHost, NULL);
+      FLAGCXCHECK(
+          flagcxHostBufferAcquire(comm->host_buffer_pool, size, &buff_out));
       timers[TIMER_COLL_ALLOC] = clockNano() - timers[TIMER_COLL_ALLOC];
 
       // step 2: recv
       timers[TIMER_COLL_COMM] = clockNano();
-      cclAdaptors[flagcxCCLAdaptorHost]->recv(buff_out, count, datatype, peer,
-                                              comm->host_comm, NULL);
+      FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorHost]->recv(
+          buff_out, count, datatype, peer, comm->host_comm, NULL));
       timers[TIMER_COLL_COMM] = clockNano() - timers[TIMER_COLL_COMM];
 
       // step 3: memcpy h2d
       timers[TIMER_COLL_MEM_H2D] = clockNano();
-      deviceAdaptor->deviceMemcpy(recvbuff, buff_out, size,
-                                  flagcxMemcpyHostToDevice, NULL, NULL);
+      FLAGCXCHECK(hostCopy(recvbuff, buff_out, size, flagcxMemcpyHostToDevice,
+                           stream));
       timers[TIMER_COLL_MEM_H2D] = clockNano() - timers[TIMER_COLL_MEM_H2D];
 
-      // step 4: free host buffer
+      // step 4: release host buffer
       timers[TIMER_COLL_FREE] = clockNano();
-      deviceAdaptor->deviceFree(buff_out, flagcxMemHost, NULL);
+      FLAGCXCHECK(flagcxHostBufferRelease(comm->host_buffer_pool, buff_out));
       timers[TIMER_COLL_FREE] = clockNano() - timers[TIMER_COLL_FREE];
 
       timers[TIMER_COLL_TOTAL] = clockNano() - timers[TIMER_COLL_TOTAL];
@@ -1871,15 +3779,330 @@ flagcxResult_t flagcxRecv(void *recvbuff, size_t count,
   return flagcxSuccess;
 }
 
+// Allreduces of a group that go through the inter ranks with a direct
+// exchange between them can share every phase.
+static bool c2cGroupMergeable(flagcxComm_t comm, const struct c2cGroupOp &op) {
+  // the merged allreduces go through the inter ranks, not striped over the
+  // gateways of the clusters
+  return op.coll == c2cGroupAllReduce && op.count > 0 &&
+         comm->ngateways == 1 &&
+         (op.op == flagcxSum || op.op == flagcxMax || op.op == flagcxMin) &&
+         (op.algo != FLAGCX_HETERO_ALGO_UNDEF
+              ? op.algo
+              : collAlgo(comm, flagcxCollAllReduce, op.count, op.datatype)) ==
+             FLAGCX_HETERO_ALGO_SINGLE_NIC &&
+         c2cInterAlgo(comm->nclusters,
+                      op.count * getFlagcxDataTypeSize(op.datatype)) ==
+             C2C_INTER_DIRECT;
+}
+
+// Runs the allreduces in ops phase by phase: one grouped intra-cluster
+// reduce, one launch of the sends and receives of all of them between the
+// inter ranks, then one grouped intra-cluster broadcast.
+static flagcxResult_t
+c2cGroupMergedAllReduce(flagcxComm_t comm,
+                        std::vector<struct c2cGroupOp *> &ops) {
+  int npeers = comm->nclusters - 1;
+  bool is_inter = comm->homo_inter_rank == comm->homo_rank;
+
+  // intra-cluster reduce
+  FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->groupStart());
+  for (struct c2cGroupOp *op : ops) {
+    FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->reduce(
+        op->sendbuff, op->recvbuff, op->count, op->datatype, op->op,
+        comm->homo_inter_rank, comm->homo_comm, op->stream));
+  }
+  FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->groupEnd());
+
+  // cross-cluster allreduce between the inter ranks, as in the direct
+  // c2cInterAllReduce: the operands are combined in cluster order with what
+  // the peers decode of the own one, so all clusters get the same bits
+  if (is_inter) {
+    c2cCompressScope compress(comm->hetero_comm);
+    std::vector<void *> peerbuffs(ops.size());
+    for (size_t i = 0; i < ops.size(); ++i) {
+      deviceAdaptor->deviceMalloc(
+          &peerbuffs[i],
+          npeers * ops[i]->count * getFlagcxDataTypeSize(ops[i]->datatype),
+          flagcxMemDevice, ops[i]->stream);
+    }
+    // TODO: use stream wait rather than stream sync to avoid cpu blocking
+    for (struct c2cGroupOp *op : ops) {
+      deviceAdaptor->streamSynchronize(op->stream);
+    }
+
+    flagcxGroupStart(comm);
+    for (size_t i = 0; i < ops.size(); ++i) {
+      struct c2cGroupOp *op = ops[i];
+      size_t size = op->count * getFlagcxDataTypeSize(op->datatype);
+      int cid = 0;
+      for (int c = 0; c < comm->nclusters; ++c) {
+        if (c == comm->cluster_ids[comm->rank])
+          continue;
+        FLAGCXCHECK(flagcxHeteroRecv(
+            static_cast<void *>(static_cast<char *>(peerbuffs[i]) +
+                                cid * size),
+            op->count, op->datatype, comm->cluster_inter_ranks[c],
+            comm->hetero_comm, op->stream));
+        FLAGCXCHECK(flagcxHeteroSend(op->recvbuff, op->count, op->datatype,
+                                     comm->cluster_inter_ranks[c],
+                                     comm->hetero_comm, op->stream));
+        cid += 1;
+      }
+    }
+    flagcxGroupEnd(comm);
+
+    // TODO: use stream wait rather than stream sync to avoid cpu blocking
+    for (struct c2cGroupOp *op : ops) {
+      deviceAdaptor->streamSynchronize(op->stream);
+    }
+
+    for (size_t i = 0; i < ops.size(); ++i) {
+      FLAGCXCHECK(c2cReducePeers(ops[i]->recvbuff, peerbuffs[i], npeers,
+                                 ops[i]->count, ops[i]->datatype, ops[i]->op,
+                                 comm, ops[i]->stream,
+                                 comm->cluster_ids[comm->rank], true));
+      deviceAdaptor->deviceFree(peerbuffs[i], flagcxMemDevice, ops[i]->stream);
+    }
+  }
+
+  // intra-cluster broadcast
+  FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->groupStart());
+  for (struct c2cGroupOp *op : ops) {
+    FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->broadcast(
+        op->recvbuff, op->recvbuff, op->count, op->datatype,
+        comm->homo_inter_rank, comm->homo_comm, op->stream));
+  }
+  FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->groupEnd());
+  return flagcxSuccess;
+}
+
+static flagcxResult_t c2cGroupRun(flagcxComm_t comm, struct c2cGroupOp &op) {
+  switch (op.coll) {
+  case c2cGroupBroadcast:
+    return runBroadcast(op.sendbuff, op.recvbuff, op.count, op.datatype,
+                        op.root, comm, op.stream, op.algo);
+  case c2cGroupReduce:
+    return runReduce(op.sendbuff, op.recvbuff, op.count, op.datatype, op.op,
+                     op.root, comm, op.stream, op.algo);
+  case c2cGroupGather:
+    return flagcxGather(op.sendbuff, op.recvbuff, op.count, op.datatype,
+                        op.root, comm, op.stream);
+  case c2cGroupScatter:
+    return flagcxScatter(op.sendbuff, op.recvbuff, op.count, op.datatype,
+                         op.root, comm, op.stream);
+  case c2cGroupAllReduce:
+    return runAllReduce(op.sendbuff, op.recvbuff, op.count, op.datatype, op.op,
+                        comm, op.stream, op.algo);
+  case c2cGroupAllGather:
+    return runAllGather(op.sendbuff, op.recvbuff, op.count, op.datatype, comm,
+                        op.stream, op.algo);
+  case c2cGroupReduceScatter:
+    return runReduceScatter(op.sendbuff, op.recvbuff, op.count, op.datatype,
+                            op.op, comm, op.stream, op.algo);
+  case c2cGroupAlltoAll:
+    return flagcxAlltoAll(op.sendbuff, op.recvbuff, op.count, op.datatype,
+                          comm, op.stream);
+  case c2cGroupAlltoAllv: {
+    size_t n = comm->nranks;
+    return flagcxAlltoAllv(op.sendbuff, op.counts.data(),
+                           op.counts.data() + n, op.recvbuff,
+                           op.counts.data() + 2 * n, op.counts.data() + 3 * n,
+                           op.datatype, comm, op.stream);
+  }
+  }
+  return flagcxInternalError;
+}
+
+// Runs the collectives recorded in the group that just ended. Every rank
+// records the same ones and picks the same algorithms, so the mergeable
+// allreduces are run together first and the others in the order issued.
+static flagcxResult_t c2cGroupFlush(flagcxComm_t comm) {
+  if (comm->c2c_group->ops.empty())
+    return flagcxSuccess;
+  std::vector<struct c2cGroupOp> ops;
+  ops.swap(comm->c2c_group->ops);
+
+  std::vector<struct c2cGroupOp *> merged;
+  for (struct c2cGroupOp &op : ops) {
+    if (c2cGroupMergeable(comm, op)) {
+      merged.push_back(&op);
+    }
+  }
+  if (merged.size() > 1) {
+    FLAGCXCHECK(c2cGroupMergedAllReduce(comm, merged));
+    for (struct c2cGroupOp *op : merged) {
+      op->done = true;
+    }
+  }
+  for (struct c2cGroupOp &op : ops) {
+    if (!op.done) {
+      FLAGCXCHECK(c2cGroupRun(comm, op));
+    }
+  }
+  return flagcxSuccess;
+}
+
+struct flagcxPlan {
+  flagcxCollType_t coll;
+  size_t count;
+  flagcxDataType_t datatype;
+  flagcxRedOp_t op;
+  int root;
+  flagcxComm_t comm;
+  // algorithm of the heterogeneous collective, resolved at creation
+  int algo;
+};
+
+static flagcxResult_t planRun(flagcxPlan_t plan, const void *sendbuff,
+                              void *recvbuff, flagcxStream_t stream) {
+  flagcxComm_t comm = plan->comm;
+  switch (plan->coll) {
+  case flagcxCollBroadcast:
+    return runBroadcast(sendbuff, recvbuff, plan->count, plan->datatype,
+                        plan->root, comm, stream, plan->algo);
+  case flagcxCollReduce:
+    return runReduce(sendbuff, recvbuff, plan->count, plan->datatype, plan->op,
+                     plan->root, comm, stream, plan->algo);
+  case flagcxCollAllGather:
+    return runAllGather(sendbuff, recvbuff, plan->count, plan->datatype, comm,
+                        stream, plan->algo);
+  case flagcxCollReduceScatter:
+    return runReduceScatter(sendbuff, recvbuff, plan->count, plan->datatype,
+                            plan->op, comm, stream, plan->algo);
+  case flagcxCollAllReduce:
+    return runAllReduce(sendbuff, recvbuff, plan->count, plan->datatype,
+                        plan->op, comm, stream, plan->algo);
+  case flagcxCollAlltoAll:
+    return flagcxAlltoAll(sendbuff, recvbuff, plan->count, plan->datatype,
+                          comm, stream);
+  case flagcxCollGather:
+    return flagcxGather(sendbuff, recvbuff, plan->count, plan->datatype,
+                        plan->root, comm, stream);
+  case flagcxCollScatter:
+    return flagcxScatter(sendbuff, recvbuff, plan->count, plan->datatype,
+                         plan->root, comm, stream);
+  default:
+    return flagcxInvalidArgument;
+  }
+}
+
+flagcxResult_t flagcxPlanCreate(flagcxPlan_t *plan, flagcxCollType_t coll,
+                                size_t count, flagcxDataType_t datatype,
+                                flagcxRedOp_t op, int root, flagcxComm_t comm,
+                                flagcxStream_t stream) {
+  FLAGCXCHECK(flagcxEnsureCommReady(comm));
+  if (plan == NULL || coll < 0 || coll >= flagcxNumColls) {
+    WARN("Invalid plan arguments");
+    return flagcxInvalidArgument;
+  }
+  // the warm-up would only be recorded, and run after its scratch buffers
+  // are freed
+  if (comm->c2c_group != NULL && comm->c2c_group->depth > 0) {
+    WARN("flagcxPlanCreate cannot be called inside a group");
+    return flagcxInvalidUsage;
+  }
+  flagcxPlan_t p = new flagcxPlan();
+  p->coll = coll;
+  p->count = count;
+  p->datatype = datatype;
+  p->op = op;
+  p->root = root;
+  p->comm = comm;
+  p->algo = FLAGCX_HETERO_ALGO_UNDEF;
+  if (!is_homo_comm(comm)) {
+    p->algo = collAlgo(comm, coll, count, datatype);
+  }
+
+  // warm-up on scratch buffers, which connects the peers of the collective
+  size_t size = count * getFlagcxDataTypeSize(datatype);
+  size_t sendsize = size;
+  size_t recvsize = size;
+  if (coll == flagcxCollAllGather || coll == flagcxCollAlltoAll ||
+      coll == flagcxCollGather) {
+    recvsize *= comm->nranks;
+  }
+  if (coll == flagcxCollReduceScatter || coll == flagcxCollAlltoAll ||
+      coll == flagcxCollScatter) {
+    sendsize *= comm->nranks;
+  }
+  void *sendbuff = NULL;
+  void *recvbuff = NULL;
+  flagcxResult_t res = flagcxSuccess;
+  if (sendsize > 0) {
+    res = deviceAdaptor->deviceMalloc(&sendbuff, sendsize, flagcxMemDevice,
+                                      stream);
+    if (res == flagcxSuccess) {
+      res = deviceAdaptor->deviceMalloc(&recvbuff, recvsize, flagcxMemDevice,
+                                        stream);
+    }
+    if (res == flagcxSuccess) {
+      res = deviceAdaptor->deviceMemset(sendbuff, 0, sendsize, flagcxMemDevice,
+                                        stream);
+    }
+  }
+  if (res == flagcxSuccess) {
+    res = planRun(p, sendbuff, recvbuff, stream);
+  }
+  // the scratch buffers are freed whatever failed, once the stream is idle
+  flagcxResult_t syncRes = deviceAdaptor->streamSynchronize(stream);
+  if (res == flagcxSuccess) {
+    res = syncRes;
+  }
+  if (sendbuff != NULL) {
+    flagcxResult_t freeRes =
+        deviceAdaptor->deviceFree(sendbuff, flagcxMemDevice, stream);
+    if (res == flagcxSuccess) {
+      res = freeRes;
+    }
+  }
+  if (recvbuff != NULL) {
+    flagcxResult_t freeRes =
+        deviceAdaptor->deviceFree(recvbuff, flagcxMemDevice, stream);
+    if (res == flagcxSuccess) {
+      res = freeRes;
+    }
+  }
+  if (res != flagcxSuccess) {
+    delete p;
+    return res;
+  }
+  INFO(FLAGCX_COLL, "Plan: coll %d count %zu datatype %d algo %d", coll, count,
+       datatype, p->algo);
+  *plan = p;
+  return flagcxSuccess;
+}
+
+flagcxResult_t flagcxPlanLaunch(flagcxPlan_t plan, const void *sendbuff,
+                                void *recvbuff, flagcxStream_t stream) {
+  if (plan == NULL) {
+    WARN("Invalid plan");
+    return flagcxInvalidArgument;
+  }
+  return planRun(plan, sendbuff, recvbuff, stream);
+}
+
+flagcxResult_t flagcxPlanDestroy(flagcxPlan_t plan) {
+  delete plan;
+  return flagcxSuccess;
+}
+
 flagcxResult_t flagcxGroupStart(flagcxComm_t comm) {
   FLAGCXCHECK(flagcxEnsureCommReady(comm));
   if (is_homo_comm(comm)) {
     return cclAdaptors[flagcxCCLAdaptorDevice]->groupStart();
   } else {
     if (use_host_comm()) {
-      cclAdaptors[flagcxCCLAdaptorHost]->groupStart();
+      if (flagcxHostEngineDefers(comm->host_engine)) {
+        return flagcxHostEngineEnqueue(
+            comm->host_engine,
+            [comm](flagcxStream_t) { return flagcxGroupStart(comm); }, NULL);
+      }
+      FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorHost]->groupStart());
+      FLAGCXCHECK(flagcxHostBufferPoolGroupStart(comm->host_buffer_pool));
     } else {
       FLAGCXCHECK(flagcxHeteroGroupStart());
+      comm->c2c_group->depth++;
     }
   }
   return flagcxSuccess;
@@ -1891,10 +4114,19 @@ flagcxResult_t flagcxGroupEnd(flagcxComm_t comm) {
     return cclAdaptors[flagcxCCLAdaptorDevice]->groupEnd();
   } else {
     if (use_host_comm()) {
-      cclAdaptors[flagcxCCLAdaptorHost]->groupEnd();
+      if (flagcxHostEngineDefers(comm->host_engine)) {
+        return flagcxHostEngineEnqueue(
+            comm->host_engine,
+            [comm](flagcxStream_t) { return flagcxGroupEnd(comm); }, NULL);
+      }
+      FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorHost]->groupEnd());
+      FLAGCXCHECK(flagcxHostBufferPoolGroupEnd(comm->host_buffer_pool));
     } else {
       FLAGCXCHECK(flagcxHeteroGroupEnd());
+      if (--comm->c2c_group->depth == 0) {
+        FLAGCXCHECK(c2cGroupFlush(comm));
+      }
     }
   }
   return flagcxSuccess;
-}
\ No newline at end of file
+}
@@ -80,6 +80,22 @@ typedef struct flagcxComm *flagcxComm_t;
 typedef struct flagcxStream *flagcxStream_t;
 /* Opaque handle to flagcxEvent */
 typedef struct flagcxEvent *flagcxEvent_t;
+/* Opaque handle to flagcxPlan */
+typedef struct flagcxPlan *flagcxPlan_t;
+
+/* Collectives that can be planned with flagcxPlanCreate, also those the
+ * adaptors report as implemented */
+typedef enum {
+  flagcxCollBroadcast = 0,
+  flagcxCollReduce = 1,
+  flagcxCollAllGather = 2,
+  flagcxCollReduceScatter = 3,
+  flagcxCollAllReduce = 4,
+  flagcxCollAlltoAll = 5,
+  flagcxCollGather = 6,
+  flagcxCollScatter = 7,
+  flagcxNumColls = 8
+} flagcxCollType_t;
 
 struct flagcxDeviceHandle {
   // Basic functions
@@ -203,11 +219,27 @@ flagcxResult_t flagcxCommUserRank(const flagcxComm_t comm, int *rank);
 /*
  * Barrier
  *
- * Blocks until all processes in the communicator have reached this routine.
+ * Blocks until all processes in the communicator have reached this routine,
+ * after the work already enqueued on stream has completed. The ranks
+ * synchronize over the bootstrap network, without device memory.
  *
  */
 flagcxResult_t flagcxBarrier(flagcxComm_t comm, flagcxStream_t stream);
 
+/*
+ * Stream Barrier
+ *
+ * Stream-ordered variant of flagcxBarrier: the work enqueued on stream
+ * afterwards starts once all processes in the communicator have reached the
+ * barrier on their streams. It returns immediately on a homogeneous
+ * communicator. On a heterogeneous one, the inter rank of every cluster
+ * synchronizes stream before each of the log2(nclusters) rounds between the
+ * clusters, so it blocks the host until the previous round and the work
+ * enqueued before the barrier have completed.
+ *
+ */
+flagcxResult_t flagcxStreamBarrier(flagcxComm_t comm, flagcxStream_t stream);
+
 /*
  * Reduce
  *
@@ -406,6 +438,39 @@ flagcxResult_t flagcxGroupStart(flagcxComm_t comm);
  */
 flagcxResult_t flagcxGroupEnd(flagcxComm_t comm);
 
+/*
+ * Persistent collective plans
+ *
+ * A plan fixes a collective, its count (with the meaning of the count argument
+ * of that collective), datatype, reduction operation and root, so that the
+ * decisions taken on every call - algorithm selection and the connection of
+ * the peers - are only taken once. Launching a plan then only issues the
+ * communication on the given buffers. Only the algorithm is cached: the
+ * offsets and ranges the heterogeneous collectives split the buffers into are
+ * still computed on every launch. Collectives with per-rank counts
+ * (flagcxAlltoAllv) cannot be planned.
+ *
+ * flagcxPlanCreate must be called on all ranks of comm with the same
+ * arguments; it runs the collective once on scratch buffers on stream to set
+ * up the connections, so it cannot be called between flagcxGroupStart and
+ * flagcxGroupEnd (flagcxInvalidUsage). Arguments that a collective does not
+ * use (op, root) are ignored. Plans can be launched inside groups.
+ */
+flagcxResult_t flagcxPlanCreate(flagcxPlan_t *plan, flagcxCollType_t coll,
+                                size_t count, flagcxDataType_t datatype,
+                                flagcxRedOp_t op, int root, flagcxComm_t comm,
+                                flagcxStream_t stream);
+
+/*
+ * Launches the collective of plan on sendbuff and recvbuff, on all ranks of
+ * its communicator.
+ */
+flagcxResult_t flagcxPlanLaunch(flagcxPlan_t plan, const void *sendbuff,
+                                void *recvbuff, flagcxStream_t stream);
+
+/* Frees the resources of plan */
+flagcxResult_t flagcxPlanDestroy(flagcxPlan_t plan);
+
 #ifdef __cplusplus
 } // end extern "C"
 #endif
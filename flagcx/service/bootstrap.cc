@@ -9,8 +9,10 @@
 #include "utils.h"
 #include "alloc.h"
 #include "bootstrap.h"
+#include "reduce_kernel.h"
 #include <unistd.h>
 #include <sys/types.h>
+#include <poll.h>
 #include "param.h"
 #include "comm.h"
 #include <vector>
@@ -66,32 +68,200 @@ flagcxResult_t bootstrapNetInit() {
 enum bootstrapInterface_t { findSubnetIf = -1, dontCareIf = -2 };
 
 // Additional sync functions
-static flagcxResult_t bootstrapNetSend(struct flagcxSocket* sock, void* data, int size) {
-  FLAGCXCHECK(flagcxSocketSend(sock, &size, sizeof(int)));
-  FLAGCXCHECK(flagcxSocketSend(sock, data, size));
+// Messages are framed by a size_t length header. The header is gathered with the
+// payload into a single sendmsg so that small messages cost one syscall.
+static flagcxResult_t bootstrapNetSend(struct flagcxSocket* sock, void* data, size_t size) {
+  struct iovec iov[2];
+  iov[0].iov_base = &size;
+  iov[0].iov_len = sizeof(size_t);
+  iov[1].iov_base = data;
+  iov[1].iov_len = size;
+  FLAGCXCHECK(flagcxSocketSendIov(sock, iov, 2));
   return flagcxSuccess;
 }
-static flagcxResult_t bootstrapNetRecv(struct flagcxSocket* sock, void* data, int size) {
-  int recvSize;
-  FLAGCXCHECK(flagcxSocketRecv(sock, &recvSize, sizeof(int)));
+static flagcxResult_t bootstrapNetRecv(struct flagcxSocket* sock, void* data, size_t size) {
+  size_t recvSize;
+  FLAGCXCHECK(flagcxSocketRecv(sock, &recvSize, sizeof(size_t)));
   if (recvSize > size) {
-    WARN("Message truncated : received %d bytes instead of %d", recvSize, size);
+    WARN("Message truncated : received %zu bytes instead of %zu", recvSize, size);
     return flagcxInternalError;
   }
   FLAGCXCHECK(flagcxSocketRecv(sock, data, std::min(recvSize, size)));
   return flagcxSuccess;
 }
-static flagcxResult_t bootstrapNetSendRecv(struct flagcxSocket* sendSock, void* sendData, int sendSize, struct flagcxSocket* recvSock, void* recvData, int recvSize) {
-  int senderRecvSize;
-  FLAGCXCHECK(flagcxSocketSendRecv(sendSock, &sendSize, sizeof(int), recvSock, &senderRecvSize, sizeof(int)));
+static flagcxResult_t bootstrapNetSendRecv(struct flagcxSocket* sendSock, void* sendData, size_t sendSize, struct flagcxSocket* recvSock, void* recvData, size_t recvSize) {
+  size_t senderRecvSize;
+  FLAGCXCHECK(flagcxSocketSendRecv(sendSock, &sendSize, sizeof(size_t), recvSock, &senderRecvSize, sizeof(size_t)));
   if (senderRecvSize > recvSize) {
-    WARN("Message truncated : received %d bytes instead of %d", senderRecvSize, recvSize);
+    WARN("Message truncated : received %zu bytes instead of %zu", senderRecvSize, recvSize);
     return flagcxInternalError;
   }
   FLAGCXCHECK(flagcxSocketSendRecv(sendSock, sendData, sendSize, recvSock, recvData, recvSize));
   return flagcxSuccess;
 }
 
+// Bootstrap ring links
+//
+// Each rank is connected to its ring neighbours by several TCP streams so that large ring
+// transfers are not limited by what a single stream (and the core driving it) can push. The
+// sender picks the number of streams and the stripe size and announces them to the receiver
+// when the link is opened.
+
+// Number of streams per ring link, 0 or less picks it from the speed of the bootstrap interface.
+FLAGCX_PARAM(BootstrapRingStreams, "BOOTSTRAP_RING_STREAMS", -1);
+FLAGCX_PARAM(BootstrapRingStripeSize, "BOOTSTRAP_RING_STRIPE_SIZE", 1 << 17);
+
+// Link speed (in Mb/s) a single stream is expected to sustain.
+#define BOOTSTRAP_RING_STREAM_SPEED 25000
+
+static int bootstrapRingStreams() {
+  int64_t nStreams = flagcxParamBootstrapRingStreams();
+  if (nStreams <= 0) {
+    nStreams = 1;
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "/sys/class/net/%s/speed", bootstrapNetIfName);
+    FILE* file = fopen(path, "r");
+    if (file != NULL) {
+      int speed;
+      // Virtual interfaces report -1 or nothing at all
+      if (fscanf(file, "%d", &speed) == 1 && speed > 0) {
+        nStreams = DIVUP(speed, BOOTSTRAP_RING_STREAM_SPEED);
+      }
+      fclose(file);
+    }
+  }
+  return (int)std::min(nStreams, (int64_t)BOOTSTRAP_RING_MAX_STREAMS);
+}
+
+struct bootstrapRingHello {
+  int stream;
+  int nStreams;
+  size_t stripeSize;
+};
+
+static flagcxResult_t bootstrapRingConnect(struct bootstrapState* state, union flagcxSocketAddress* nextAddr) {
+  struct bootstrapRingLink* link = &state->ringSend;
+  struct bootstrapRingHello hello;
+  hello.nStreams = bootstrapRingStreams();
+  hello.stripeSize = std::max((int64_t)flagcxParamBootstrapRingStripeSize(), (int64_t)1);
+  for (hello.stream = 0; hello.stream < hello.nStreams; hello.stream++) {
+    struct flagcxSocket* sock = link->socks + hello.stream;
+    FLAGCXCHECK(flagcxSocketInit(sock, nextAddr, state->magic, flagcxSocketTypeBootstrap, state->abortFlag));
+    FLAGCXCHECK(flagcxSocketConnect(sock));
+    link->nStreams = hello.stream + 1;
+    FLAGCXCHECK(bootstrapNetSend(sock, &hello, sizeof(hello)));
+  }
+  link->stripeSize = hello.stripeSize;
+  TRACE(FLAGCX_INIT, "rank %d ring link to next: %d streams, stripe size %zu", state->rank, link->nStreams, link->stripeSize);
+  return flagcxSuccess;
+}
+
+// Streams may be accepted in any order, the hello message tells where each one belongs.
+static flagcxResult_t bootstrapRingAccept(struct bootstrapState* state) {
+  struct bootstrapRingLink* link = &state->ringRecv;
+  struct bootstrapRingHello hello;
+  int nStreams = 1;
+  for (int i = 0; i < nStreams; i++) {
+    struct flagcxSocket sock;
+    FLAGCXCHECK(flagcxSocketInit(&sock));
+    FLAGCXCHECK(flagcxSocketAccept(&sock, &state->listenSock));
+    FLAGCXCHECK(bootstrapNetRecv(&sock, &hello, sizeof(hello)));
+    if (hello.nStreams < 1 || hello.nStreams > BOOTSTRAP_RING_MAX_STREAMS || hello.stream < 0 || hello.stream >= hello.nStreams ||
+        (i > 0 && (hello.nStreams != nStreams || hello.stripeSize != link->stripeSize))) {
+      WARN("Bootstrap : invalid ring stream %d/%d from previous rank", hello.stream, hello.nStreams);
+      FLAGCXCHECK(flagcxSocketClose(&sock));
+      return flagcxInternalError;
+    }
+    nStreams = hello.nStreams;
+    link->stripeSize = hello.stripeSize;
+    link->socks[hello.stream] = sock;
+    link->nStreams = std::max(link->nStreams, hello.stream + 1);
+  }
+  return flagcxSuccess;
+}
+
+static flagcxResult_t bootstrapRingClose(struct bootstrapRingLink* link) {
+  for (int s = 0; s < link->nStreams; s++) {
+    FLAGCXCHECK(flagcxSocketClose(link->socks + s));
+  }
+  link->nStreams = 0;
+  return flagcxSuccess;
+}
+
+// Progress of a transfer over a ring link. offset is the prefix of the buffer that has been
+// transferred, every stream may be ahead of it by up to one stripe per stream.
+struct bootstrapRingCursor {
+  size_t offset;
+  size_t streamOffset[BOOTSTRAP_RING_MAX_STREAMS];
+};
+
+static void bootstrapRingCursorReset(struct bootstrapRingCursor* cursor) {
+  memset(cursor, 0, sizeof(*cursor));
+}
+
+// Number of bytes below limit carried by stream s.
+static size_t bootstrapRingStreamBytes(int s, int nStreams, size_t stripe, size_t limit) {
+  size_t cycle = stripe * nStreams;
+  size_t rem = limit % cycle;
+  size_t first = s * stripe;
+  return limit / cycle * stripe + (rem > first ? std::min(rem - first, stripe) : 0);
+}
+
+/*
+ * Non-blocking send or receive of bytes [0, limit) of data[0, size) over link; limit may
+ * grow between calls up to size. Updates cursor->offset to the prefix that has been
+ * fully transferred.
+ */
+static flagcxResult_t bootstrapRingProgress(int op, struct bootstrapRingLink* link, char* data, size_t size, size_t limit,
+                                            struct bootstrapRingCursor* cursor) {
+  int nStreams = link->nStreams;
+  // With a single stream the mapping is the identity, avoid splitting the syscalls.
+  size_t stripe = nStreams == 1 ? std::max(size, (size_t)1) : link->stripeSize;
+  size_t offset = size;
+  for (int s = 0; s < nStreams; s++) {
+    size_t* streamOffset = cursor->streamOffset + s;
+    size_t end = bootstrapRingStreamBytes(s, nStreams, stripe, limit);
+    while (*streamOffset < end) {
+      size_t segment = *streamOffset / stripe;
+      size_t pos = *streamOffset % stripe;
+      size_t start = pos;
+      size_t segmentEnd = std::min(pos + end - *streamOffset, stripe);
+      FLAGCXCHECK(flagcxSocketProgress(op, link->socks + s, data + (segment * nStreams + s) * stripe, segmentEnd, &pos));
+      *streamOffset += pos - start;
+      if (pos < segmentEnd) break;
+    }
+    if (*streamOffset < bootstrapRingStreamBytes(s, nStreams, stripe, size)) {
+      offset = std::min(offset, (*streamOffset / stripe * nStreams + s) * stripe + *streamOffset % stripe);
+    }
+  }
+  cursor->offset = offset;
+  return flagcxSuccess;
+}
+
+// Blocking exchange over the ring: sends to next while receiving from prev, with the same
+// size header as bootstrapNetSendRecv.
+static flagcxResult_t bootstrapRingSendRecv(struct bootstrapRingLink* next, void* sendData, size_t sendSize,
+                                            struct bootstrapRingLink* prev, void* recvData, size_t recvSize) {
+  size_t senderRecvSize;
+  FLAGCXCHECK(flagcxSocketSendRecv(next->socks, &sendSize, sizeof(size_t), prev->socks, &senderRecvSize, sizeof(size_t)));
+  if (senderRecvSize > recvSize) {
+    WARN("Message truncated : received %zu bytes instead of %zu", senderRecvSize, recvSize);
+    return flagcxInternalError;
+  }
+  struct bootstrapRingCursor sendCursor, recvCursor;
+  bootstrapRingCursorReset(&sendCursor);
+  bootstrapRingCursorReset(&recvCursor);
+  while (sendCursor.offset < sendSize || recvCursor.offset < senderRecvSize) {
+    if (sendCursor.offset < sendSize) {
+      FLAGCXCHECK(bootstrapRingProgress(FLAGCX_SOCKET_SEND, next, (char*)sendData, sendSize, sendSize, &sendCursor));
+    }
+    if (recvCursor.offset < senderRecvSize) {
+      FLAGCXCHECK(bootstrapRingProgress(FLAGCX_SOCKET_RECV, prev, (char*)recvData, senderRecvSize, senderRecvSize, &recvCursor));
+    }
+  }
+  return flagcxSuccess;
+}
+
 struct extInfo {
   int rank;
   int nranks;
@@ -273,11 +443,9 @@ flagcxResult_t bootstrapInit(struct flagcxBootstrapHandle* handle, void* commSta
   FLAGCXCHECK(flagcxSocketClose(&sock));
   FLAGCXCHECK(flagcxSocketClose(&listenSockRoot));
 
-  FLAGCXCHECK(flagcxSocketInit(&state->ringSendSocket, &nextAddr, state->magic, flagcxSocketTypeBootstrap, state->abortFlag));
-  FLAGCXCHECK(flagcxSocketConnect(&state->ringSendSocket));
-  // Accept the connect request from the previous rank in the AllGather ring
-  FLAGCXCHECK(flagcxSocketInit(&state->ringRecvSocket));
-  FLAGCXCHECK(flagcxSocketAccept(&state->ringRecvSocket, &state->listenSock));
+  FLAGCXCHECK(bootstrapRingConnect(state, &nextAddr));
+  // Accept the connect requests from the previous rank in the AllGather ring
+  FLAGCXCHECK(bootstrapRingAccept(state));
 
   // AllGather all listen handlers
   FLAGCXCHECK(flagcxCalloc(&state->peerCommAddresses, nranks));
@@ -310,15 +478,15 @@ fail:
   return ret;
 }
 
-flagcxResult_t bootstrapSend(void* commState, int peer, int tag, void* data, int size) {
+flagcxResult_t bootstrapSend(void* commState, int peer, int tag, void* data, size_t size) {
   flagcxResult_t ret = flagcxSuccess;
   struct flagcxSocket sock;
 
-  TRACE(FLAGCX_BOOTSTRAP, "Sending to peer=%d tag=%d size=%d", peer, tag, size);
+  TRACE(FLAGCX_BOOTSTRAP, "Sending to peer=%d tag=%d size=%zu", peer, tag, size);
   FLAGCXCHECK(bootstrapConnect(commState, peer, tag, &sock));
   FLAGCXCHECKGOTO(bootstrapNetSend(&sock, data, size), ret, exit);
 
-  TRACE(FLAGCX_BOOTSTRAP, "Sent to peer=%d tag=%d size=%d", peer, tag, size);
+  TRACE(FLAGCX_BOOTSTRAP, "Sent to peer=%d tag=%d size=%zu", peer, tag, size);
 
 exit:
   FLAGCXCHECK(flagcxSocketClose(&sock));
@@ -405,20 +573,39 @@ fail:
 }
 
 // We can't know who we'll receive from, so we need to receive everything at once
-flagcxResult_t bootstrapRecv(void* commState, int peer, int tag, void* data, int size) {
+flagcxResult_t bootstrapRecv(void* commState, int peer, int tag, void* data, size_t size) {
   flagcxResult_t ret;
   struct flagcxSocket sock;
   FLAGCXCHECK(bootstrapAccept(commState, peer, tag, &sock));
-  TRACE(FLAGCX_BOOTSTRAP, "Receiving tag=%d peer=%d size=%d", tag, peer, size);
+  TRACE(FLAGCX_BOOTSTRAP, "Receiving tag=%d peer=%d size=%zu", tag, peer, size);
   FLAGCXCHECKGOTO(bootstrapNetRecv(&sock, ((char*)data), size), ret, exit);
 exit:
   FLAGCXCHECK(flagcxSocketClose(&sock));
   return ret;
 }
 
+// Simultaneous send to sendPeer and receive from recvPeer (which may be the same rank). Both
+// directions are in flight at the same time, so ranks exchanging large buffers in a pairwise
+// pattern cannot block each other in send.
+static flagcxResult_t bootstrapSendRecv(void* commState, int sendPeer, int recvPeer, int tag, void* sendData,
+                                        size_t sendSize, void* recvData, size_t recvSize) {
+  flagcxResult_t ret = flagcxSuccess;
+  struct flagcxSocket sendSock, recvSock;
+  FLAGCXCHECK(bootstrapConnect(commState, sendPeer, tag, &sendSock));
+  FLAGCXCHECKGOTO(bootstrapAccept(commState, recvPeer, tag, &recvSock), ret, closeSend);
+  TRACE(FLAGCX_BOOTSTRAP, "Exchanging tag=%d: %zu bytes to peer=%d, %zu bytes from peer=%d", tag, sendSize, sendPeer,
+        recvSize, recvPeer);
+  FLAGCXCHECKGOTO(bootstrapNetSendRecv(&sendSock, sendData, sendSize, &recvSock, recvData, recvSize), ret, closeRecv);
+closeRecv:
+  FLAGCXCHECK(flagcxSocketClose(&recvSock));
+closeSend:
+  FLAGCXCHECK(flagcxSocketClose(&sendSock));
+  return ret;
+}
+
 // Collective algorithms, based on bootstrapSend/Recv, and sometimes bootstrapConnect/Accept
 
-flagcxResult_t bootstrapRingAllGather(struct flagcxSocket* prevSocket, struct flagcxSocket* nextSocket, int rank, int nranks, char* data, int size) {
+flagcxResult_t bootstrapRingAllGather(struct bootstrapRingLink* prev, struct bootstrapRingLink* next, int rank, int nranks, char* data, size_t size) {
   /* Simple ring based AllGather
    * At each step i receive data from (rank-i-1) from prev
    * and send previous step's data from (rank-i) to next
@@ -428,14 +615,14 @@ flagcxResult_t bootstrapRingAllGather(struct flagcxSocket* prevSocket, struct fl
     size_t sslice = (rank - i + nranks) % nranks;
 
     // Send slice to the right, recv slice from the left
-    FLAGCXCHECK(bootstrapNetSendRecv(nextSocket, data+sslice*size, size, prevSocket, data+rslice*size, size));
+    FLAGCXCHECK(bootstrapRingSendRecv(next, data+sslice*size, size, prev, data+rslice*size, size));
   }
   return flagcxSuccess;
 }
 
 // Another Version of RingAllGather
 // The data bytes gather from multiple ranks are uneven.
-flagcxResult_t bootstrapRingAllGatherV2(struct flagcxSocket* prevSocket, struct flagcxSocket* nextSocket, int rank, int nranks,
+flagcxResult_t bootstrapRingAllGatherV2(struct bootstrapRingLink* prev, struct bootstrapRingLink* next, int rank, int nranks,
                                         char* data, size_t* offset, size_t* length) {
   /* Simple ring based AllGather
    * At each step i receive data from (rank-i-1) from prev
@@ -449,8 +636,8 @@ flagcxResult_t bootstrapRingAllGatherV2(struct flagcxSocket* prevSocket, struct
     size_t sslice = (rank - i + nranks) % nranks;
 
     // Send slice to the right, recv slice from the left
-    FLAGCXCHECK(bootstrapNetSendRecv(nextSocket, (void *)(data + offset[sslice]), length[sslice],
-                                     prevSocket, (void *)(data + offset[rslice]), length[rslice]));
+    FLAGCXCHECK(bootstrapRingSendRecv(next, (void *)(data + offset[sslice]), length[sslice],
+                                      prev, (void *)(data + offset[rslice]), length[rslice]));
   }
   timers[TIMER_COLL_TOTAL] = clockNano() - timers[TIMER_COLL_TOTAL];
   INFO(FLAGCX_COLL,
@@ -459,16 +646,16 @@ flagcxResult_t bootstrapRingAllGatherV2(struct flagcxSocket* prevSocket, struct
   return flagcxSuccess;
 
 }
-flagcxResult_t bootstrapAllGather(void* commState, void* allData, int size) {
+flagcxResult_t bootstrapAllGather(void* commState, void* allData, size_t size) {
   struct bootstrapState* state = (struct bootstrapState*)commState;
   int rank = state->rank;
   int nranks = state->nranks;
 
-  TRACE(FLAGCX_INIT, "rank %d nranks %d size %d", rank, nranks, size);
+  TRACE(FLAGCX_INIT, "rank %d nranks %d size %zu", rank, nranks, size);
 
-  FLAGCXCHECK(bootstrapRingAllGather(&state->ringRecvSocket, &state->ringSendSocket, rank, nranks, (char*)allData, size));
+  FLAGCXCHECK(bootstrapRingAllGather(&state->ringRecv, &state->ringSend, rank, nranks, (char*)allData, size));
 
-  TRACE(FLAGCX_INIT, "rank %d nranks %d size %d - DONE", rank, nranks, size);
+  TRACE(FLAGCX_INIT, "rank %d nranks %d size %zu - DONE", rank, nranks, size);
   return flagcxSuccess;
 }
 
@@ -482,6 +669,9 @@ flagcxResult_t AllGatherBootstrap(void* commState, const void* sendbuff, void* r
   }
   return  bootstrapAllGather(commState, recvbuff, getFlagcxDataTypeSize(datatype) * sendcount);
 }
+// Granularity at which received data is reduced and forwarded by the ring reduce-scatter.
+FLAGCX_PARAM(BootstrapReduceBlockSize, "BOOTSTRAP_REDUCE_BLOCK_SIZE", 1 << 18);
+
 /*
  * Reduce-Scatter
  *
@@ -494,105 +684,121 @@ flagcxResult_t AllGatherBootstrap(void* commState, const void* sendbuff, void* r
  * The recvbuff of rank i should has the length of at least length[i].
  *
  * In-place operations will happen if recvbuff == sendbuff + offset[rank].
+ *
+ * The nranks-1 ring steps are processed as one stream of sub-blocks instead of
+ * whole chunks: a sub-block is reduced as soon as it has arrived from prev while
+ * later sub-blocks are still in flight, and it is forwarded to next as soon as
+ * it has been reduced. Step i receives into buffer i%2 and the step i+1 send
+ * drains the same buffer, so a buffer is refilled only behind the send cursor
+ * that is still reading it.
  */
-flagcxResult_t bootstrapRingReduceScatter(struct flagcxSocket* prevSocket, struct flagcxSocket* nextSocket, int rank, int nranks,
+flagcxResult_t bootstrapRingReduceScatter(struct bootstrapRingLink* prev, struct bootstrapRingLink* next, int rank, int nranks,
                                          const char* sendbuff, char* recvbuff, size_t* offset, size_t* length,
                                          flagcxDataType_t datatype, flagcxRedOp_t op) {
   uint64_t timers[TIMERS_COLL_COUNT] = {0};
   timers[TIMER_COLL_TOTAL] = clockNano();
 
-  // Allocate two temporary buffer with size length[0] to ensure that it can fill any chunk size.
+  const int nsteps = nranks - 1;
+  if (nsteps == 0) {
+    if (recvbuff != sendbuff + offset[rank]) memcpy(recvbuff, sendbuff + offset[rank], length[rank]);
+    return flagcxSuccess;
+  }
+
+  // Allocate two temporary buffers large enough for the largest chunk.
   timers[TIMER_COLL_ALLOC] = clockNano();
-  // found the largest chunk
   size_t subSize = 0;
   for (int i = 0; i < nranks; ++i) {
     subSize = std::max(length[i], subSize);
   }
-  char *data_for_send = nullptr;
-  FLAGCXCHECK(flagcxCalloc(&data_for_send, subSize));
-  char *data_for_recv = nullptr;
-  FLAGCXCHECK(flagcxCalloc(&data_for_recv, subSize));
+  char* buffers[2] = {nullptr, nullptr};
+  FLAGCXCHECK(flagcxCalloc(&buffers[0], subSize));
+  FLAGCXCHECK(flagcxCalloc(&buffers[1], subSize));
   timers[TIMER_COLL_ALLOC] = clockNano() - timers[TIMER_COLL_ALLOC];
 
-  uint64_t start = 0;
-  uint64_t end = 0;
-  // for iteration 0 -> n-1
-  for (int iter = 0; iter < nranks - 1; ++iter) {
-    // for each iteration ${iter}
-    // 1. rank ${rank} should send data of chunk $(send_chunk_no) to next rank
-    // 2. rank ${rank} should recv data of chunk $(recv_chunk_no) from prev rank
-    int send_chunk_no = (rank + 2 * nranks - iter - 1) % nranks;
-    int recv_chunk_no = (rank + 2 * nranks - iter - 2) % nranks;
-    bool needSend = length[send_chunk_no] != 0;
-    bool needRecv = length[recv_chunk_no] != 0;
-
-    INFO(FLAGCX_COLL, "rank %d nranks %d; iter=%d; send_chunk_no=%d; send_chunk_size=%lu; needSend=%d; "
-	              "recv_chunk_no=%d; recv_chunk_size=%lu; needRecv=%d",
-	 rank, nranks, iter, send_chunk_no, length[send_chunk_no], needSend, recv_chunk_no, length[recv_chunk_no], needRecv);
-    if (!needSend && !needRecv) {
-      continue;
-    }
+  size_t typeSize = getFlagcxDataTypeSize(datatype);
+  size_t blockSize = std::max((size_t)flagcxParamBootstrapReduceBlockSize(), typeSize);
+  blockSize -= blockSize % typeSize;
 
-    // step 1: prepare send data if needed
-    if (needSend) {
-      start = clockNano();
-      if (iter == 0) {
-        // initial iteration
-        memcpy(data_for_send, sendbuff + offset[send_chunk_no], length[send_chunk_no]);
-      } else {
-        std::swap(data_for_send, data_for_recv);
-      }
-      end = clockNano();
-      timers[TIMER_COLL_MEM] += end - start;
-    }
+  // In iteration i, send chunk sendChunk(i) to next rank and receive chunk recvChunk(i) from
+  // prev rank; the chunk received in iteration i is the one sent in iteration i+1.
+  auto sendChunk = [&](int step) { return (rank + 2 * nranks - step - 1) % nranks; };
+  auto recvChunk = [&](int step) { return (rank + 2 * nranks - step - 2) % nranks; };
 
-    // step 2: exchange data using Send/Recv
+  int sendStep = 0, recvStep = 0, redStep = 0;
+  struct bootstrapRingCursor sendCursor, recvCursor;
+  bootstrapRingCursorReset(&sendCursor);
+  bootstrapRingCursorReset(&recvCursor);
+  size_t redOffset = 0;
+  flagcxResult_t ret = flagcxSuccess;
+  uint64_t start;
+  while (redStep < nsteps) {
     start = clockNano();
-    if (needSend && needRecv) {
-      FLAGCXCHECK(bootstrapNetSendRecv(nextSocket, (void *)data_for_send, length[send_chunk_no],
-                                       prevSocket, (void *)data_for_recv, length[recv_chunk_no]));
-    } else if (needSend) {
-      FLAGCXCHECK(bootstrapNetSend(nextSocket, (void *)data_for_send, length[send_chunk_no]));
-    } else if (needRecv) {
-      FLAGCXCHECK(bootstrapNetRecv(prevSocket, (void *)data_for_recv, length[recv_chunk_no]));
-    }
-    end = clockNano();
-    timers[TIMER_COLL_COMM] += end - start;
-
-    // step3 : local reduction for data_for_send & chunk ${recv_chunk_no} if recv something
-    //         save result in data_for_recv
-    if (!needRecv) {
-      continue;
+    // Send: step 0 reads sendbuff directly, later steps may only send what has been reduced.
+    if (sendStep < nsteps) {
+      size_t len = length[sendChunk(sendStep)];
+      size_t avail = (sendStep == 0 || redStep >= sendStep) ? len : (redStep == sendStep - 1 ? redOffset : 0);
+      const char* src = sendStep == 0 ? sendbuff + offset[sendChunk(0)] : buffers[(sendStep - 1) % 2];
+      if (sendCursor.offset < avail) {
+        FLAGCXCHECKGOTO(bootstrapRingProgress(FLAGCX_SOCKET_SEND, next, (char*)src, len, avail, &sendCursor), ret, exit);
+      }
+      if (sendCursor.offset == len) {
+        sendStep++;
+        bootstrapRingCursorReset(&sendCursor);
+      }
+    }
+    // Receive: buffer recvStep%2 is still being sent by step recvStep-1, stay behind it. That
+    // step sends a different chunk, so its cursor may run past the length of this one.
+    if (recvStep < nsteps) {
+      size_t len = length[recvChunk(recvStep)];
+      size_t avail = (recvStep < 2 || sendStep >= recvStep) ? len : (sendStep == recvStep - 1 ? std::min(sendCursor.offset, len) : 0);
+      if (recvCursor.offset < avail) {
+        FLAGCXCHECKGOTO(bootstrapRingProgress(FLAGCX_SOCKET_RECV, prev, buffers[recvStep % 2], len, avail, &recvCursor), ret, exit);
+      }
+      if (recvCursor.offset == len) {
+        recvStep++;
+        bootstrapRingCursorReset(&recvCursor);
+      }
     }
+    timers[TIMER_COLL_COMM] += clockNano() - start;
+
+    // Reduce whatever full sub-blocks have arrived in one call, so that a backlog is large
+    // enough to be split by the host reduction pool; the last step writes straight into recvbuff.
     start = clockNano();
-    switch(op) {
-      case flagcxSum:
-        GENERATE_ALL_TYPES(datatype, sum, data_for_recv,
-                          sendbuff + offset[recv_chunk_no], data_for_recv,
-                          length[recv_chunk_no]/getFlagcxDataTypeSize(datatype));
-        break;
-      case flagcxMax:
-        GENERATE_ALL_TYPES(datatype, max, data_for_recv,
-                          sendbuff + offset[recv_chunk_no], data_for_recv,
-                          length[recv_chunk_no]/getFlagcxDataTypeSize(datatype));
-        break;
-      case flagcxMin:
-        GENERATE_ALL_TYPES(datatype, min, data_for_recv,
-                          sendbuff + offset[recv_chunk_no], data_for_recv,
-                          length[recv_chunk_no]/getFlagcxDataTypeSize(datatype));
-        break;
-      default:
-          WARN("Unsupported reduction operation %d", op);
-          return flagcxInvalidArgument;
+    while (redStep < nsteps) {
+      int chunk = recvChunk(redStep);
+      size_t len = length[chunk];
+      size_t avail = redStep < recvStep ? len : (redStep == recvStep ? recvCursor.offset : 0);
+      size_t bytes = avail == len ? len - redOffset : (avail - redOffset) / blockSize * blockSize;
+      if (bytes == 0 && avail < len) break;
+      char* in = buffers[redStep % 2] + redOffset;
+      char* out = redStep == nsteps - 1 ? recvbuff + redOffset : in;
+      if (bytes > 0) {
+        FLAGCXCHECKGOTO(flagcxHostReduce(out, in, sendbuff + offset[chunk] + redOffset, bytes / typeSize, datatype, op), ret, exit);
+        if (redStep == nsteps - 1) {
+          FLAGCXCHECKGOTO(flagcxHostReduceFinalize(out, bytes / typeSize, datatype, op, nranks), ret, exit);
+        }
+        redOffset += bytes;
+      }
+      if (redOffset == len) {
+        redStep++;
+        redOffset = 0;
       }
-      end = clockNano();
-      timers[TIMER_COLL_CALC] += end - start;
+    }
+    timers[TIMER_COLL_CALC] += clockNano() - start;
   }
 
-  // copy the final reduction to recvbuff
-  memcpy(recvbuff, data_for_recv, length[rank]);
-  free(data_for_send);
-  free(data_for_recv);
+  // Drain the tail of the last send.
+  start = clockNano();
+  while (sendStep < nsteps) {
+    size_t len = length[sendChunk(sendStep)];
+    const char* src = sendStep == 0 ? sendbuff + offset[sendChunk(0)] : buffers[(sendStep - 1) % 2];
+    while (sendCursor.offset < len) {
+      FLAGCXCHECKGOTO(bootstrapRingProgress(FLAGCX_SOCKET_SEND, next, (char*)src, len, len, &sendCursor), ret, exit);
+    }
+    sendStep++;
+    bootstrapRingCursorReset(&sendCursor);
+  }
+  timers[TIMER_COLL_COMM] += clockNano() - start;
 
   timers[TIMER_COLL_TOTAL] = clockNano() - timers[TIMER_COLL_TOTAL];
   INFO(FLAGCX_COLL,
@@ -600,10 +806,20 @@ flagcxResult_t bootstrapRingReduceScatter(struct flagcxSocket* prevSocket, struc
        "BootstrapRingReduceScatter", rank, nranks,
        timers[TIMER_COLL_TOTAL] / 1e6, timers[TIMER_COLL_CALC] / 1e6, timers[TIMER_COLL_ALLOC] / 1e6, timers[TIMER_COLL_MEM] / 1e6,
        timers[TIMER_COLL_COMM] / 1e6);
-  return flagcxSuccess;
+exit:
+  free(buffers[0]);
+  free(buffers[1]);
+  return ret;
 }
 
 const size_t MIN_CHUNK_SIZE = 1024 * 1024 * 4; // 4MB
+// Message sizes (in bytes) below which AllReduceBootstrap uses recursive doubling and Rabenseifner
+// halving-doubling instead of the ring. Setting a threshold to 0 disables the algorithm.
+// Every recursive doubling/Rabenseifner round opens a new connection while the ring reuses the
+// ring sockets, so the crossovers sit higher than with MPI; test/perf run-bootstrap-allreduce
+// measures the three algorithms over the whole size range.
+FLAGCX_PARAM(BootstrapAllReduceRdThreshold, "BOOTSTRAP_ALLREDUCE_RD_THRESHOLD", 1 << 16);
+FLAGCX_PARAM(BootstrapAllReduceRabenseifnerThreshold, "BOOTSTRAP_ALLREDUCE_RABENSEIFNER_THRESHOLD", 1 << 22);
 
 size_t roundUp(size_t value, size_t multiple) {
   size_t remainder = value % multiple;
@@ -613,7 +829,7 @@ size_t roundUp(size_t value, size_t multiple) {
   return value + multiple - remainder;
 }
 
-flagcxResult_t bootstrapRingAllReduce(struct flagcxSocket* prevSocket, struct flagcxSocket* nextSocket, int rank, int nranks,
+flagcxResult_t bootstrapRingAllReduce(struct bootstrapRingLink* prev, struct bootstrapRingLink* next, int rank, int nranks,
                                       const char* sendbuff, char* recvbuff, size_t count, flagcxDataType_t datatype, flagcxRedOp_t op) {
 
   // The ring algorithm works as follows.
@@ -626,10 +842,11 @@ flagcxResult_t bootstrapRingAllReduce(struct flagcxSocket* prevSocket, struct fl
   // final ranks may have partial output or may be empty.
   //
 
+  // The ring is only selected for large messages, so the chunks are split evenly (at element
+  // granularity) instead of being rounded up to MIN_CHUNK_SIZE, which would leave the last ranks
+  // without work.
   size_t size = count * getFlagcxDataTypeSize(datatype);
-  size_t ChunkBytes = std::max((size+nranks-1)/nranks, MIN_CHUNK_SIZE);
-  // Ensure that min chunk size is a multiple of the element size.
-  ChunkBytes = roundUp(ChunkBytes, getFlagcxDataTypeSize(datatype));
+  size_t ChunkBytes = roundUp((size+nranks-1)/nranks, getFlagcxDataTypeSize(datatype));
   INFO(FLAGCX_COLL, "rank %d nranks %d; size=%lu; typesize=%lu; ChunkBytes=%lu", rank, nranks, size, getFlagcxDataTypeSize(datatype), ChunkBytes);
 
   // step 1: split the data and prepare offset and length array
@@ -646,14 +863,155 @@ flagcxResult_t bootstrapRingAllReduce(struct flagcxSocket* prevSocket, struct fl
   }
 
   // step 2: reduce scatter
-  FLAGCXCHECK(bootstrapRingReduceScatter(prevSocket, nextSocket, rank, nranks, sendbuff, recvbuff + offset[rank], offset.data(), length.data(), datatype, op));
+  FLAGCXCHECK(bootstrapRingReduceScatter(prev, next, rank, nranks, sendbuff, recvbuff + offset[rank], offset.data(), length.data(), datatype, op));
 
   // step 3: all gather
-  FLAGCXCHECK(bootstrapRingAllGatherV2(prevSocket, nextSocket, rank, nranks, recvbuff, offset.data(), length.data()));
+  FLAGCXCHECK(bootstrapRingAllGatherV2(prev, next, rank, nranks, recvbuff, offset.data(), length.data()));
+  return flagcxSuccess;
+}
+
+/*
+ * Recursive doubling and Rabenseifner allreduce.
+ *
+ * Both algorithms work on a power-of-two number of ranks pof2. When nranks is
+ * not a power of two, the first 2*rem ranks (rem = nranks - pof2) are folded in
+ * pairs first: every even rank among them hands its input to the next odd rank
+ * and takes no further part until that rank sends the result back. The
+ * remaining ranks are renumbered 0..pof2-1 ("newrank").
+ */
+static int bootstrapAllReduceRealRank(int newrank, int rem) {
+  return newrank < rem ? newrank * 2 + 1 : newrank + rem;
+}
+
+static flagcxResult_t bootstrapAllReduceFold(void* commState, int rank, int rem, const char* sendbuff, char* recvbuff,
+                                             char* tmpbuff, size_t count, flagcxDataType_t datatype, flagcxRedOp_t op,
+                                             int* newrank) {
+  const int bootstrapTag = -9994;
+  size_t size = count * getFlagcxDataTypeSize(datatype);
+  if (rank < 2 * rem) {
+    if (rank % 2 == 0) {
+      FLAGCXCHECK(bootstrapSend(commState, rank + 1, bootstrapTag, (void*)sendbuff, size));
+      *newrank = -1;
+    } else {
+      FLAGCXCHECK(bootstrapRecv(commState, rank - 1, bootstrapTag, tmpbuff, size));
+      FLAGCXCHECK(flagcxHostReduce(recvbuff, sendbuff, tmpbuff, count, datatype, op));
+      *newrank = rank / 2;
+    }
+  } else {
+    if (sendbuff != recvbuff) memcpy(recvbuff, sendbuff, size);
+    *newrank = rank - rem;
+  }
+  return flagcxSuccess;
+}
+
+static flagcxResult_t bootstrapAllReduceUnfold(void* commState, int rank, int rem, char* recvbuff, size_t size) {
+  const int bootstrapTag = -9994;
+  if (rank < 2 * rem) {
+    if (rank % 2 == 0) {
+      FLAGCXCHECK(bootstrapRecv(commState, rank + 1, bootstrapTag, recvbuff, size));
+    } else {
+      FLAGCXCHECK(bootstrapSend(commState, rank - 1, bootstrapTag, recvbuff, size));
+    }
+  }
   return flagcxSuccess;
 }
 
-flagcxResult_t bootstrapRingReduce(void* commState, struct flagcxSocket* prevSocket, struct flagcxSocket* nextSocket, int rank, int nranks,
+// log2(pof2) rounds, each exchanging the whole buffer with newrank ^ mask. Latency-optimal, used
+// for small messages.
+flagcxResult_t bootstrapRecursiveDoublingAllReduce(void* commState, int rank, int nranks, const char* sendbuff,
+                                                   char* recvbuff, size_t count, flagcxDataType_t datatype,
+                                                   flagcxRedOp_t op) {
+  const int bootstrapTag = -9995;
+  flagcxResult_t ret = flagcxSuccess;
+  size_t size = count * getFlagcxDataTypeSize(datatype);
+  int pof2 = 1;
+  while (pof2 * 2 <= nranks) pof2 *= 2;
+  int rem = nranks - pof2;
+  int newrank;
+
+  char* tmpbuff = nullptr;
+  FLAGCXCHECK(flagcxCalloc(&tmpbuff, size));
+  FLAGCXCHECKGOTO(bootstrapAllReduceFold(commState, rank, rem, sendbuff, recvbuff, tmpbuff, count, datatype, op, &newrank), ret, exit);
+  if (newrank != -1) {
+    for (int mask = 1; mask < pof2; mask <<= 1) {
+      int peer = bootstrapAllReduceRealRank(newrank ^ mask, rem);
+      FLAGCXCHECKGOTO(bootstrapSendRecv(commState, peer, peer, bootstrapTag, recvbuff, size, tmpbuff, size), ret, exit);
+      FLAGCXCHECKGOTO(flagcxHostReduce(recvbuff, recvbuff, tmpbuff, count, datatype, op), ret, exit);
+    }
+    FLAGCXCHECKGOTO(flagcxHostReduceFinalize(recvbuff, count, datatype, op, nranks), ret, exit);
+  }
+  FLAGCXCHECKGOTO(bootstrapAllReduceUnfold(commState, rank, rem, recvbuff, size), ret, exit);
+exit:
+  free(tmpbuff);
+  return ret;
+}
+
+// Reduce-scatter by recursive halving followed by allgather by recursive doubling (Rabenseifner).
+// Every rank sends about 2*size bytes in 2*log2(pof2) rounds; used for medium messages.
+flagcxResult_t bootstrapRabenseifnerAllReduce(void* commState, int rank, int nranks, const char* sendbuff,
+                                              char* recvbuff, size_t count, flagcxDataType_t datatype,
+                                              flagcxRedOp_t op) {
+  const int halvingTag = -9996;
+  const int doublingTag = -9997;
+  flagcxResult_t ret = flagcxSuccess;
+  size_t typeSize = getFlagcxDataTypeSize(datatype);
+  size_t size = count * typeSize;
+  int pof2 = 1;
+  while (pof2 * 2 <= nranks) pof2 *= 2;
+  int rem = nranks - pof2;
+  int newrank;
+
+  // block i of the buffer ends up fully reduced on newrank i
+  std::vector<size_t> displs(pof2 + 1, 0);
+  for (int i = 0; i < pof2; i++) {
+    displs[i + 1] = displs[i] + count / pof2 + ((size_t)i < count % pof2 ? 1 : 0);
+  }
+
+  char* tmpbuff = nullptr;
+  FLAGCXCHECK(flagcxCalloc(&tmpbuff, size));
+  FLAGCXCHECKGOTO(bootstrapAllReduceFold(commState, rank, rem, sendbuff, recvbuff, tmpbuff, count, datatype, op, &newrank), ret, exit);
+  if (newrank != -1) {
+    // recursive halving: keep the half of [lo, hi) that contains newrank, send the other one
+    int lo = 0, hi = pof2;
+    for (int mask = pof2 / 2; mask > 0; mask >>= 1) {
+      int peer = bootstrapAllReduceRealRank(newrank ^ mask, rem);
+      int mid = lo + mask;
+      int keepLo = (newrank & mask) ? mid : lo;
+      int keepHi = (newrank & mask) ? hi : mid;
+      int sendLo = (newrank & mask) ? lo : mid;
+      int sendHi = (newrank & mask) ? mid : hi;
+      size_t keepCount = displs[keepHi] - displs[keepLo];
+      FLAGCXCHECKGOTO(bootstrapSendRecv(commState, peer, peer, halvingTag, recvbuff + displs[sendLo] * typeSize,
+                                        (displs[sendHi] - displs[sendLo]) * typeSize, tmpbuff, keepCount * typeSize),
+                      ret, exit);
+      char* keep = recvbuff + displs[keepLo] * typeSize;
+      FLAGCXCHECKGOTO(flagcxHostReduce(keep, keep, tmpbuff, keepCount, datatype, op), ret, exit);
+      lo = keepLo;
+      hi = keepHi;
+    }
+    FLAGCXCHECKGOTO(flagcxHostReduceFinalize(recvbuff + displs[newrank] * typeSize, displs[newrank + 1] - displs[newrank],
+                                             datatype, op, nranks), ret, exit);
+
+    // recursive doubling: exchange the reduced range [lo, hi) with the adjacent range of the peer
+    for (int mask = 1; mask < pof2; mask <<= 1) {
+      int peer = bootstrapAllReduceRealRank(newrank ^ mask, rem);
+      int peerLo = (newrank & mask) ? lo - mask : hi;
+      int peerHi = peerLo + mask;
+      FLAGCXCHECKGOTO(bootstrapSendRecv(commState, peer, peer, doublingTag, recvbuff + displs[lo] * typeSize,
+                                        (displs[hi] - displs[lo]) * typeSize, recvbuff + displs[peerLo] * typeSize,
+                                        (displs[peerHi] - displs[peerLo]) * typeSize),
+                      ret, exit);
+      lo = std::min(lo, peerLo);
+      hi = std::max(hi, peerHi);
+    }
+  }
+  FLAGCXCHECKGOTO(bootstrapAllReduceUnfold(commState, rank, rem, recvbuff, size), ret, exit);
+exit:
+  free(tmpbuff);
+  return ret;
+}
+
+flagcxResult_t bootstrapRingReduce(void* commState, struct bootstrapRingLink* prev, struct bootstrapRingLink* next, int rank, int nranks,
   const char* sendbuff, char* recvbuff, size_t count, flagcxDataType_t datatype, flagcxRedOp_t op, int root) {
 
   // The ring algorithm works as follows.
@@ -686,7 +1044,7 @@ flagcxResult_t bootstrapRingReduce(void* commState, struct flagcxSocket* prevSoc
   }
 
   // step 2: reduce scatter
-  FLAGCXCHECK(bootstrapRingReduceScatter(prevSocket, nextSocket, rank, nranks, sendbuff, recvbuff + offset[rank], offset.data(), length.data(), datatype, op));
+  FLAGCXCHECK(bootstrapRingReduceScatter(prev, next, rank, nranks, sendbuff, recvbuff + offset[rank], offset.data(), length.data(), datatype, op));
 
   // step 3: gather
   const int bootstrapTag = -9993;
@@ -714,8 +1072,27 @@ flagcxResult_t AllReduceBootstrap(void* commState, const void* sendbuff, void* r
     }
     return flagcxSuccess;
   }
-  FLAGCXCHECK(bootstrapRingAllReduce(&state->ringRecvSocket, &state->ringSendSocket, rank, nranks,
-                                    (char*)sendbuff, (char*)recvbuff, count, datatype, op));
+
+  // Recursive doubling below FLAGCX_BOOTSTRAP_ALLREDUCE_RD_THRESHOLD bytes, Rabenseifner below
+  // FLAGCX_BOOTSTRAP_ALLREDUCE_RABENSEIFNER_THRESHOLD bytes, ring above. Rabenseifner needs at least
+  // one element per block, smaller messages use recursive doubling.
+  size_t size = count * getFlagcxDataTypeSize(datatype);
+  int pof2 = 1;
+  while (pof2 * 2 <= nranks) pof2 *= 2;
+  if (size < (size_t)flagcxParamBootstrapAllReduceRdThreshold() ||
+      (size < (size_t)flagcxParamBootstrapAllReduceRabenseifnerThreshold() && count < (size_t)pof2)) {
+    TRACE(FLAGCX_COLL, "rank %d nranks %d size %zu: recursive doubling allreduce", rank, nranks, size);
+    FLAGCXCHECK(bootstrapRecursiveDoublingAllReduce(commState, rank, nranks, (char*)sendbuff, (char*)recvbuff, count,
+                                                    datatype, op));
+  } else if (size < (size_t)flagcxParamBootstrapAllReduceRabenseifnerThreshold()) {
+    TRACE(FLAGCX_COLL, "rank %d nranks %d size %zu: Rabenseifner allreduce", rank, nranks, size);
+    FLAGCXCHECK(bootstrapRabenseifnerAllReduce(commState, rank, nranks, (char*)sendbuff, (char*)recvbuff, count,
+                                               datatype, op));
+  } else {
+    TRACE(FLAGCX_COLL, "rank %d nranks %d size %zu: ring allreduce", rank, nranks, size);
+    FLAGCXCHECK(bootstrapRingAllReduce(&state->ringRecv, &state->ringSend, rank, nranks,
+                                      (char*)sendbuff, (char*)recvbuff, count, datatype, op));
+  }
 
   return flagcxSuccess;
 }
@@ -732,7 +1109,7 @@ flagcxResult_t ReduceBootstrap(void* commState, const void* sendbuff, void* recv
     }
     return flagcxSuccess;
   }
-  FLAGCXCHECK(bootstrapRingReduce(commState, &state->ringRecvSocket, &state->ringSendSocket, rank, nranks,
+  FLAGCXCHECK(bootstrapRingReduce(commState, &state->ringRecv, &state->ringSend, rank, nranks,
       (char*)sendbuff, (char*)recvbuff, count, datatype, op, root));
   return flagcxSuccess;
 }
@@ -755,56 +1132,380 @@ flagcxResult_t ReduceScatterBootstrap(void* commState, const void* sendbuff, voi
       offset[i] = i * recvcount * getFlagcxDataTypeSize(datatype);
       length[i] = recvcount * getFlagcxDataTypeSize(datatype);
     }
-    FLAGCXCHECK(bootstrapRingReduceScatter(&state->ringRecvSocket, &state->ringSendSocket, rank, nranks,
+    FLAGCXCHECK(bootstrapRingReduceScatter(&state->ringRecv, &state->ringSend, rank, nranks,
                                          (char*)sendbuff, (char*)recvbuff, offset.data(), length.data(),
                                          datatype, op));
     return flagcxSuccess;
   }
 
+// Number of peer exchanges AlltoAllBootstrap keeps in flight.
+FLAGCX_PARAM(BootstrapAlltoAllWindow, "BOOTSTRAP_ALLTOALL_WINDOW", 8);
+
+struct bootstrapAlltoAllSlot {
+  int peer;
+  struct flagcxSocket sendSock;
+  struct flagcxSocket recvSock;
+  bool recvConnected;
+  size_t sendOffset;
+  size_t recvOffset;
+  char* recvData;
+};
+
+/*
+ * Every rank exchanges with one peer per step, peer = (step - rank) mod nranks, which pairs the
+ * ranks in both directions and visits every peer once. Up to FLAGCX_BOOTSTRAP_ALLTOALL_WINDOW
+ * steps are in flight; all their sockets are driven together with poll(), and a new step starts
+ * as soon as one completes. Incoming connections are picked up from the listen socket without
+ * blocking, so a rank waiting for a slow peer keeps serving the others.
+ *
+ * Since both directions of a step concern the same block, in-place mode only needs one scratch
+ * block per slot: the received block is copied into place once the outgoing one has been sent.
+ */
 flagcxResult_t AlltoAllBootstrap(void* commState, const void* sendbuff, void* recvbuff, size_t count,
                                  flagcxDataType_t datatype) {
   struct bootstrapState* state = (struct bootstrapState*)commState;
   int rank = state->rank;
   int nranks = state->nranks;
   size_t size = count * getFlagcxDataTypeSize(datatype);
+  const int bootstrapTag = -9991;
 
   bool inPlace = (sendbuff == recvbuff);
-  char *tmpBuff = nullptr;
+  if (!inPlace) {
+    memcpy((char*)recvbuff + size * rank, (const char*)sendbuff + size * rank, size);
+  }
+  if (nranks == 1 || size == 0) return flagcxSuccess;
+
+  flagcxResult_t ret = flagcxSuccess;
+  int window = std::max(1, std::min((int)flagcxParamBootstrapAlltoAllWindow(), nranks - 1));
+  std::vector<struct bootstrapAlltoAllSlot> slots(window);
+  std::vector<struct pollfd> pfds;
+  std::vector<int> pfdSlot;
+  char* scratch = nullptr;
   if (inPlace) {
-      FLAGCXCHECK(flagcxCalloc(&tmpBuff, size));
+    FLAGCXCHECK(flagcxCalloc(&scratch, window * size));
   }
+  for (int i = 0; i < window; i++) slots[i].peer = -1;
+
+  int step = 0, active = 0, done = 0;
+  while (done < nranks - 1) {
+    // Start new exchanges in free slots.
+    for (int i = 0; i < window && active < window && step < nranks; i++) {
+      if (slots[i].peer != -1) continue;
+      int peer = (step - rank + nranks) % nranks;
+      step++;
+      if (peer == rank) {
+        i--;
+        continue;
+      }
+      struct bootstrapAlltoAllSlot* slot = &slots[i];
+      slot->peer = peer;
+      slot->recvConnected = false;
+      slot->sendOffset = slot->recvOffset = 0;
+      slot->recvData = inPlace ? scratch + i * size : (char*)recvbuff + size * peer;
+      FLAGCXCHECKGOTO(bootstrapConnect(commState, peer, bootstrapTag, &slot->sendSock), ret, exit);
+      active++;
+    }
 
-  for (int i = 0; i < nranks; ++i) {
-    if (i == rank) {
-      if (!inPlace) {
-        memcpy((void *)((char*)recvbuff + size * i), (void *)((char *)sendbuff + size * i), size);
+    // Match connections that have already been accepted.
+    bool needAccept = false;
+    for (int i = 0; i < window; i++) {
+      struct bootstrapAlltoAllSlot* slot = &slots[i];
+      if (slot->peer == -1 || slot->recvConnected) continue;
+      int found;
+      FLAGCXCHECKGOTO(unexpectedDequeue(state, slot->peer, bootstrapTag, &slot->recvSock, &found), ret, exit);
+      slot->recvConnected = found;
+      if (!found) needAccept = true;
+    }
+
+    pfds.clear();
+    pfdSlot.clear();
+    if (needAccept) {
+      pfds.push_back({state->listenSock.fd, POLLIN, 0});
+      pfdSlot.push_back(-1);
+    }
+    for (int i = 0; i < window; i++) {
+      struct bootstrapAlltoAllSlot* slot = &slots[i];
+      if (slot->peer == -1) continue;
+      if (slot->sendOffset < size) {
+        pfds.push_back({slot->sendSock.fd, POLLOUT, 0});
+        pfdSlot.push_back(i);
+      }
+      if (slot->recvConnected && slot->recvOffset < size) {
+        pfds.push_back({slot->recvSock.fd, POLLIN, 0});
+        pfdSlot.push_back(i);
       }
     }
-    const int bootstrapTag = -9991;
-    if (rank > i) {
-      FLAGCXCHECK(bootstrapSend(commState, i, bootstrapTag, (void *)((char *)sendbuff + size * i), size));
-      if (inPlace) {
-        FLAGCXCHECK(bootstrapRecv(commState, i, bootstrapTag, (void *)tmpBuff, size));
-        memcpy((void *)((char *)recvbuff + size * i), (void *)tmpBuff, size);
+    if (__atomic_load_n(state->abortFlag, __ATOMIC_RELAXED)) {
+      ret = flagcxInternalError;
+      goto exit;
+    }
+    if (poll(pfds.data(), pfds.size(), 100) < 0) {
+      if (errno == EINTR) continue;
+      WARN("AlltoAllBootstrap: poll failed: %s", strerror(errno));
+      ret = flagcxSystemError;
+      goto exit;
+    }
+
+    for (size_t p = 0; p < pfds.size(); p++) {
+      if (pfds[p].revents == 0) continue;
+      int i = pfdSlot[p];
+      if (i == -1) {
+        // A peer connected: read its (rank, tag) and queue it until its slot claims it.
+        struct flagcxSocket sock;
+        int newPeer, newTag;
+        FLAGCXCHECKGOTO(flagcxSocketInit(&sock), ret, exit);
+        FLAGCXCHECKGOTO(flagcxSocketAccept(&sock, &state->listenSock), ret, exit);
+        FLAGCXCHECKGOTO(bootstrapNetRecv(&sock, &newPeer, sizeof(int)), ret, exit);
+        FLAGCXCHECKGOTO(bootstrapNetRecv(&sock, &newTag, sizeof(int)), ret, exit);
+        FLAGCXCHECKGOTO(unexpectedEnqueue(state, newPeer, newTag, &sock), ret, exit);
+      } else if (pfds[p].fd == slots[i].sendSock.fd) {
+        FLAGCXCHECKGOTO(flagcxSocketProgress(FLAGCX_SOCKET_SEND, &slots[i].sendSock,
+                                             (char*)sendbuff + size * slots[i].peer, size, &slots[i].sendOffset),
+                        ret, exit);
       } else {
-        FLAGCXCHECK(bootstrapRecv(commState, i, bootstrapTag, (void *)((char *)recvbuff + size * i), size));
+        FLAGCXCHECKGOTO(flagcxSocketProgress(FLAGCX_SOCKET_RECV, &slots[i].recvSock, slots[i].recvData, size,
+                                             &slots[i].recvOffset),
+                        ret, exit);
       }
-    } else if (rank < i) {
-      if (inPlace) {
-        FLAGCXCHECK(bootstrapRecv(commState, i, bootstrapTag, (void *)tmpBuff, size));
-      } else {
-        FLAGCXCHECK(bootstrapRecv(commState, i, bootstrapTag, (void *)((char *)recvbuff + size * i), size));
+    }
+
+    // Retire finished exchanges.
+    for (int i = 0; i < window; i++) {
+      struct bootstrapAlltoAllSlot* slot = &slots[i];
+      if (slot->peer == -1 || slot->sendOffset < size || !slot->recvConnected || slot->recvOffset < size) continue;
+      if (inPlace) memcpy((char*)recvbuff + size * slot->peer, slot->recvData, size);
+      FLAGCXCHECKGOTO(flagcxSocketClose(&slot->sendSock), ret, exit);
+      FLAGCXCHECKGOTO(flagcxSocketClose(&slot->recvSock), ret, exit);
+      slot->peer = -1;
+      active--;
+      done++;
+    }
+  }
+
+exit:
+  if (ret != flagcxSuccess) {
+    for (int i = 0; i < window; i++) {
+      if (slots[i].peer == -1) continue;
+      flagcxSocketClose(&slots[i].sendSock);
+      if (slots[i].recvConnected) flagcxSocketClose(&slots[i].recvSock);
+    }
+  }
+  free(scratch);
+  return ret;
+}
+
+// Messages up to this size (in bytes) are broadcast along a binomial tree, larger ones are
+// pipelined along the ring.
+FLAGCX_PARAM(BootstrapBcastPipelineThreshold, "BOOTSTRAP_BCAST_PIPELINE_THRESHOLD", 1 << 16);
+
+// Number of blocks held by the subtree of relative rank vr in a binomial tree rooted at 0.
+static int binomialSubtreeSize(int vr, int nranks) {
+  if (vr == 0) return nranks;
+  return std::min(vr & -vr, nranks - vr);
+}
+
+flagcxResult_t BroadcastBootstrap(void* commState, const void* sendbuff, void* recvbuff, size_t count,
+                                  flagcxDataType_t datatype, int root) {
+  struct bootstrapState* state = (struct bootstrapState*)commState;
+  int rank = state->rank;
+  int nranks = state->nranks;
+  size_t size = count * getFlagcxDataTypeSize(datatype);
+  if (rank == root && sendbuff != recvbuff) {
+    memcpy(recvbuff, sendbuff, size);
+  }
+  if (nranks == 1 || size == 0) return flagcxSuccess;
+
+  if (size <= (size_t)flagcxParamBootstrapBcastPipelineThreshold()) {
+    // Binomial tree: log2(nranks) rounds, each rank forwards to its children after it received.
+    const int bootstrapTag = -9998;
+    int vr = (rank - root + nranks) % nranks;
+    int mask = 1;
+    while (mask < nranks) {
+      if (vr & mask) {
+        FLAGCXCHECK(bootstrapRecv(commState, (vr - mask + root) % nranks, bootstrapTag, recvbuff, size));
+        break;
       }
-      FLAGCXCHECK(bootstrapSend(commState, i, bootstrapTag, (void *)((char *)sendbuff + size * i), size));
-      if (inPlace) {
-        memcpy((void *)((char *)recvbuff + size * i), (void *)tmpBuff, size);
+      mask <<= 1;
+    }
+    for (mask >>= 1; mask > 0; mask >>= 1) {
+      if (vr + mask < nranks) {
+        FLAGCXCHECK(bootstrapSend(commState, (vr + mask + root) % nranks, bootstrapTag, recvbuff, size));
       }
     }
+    return flagcxSuccess;
+  }
+
+  // Pipelined chain along the ring, starting at root: every rank forwards to next whatever it has
+  // already received from prev, so the message crosses all links concurrently.
+  bool isLast = (rank == (root + nranks - 1) % nranks);
+  struct bootstrapRingCursor recvCursor, sendCursor;
+  bootstrapRingCursorReset(&recvCursor);
+  bootstrapRingCursorReset(&sendCursor);
+  if (rank == root) recvCursor.offset = size;
+  if (isLast) sendCursor.offset = size;
+  while (recvCursor.offset < size || sendCursor.offset < size) {
+    if (recvCursor.offset < size) {
+      FLAGCXCHECK(bootstrapRingProgress(FLAGCX_SOCKET_RECV, &state->ringRecv, (char*)recvbuff, size, size, &recvCursor));
+    }
+    if (sendCursor.offset < recvCursor.offset) {
+      FLAGCXCHECK(bootstrapRingProgress(FLAGCX_SOCKET_SEND, &state->ringSend, (char*)recvbuff, size, recvCursor.offset, &sendCursor));
+    }
   }
-  free(tmpBuff);
   return flagcxSuccess;
 }
 
+flagcxResult_t GatherBootstrap(void* commState, const void* sendbuff, void* recvbuff, size_t count,
+                               flagcxDataType_t datatype, int root) {
+  struct bootstrapState* state = (struct bootstrapState*)commState;
+  int rank = state->rank;
+  int nranks = state->nranks;
+  size_t size = count * getFlagcxDataTypeSize(datatype);
+  if (nranks == 1 || size == 0) {
+    if (rank == root && sendbuff != (char*)recvbuff + rank * size) memcpy((char*)recvbuff + rank * size, sendbuff, size);
+    return flagcxSuccess;
+  }
+
+  // Binomial tree: every rank collects the blocks of its subtree, ordered by relative rank, and
+  // hands them to its parent in one message. Leaves send straight from sendbuff and a root 0
+  // collects straight into recvbuff.
+  const int bootstrapTag = -9999;
+  flagcxResult_t ret = flagcxSuccess;
+  int vr = (rank - root + nranks) % nranks;
+  int blocks = binomialSubtreeSize(vr, nranks);
+  char* tmpbuff = nullptr;
+  char* data = (char*)sendbuff;
+  if (root == 0 && rank == 0) {
+    data = (char*)recvbuff;
+  } else if (blocks > 1) {
+    FLAGCXCHECK(flagcxCalloc(&tmpbuff, blocks * size));
+    data = tmpbuff;
+  }
+  if (data != sendbuff) memcpy(data, sendbuff, size);
+
+  for (int mask = 1; mask < nranks; mask <<= 1) {
+    if (vr & mask) {
+      FLAGCXCHECKGOTO(bootstrapSend(commState, (vr - mask + root) % nranks, bootstrapTag, data, blocks * size), ret, exit);
+      break;
+    }
+    if (vr + mask < nranks) {
+      int child = vr + mask;
+      FLAGCXCHECKGOTO(bootstrapRecv(commState, (child + root) % nranks, bootstrapTag, data + mask * size,
+                                    binomialSubtreeSize(child, nranks) * size), ret, exit);
+    }
+  }
+
+  // Rotate relative order back to rank order.
+  if (rank == root && data != recvbuff) {
+    for (int i = 0; i < nranks; i++) {
+      memcpy((char*)recvbuff + ((i + root) % nranks) * size, data + i * size, size);
+    }
+  }
+exit:
+  free(tmpbuff);
+  return ret;
+}
+
+flagcxResult_t ScatterBootstrap(void* commState, const void* sendbuff, void* recvbuff, size_t count,
+                                flagcxDataType_t datatype, int root) {
+  struct bootstrapState* state = (struct bootstrapState*)commState;
+  int rank = state->rank;
+  int nranks = state->nranks;
+  size_t size = count * getFlagcxDataTypeSize(datatype);
+  if (nranks == 1 || size == 0) {
+    if (rank == root && (char*)sendbuff + rank * size != recvbuff) memcpy(recvbuff, (char*)sendbuff + rank * size, size);
+    return flagcxSuccess;
+  }
+
+  // Binomial tree: every rank receives the blocks of its subtree, ordered by relative rank, from
+  // its parent and passes the halves on to its children. Leaves receive straight into recvbuff
+  // and a root 0 sends straight from sendbuff.
+  const int bootstrapTag = -10000;
+  flagcxResult_t ret = flagcxSuccess;
+  int vr = (rank - root + nranks) % nranks;
+  int blocks = binomialSubtreeSize(vr, nranks);
+  char* tmpbuff = nullptr;
+  char* data = (char*)recvbuff;
+  if (root == 0 && rank == 0) {
+    data = (char*)sendbuff;
+  } else if (blocks > 1) {
+    FLAGCXCHECK(flagcxCalloc(&tmpbuff, blocks * size));
+    data = tmpbuff;
+    if (rank == root) {
+      for (int i = 0; i < nranks; i++) {
+        memcpy(data + i * size, (char*)sendbuff + ((i + root) % nranks) * size, size);
+      }
+    }
+  }
+
+  int mask = 1;
+  while (mask < nranks) {
+    if (vr & mask) {
+      FLAGCXCHECKGOTO(bootstrapRecv(commState, (vr - mask + root) % nranks, bootstrapTag, data, blocks * size), ret, exit);
+      break;
+    }
+    mask <<= 1;
+  }
+  for (mask >>= 1; mask > 0; mask >>= 1) {
+    if (vr + mask < nranks) {
+      int child = vr + mask;
+      FLAGCXCHECKGOTO(bootstrapSend(commState, (child + root) % nranks, bootstrapTag, data + mask * size,
+                                    binomialSubtreeSize(child, nranks) * size), ret, exit);
+    }
+  }
+  if (data != recvbuff) memcpy(recvbuff, data, size);
+exit:
+  free(tmpbuff);
+  return ret;
+}
+
+flagcxResult_t AlltoAllvBootstrap(void* commState, const void* sendbuff, size_t* sendcounts, size_t* sdispls,
+                                  void* recvbuff, size_t* recvcounts, size_t* rdispls, flagcxDataType_t datatype) {
+  struct bootstrapState* state = (struct bootstrapState*)commState;
+  int rank = state->rank;
+  int nranks = state->nranks;
+  size_t typeSize = getFlagcxDataTypeSize(datatype);
+  const int bootstrapTag = -10001;
+  flagcxResult_t ret = flagcxSuccess;
+
+  // In-place operation: keep a copy of the send extents, they may be overwritten by receives.
+  char* tmpbuff = nullptr;
+  const char* src = (const char*)sendbuff;
+  if (sendbuff == recvbuff) {
+    size_t extent = 0;
+    for (int i = 0; i < nranks; i++) {
+      if (sendcounts[i] > 0) extent = std::max(extent, (sdispls[i] + sendcounts[i]) * typeSize);
+    }
+    FLAGCXCHECK(flagcxCalloc(&tmpbuff, extent));
+    memcpy(tmpbuff, sendbuff, extent);
+    src = tmpbuff;
+  }
+  if (src + sdispls[rank] * typeSize != (char*)recvbuff + rdispls[rank] * typeSize) {
+    memcpy((char*)recvbuff + rdispls[rank] * typeSize, src + sdispls[rank] * typeSize, sendcounts[rank] * typeSize);
+  }
+
+  // Pairwise exchange: in step k every rank sends to rank+k and receives from rank-k, so each
+  // rank talks to exactly one sender and one receiver at a time. Zero-sized messages are skipped,
+  // the peer knows not to expect them from its own counts.
+  for (int k = 1; k < nranks; k++) {
+    int sendPeer = (rank + k) % nranks;
+    int recvPeer = (rank - k + nranks) % nranks;
+    size_t sendSize = sendcounts[sendPeer] * typeSize;
+    size_t recvSize = recvcounts[recvPeer] * typeSize;
+    void* sendData = (void*)(src + sdispls[sendPeer] * typeSize);
+    void* recvData = (char*)recvbuff + rdispls[recvPeer] * typeSize;
+    if (sendSize > 0 && recvSize > 0) {
+      FLAGCXCHECKGOTO(bootstrapSendRecv(commState, sendPeer, recvPeer, bootstrapTag, sendData, sendSize, recvData, recvSize), ret, exit);
+    } else if (sendSize > 0) {
+      FLAGCXCHECKGOTO(bootstrapSend(commState, sendPeer, bootstrapTag, sendData, sendSize), ret, exit);
+    } else if (recvSize > 0) {
+      FLAGCXCHECKGOTO(bootstrapRecv(commState, recvPeer, bootstrapTag, recvData, recvSize), ret, exit);
+    }
+  }
+exit:
+  free(tmpbuff);
+  return ret;
+}
+
 flagcxResult_t bootstrapIntraNodeBarrier(void* commState, int *ranks, int rank, int nranks, int tag) {
   if (nranks == 1) return flagcxSuccess;
   TRACE(FLAGCX_INIT, "rank %d nranks %d tag %x - ENTER", rank, nranks, tag);
@@ -831,9 +1532,9 @@ flagcxResult_t bootstrapBarrier(void* commState, int rank, int nranks, int tag)
 }
 
 // [IntraNode] in-place Broadcast
-flagcxResult_t bootstrapIntraNodeBroadcast(void* commState, int *ranks, int rank, int nranks, int root, void* bcastData, int size) {
+flagcxResult_t bootstrapIntraNodeBroadcast(void* commState, int *ranks, int rank, int nranks, int root, void* bcastData, size_t size) {
   if (nranks == 1) return flagcxSuccess;
-  TRACE(FLAGCX_INIT, "rank %d nranks %d root %d size %d - ENTER", rank, nranks, root, size);
+  TRACE(FLAGCX_INIT, "rank %d nranks %d root %d size %zu - ENTER", rank, nranks, root, size);
 
   if (rank == root) {
     for (int i=0; i<nranks; i++) {
@@ -844,11 +1545,11 @@ flagcxResult_t bootstrapIntraNodeBroadcast(void* commState, int *ranks, int rank
     FLAGCXCHECK(bootstrapRecv(commState, ranks ? ranks[root] : root, /*tag=*/ranks ? ranks[rank] : rank, bcastData, size));
   }
 
-  TRACE(FLAGCX_INIT, "rank %d nranks %d root %d size %d - DONE", rank, nranks, root, size);
+  TRACE(FLAGCX_INIT, "rank %d nranks %d root %d size %zu - DONE", rank, nranks, root, size);
   return flagcxSuccess;
 }
 
-flagcxResult_t bootstrapBroadcast(void* commState, int rank, int nranks, int root, void* bcastData, int size) {
+flagcxResult_t bootstrapBroadcast(void* commState, int rank, int nranks, int root, void* bcastData, size_t size) {
   return bootstrapIntraNodeBroadcast(commState, NULL, rank, nranks, root, bcastData, size);
 }
 
@@ -863,8 +1564,8 @@ flagcxResult_t bootstrapClose(void* commState) {
   }
 
   FLAGCXCHECK(flagcxSocketClose(&state->listenSock));
-  FLAGCXCHECK(flagcxSocketClose(&state->ringSendSocket));
-  FLAGCXCHECK(flagcxSocketClose(&state->ringRecvSocket));
+  FLAGCXCHECK(bootstrapRingClose(&state->ringSend));
+  FLAGCXCHECK(bootstrapRingClose(&state->ringRecv));
 
   free(state->peerCommAddresses);
   free(state);
@@ -876,8 +1577,8 @@ flagcxResult_t bootstrapAbort(void* commState) {
   struct bootstrapState* state = (struct bootstrapState*)commState;
   if (commState == NULL) return flagcxSuccess;
   FLAGCXCHECK(flagcxSocketClose(&state->listenSock));
-  FLAGCXCHECK(flagcxSocketClose(&state->ringSendSocket));
-  FLAGCXCHECK(flagcxSocketClose(&state->ringRecvSocket));
+  FLAGCXCHECK(bootstrapRingClose(&state->ringSend));
+  FLAGCXCHECK(bootstrapRingClose(&state->ringRecv));
   free(state->peerCommAddresses);
   free(state->peerProxyAddresses);
   free(state);
@@ -20,10 +20,20 @@ struct flagcxBootstrapHandle {
 };
 static_assert(sizeof(struct flagcxBootstrapHandle) <= sizeof(flagcxUniqueId), "Bootstrap handle is too large to fit inside FLAGCX unique ID");
 
+#define BOOTSTRAP_RING_MAX_STREAMS 8
+
+// Connection to a neighbour in the bootstrap ring. Large transfers are cut into
+// stripeSize segments, segment j travels on socks[j % nStreams].
+struct bootstrapRingLink {
+  int nStreams;
+  size_t stripeSize;
+  struct flagcxSocket socks[BOOTSTRAP_RING_MAX_STREAMS];
+};
+
 struct bootstrapState {
   struct flagcxSocket listenSock;
-  struct flagcxSocket ringRecvSocket;
-  struct flagcxSocket ringSendSocket;
+  struct bootstrapRingLink ringRecv;
+  struct bootstrapRingLink ringSend;
   union flagcxSocketAddress* peerCommAddresses;
   union flagcxSocketAddress* peerProxyAddresses;
   struct unexConn* unexpectedConnections;
@@ -37,14 +47,14 @@ flagcxResult_t bootstrapNetInit();
 flagcxResult_t bootstrapCreateRoot(struct flagcxBootstrapHandle* handle, bool idFromEnv);
 flagcxResult_t bootstrapGetUniqueId(struct flagcxBootstrapHandle* handle);
 flagcxResult_t bootstrapInit(struct flagcxBootstrapHandle* handle, void* commState);
-flagcxResult_t bootstrapAllGather(void* commState, void* allData, int size);
+flagcxResult_t bootstrapAllGather(void* commState, void* allData, size_t size);
 
-flagcxResult_t bootstrapSend(void* commState, int peer, int tag, void* data, int size);
-flagcxResult_t bootstrapRecv(void* commState, int peer, int tag, void* data, int size);
+flagcxResult_t bootstrapSend(void* commState, int peer, int tag, void* data, size_t size);
+flagcxResult_t bootstrapRecv(void* commState, int peer, int tag, void* data, size_t size);
 flagcxResult_t bootstrapBarrier(void* commState, int rank, int nranks, int tag);
-flagcxResult_t bootstrapBroadcast(void* commState, int rank, int nranks, int root, void* bcastData, int size);
+flagcxResult_t bootstrapBroadcast(void* commState, int rank, int nranks, int root, void* bcastData, size_t size);
 flagcxResult_t bootstrapIntraNodeBarrier(void* commState, int *ranks, int rank, int nranks, int tag);
-flagcxResult_t bootstrapIntraNodeBroadcast(void* commState, int *ranks, int rank, int nranks, int root, void* bcastData, int size);
+flagcxResult_t bootstrapIntraNodeBroadcast(void* commState, int *ranks, int rank, int nranks, int root, void* bcastData, size_t size);
 flagcxResult_t bootstrapClose(void* commState);
 flagcxResult_t bootstrapAbort(void* commState);
 
@@ -107,6 +117,48 @@ flagcxResult_t ReduceScatterBootstrap(void* commState, const void* sendbuff, voi
  */
 flagcxResult_t AlltoAllBootstrap(void* commState, const void* sendbuff, void* recvbuff, size_t count,
                                  flagcxDataType_t datatype);
+/*
+ * Broadcast
+ *
+ * Copies count values from sendbuff on root to recvbuff on all ranks. Small
+ * messages travel along a binomial tree, large ones are pipelined along the
+ * bootstrap ring.
+ *
+ * In-place operation will happen if sendbuff == recvbuff.
+ */
+flagcxResult_t BroadcastBootstrap(void* commState, const void* sendbuff, void* recvbuff, size_t count,
+                                  flagcxDataType_t datatype, int root);
+/*
+ * Gather
+ *
+ * Root receives count values from rank i at offset i*count of recvbuff, which
+ * should have a size of at least nranks*count elements. Binomial tree.
+ *
+ * In-place operation will happen if sendbuff == recvbuff + root * count.
+ */
+flagcxResult_t GatherBootstrap(void* commState, const void* sendbuff, void* recvbuff, size_t count,
+                               flagcxDataType_t datatype, int root);
+/*
+ * Scatter
+ *
+ * Root sends the i-th block of count values of sendbuff to rank i. Binomial
+ * tree.
+ *
+ * In-place operation will happen if recvbuff == sendbuff + root * count.
+ */
+flagcxResult_t ScatterBootstrap(void* commState, const void* sendbuff, void* recvbuff, size_t count,
+                                flagcxDataType_t datatype, int root);
+/*
+ * All-to-allv
+ *
+ * Every rank sends sendcounts[j] values at offset sdispls[j] of sendbuff to
+ * rank j, and receives recvcounts[j] values from rank j at offset rdispls[j]
+ * of recvbuff. Counts and displacements are in elements. Pairwise exchange.
+ *
+ * In-place operations will happen if sendbuff == recvbuff.
+ */
+flagcxResult_t AlltoAllvBootstrap(void* commState, const void* sendbuff, size_t* sendcounts, size_t* sdispls,
+                                  void* recvbuff, size_t* recvcounts, size_t* rdispls, flagcxDataType_t datatype);
 #ifdef __cplusplus
 } // end extern "C"
 #endif
@@ -0,0 +1,181 @@
+#include "compress.h"
+#include "debug.h"
+#include "float_convert.h"
+#include "param.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+// Largest finite E4M3 value
+#define FLAGCX_FP8_MAX 448.0f
+
+flagcxCodec_t flagcxCodecFromEnv() {
+  const char *env = flagcxGetEnv("FLAGCX_C2C_COMPRESS");
+  if (env == NULL || env[0] == '\0' || strcasecmp(env, "none") == 0)
+    return flagcxCodecNone;
+  for (int codec = flagcxCodecBf16; codec < flagcxCodecNum; codec++) {
+    if (strcasecmp(env, flagcxCodecToString((flagcxCodec_t)codec)) == 0)
+      return (flagcxCodec_t)codec;
+  }
+  WARN("Unknown FLAGCX_C2C_COMPRESS value %s, compression disabled", env);
+  return flagcxCodecNone;
+}
+
+const char *flagcxCodecToString(flagcxCodec_t codec) {
+  switch (codec) {
+  case flagcxCodecBf16:
+    return "bf16";
+  case flagcxCodecFp16:
+    return "fp16";
+  case flagcxCodecFp8:
+    return "fp8";
+  default:
+    return "none";
+  }
+}
+
+size_t flagcxCodecEncodedSize(flagcxCodec_t codec, size_t count) {
+  switch (codec) {
+  case flagcxCodecBf16:
+  case flagcxCodecFp16:
+    return count * sizeof(uint16_t);
+  case flagcxCodecFp8:
+    return (count + FLAGCX_CODEC_FP8_BLOCK - 1) / FLAGCX_CODEC_FP8_BLOCK *
+               sizeof(float) +
+           count;
+  default:
+    return count * sizeof(float);
+  }
+}
+
+/* E4M3 (no infinities, 0x7f is nan) <-> fp32, rounding to nearest even and
+ * saturating to 448 */
+static inline uint8_t floatToE4m3(float f) {
+  uint32_t u;
+  memcpy(&u, &f, sizeof(u));
+  uint8_t sign = (u >> 24) & 0x80;
+  uint32_t a = u & 0x7fffffff;
+  if (a > 0x7f800000)
+    return sign | 0x7f;
+  if (a >= 0x3c800000) {
+    // normal: round the mantissa to 3 bits, a carry bumps the exponent
+    uint32_t r = (a + 0x7ffff + ((a >> 20) & 1)) >> 20;
+    uint32_t code = r - (120 << 3);
+    return sign | (code > 0x7e ? 0x7e : code);
+  }
+  // subnormal, multiples of 2^-9: the addition rounds to an integer
+  float t;
+  memcpy(&t, &a, sizeof(t));
+  t = t * 512.0f + 8388608.0f;
+  uint32_t bits;
+  memcpy(&bits, &t, sizeof(bits));
+  return sign | (bits - 0x4b000000);
+}
+
+struct fp8Table {
+  float values[256];
+  fp8Table() {
+    for (int code = 0; code < 256; code++) {
+      int exp = (code >> 3) & 0xf;
+      int mant = code & 0x7;
+      float v = exp == 0 ? ldexpf((float)mant, -9)
+                         : ldexpf(1.0f + mant / 8.0f, exp - 7);
+      if ((code & 0x7f) == 0x7f)
+        v = NAN;
+      values[code] = (code & 0x80) ? -v : v;
+    }
+  }
+};
+static const fp8Table e4m3ToFloat;
+
+static void encodeFp8(void *dst, const float *src, size_t count) {
+  size_t nblocks =
+      (count + FLAGCX_CODEC_FP8_BLOCK - 1) / FLAGCX_CODEC_FP8_BLOCK;
+  float *scales = (float *)dst;
+  uint8_t *codes = (uint8_t *)(scales + nblocks);
+  for (size_t b = 0; b < nblocks; b++) {
+    size_t begin = b * FLAGCX_CODEC_FP8_BLOCK;
+    size_t end = begin + FLAGCX_CODEC_FP8_BLOCK < count
+                     ? begin + FLAGCX_CODEC_FP8_BLOCK
+                     : count;
+    float amax = 0.0f;
+    for (size_t i = begin; i < end; i++) {
+      amax = fmaxf(amax, fabsf(src[i]));
+    }
+    // smallest power of two that brings the block within range, so that
+    // scaling is exact and decoded data encodes to the same values again;
+    // blocks of zeros (or tiny values) and non-finite maxima keep a neutral
+    // scale, whose inverse stays finite
+    float scale = amax / FLAGCX_FP8_MAX;
+    if (!(scale >= FLT_MIN) || !isfinite(scale)) {
+      scale = 1.0f;
+    } else {
+      int exp;
+      float mant = frexpf(scale, &exp);
+      scale = ldexpf(1.0f, mant == 0.5f ? exp - 1 : exp);
+    }
+    float inv = 1.0f / scale;
+    scales[b] = scale;
+    for (size_t i = begin; i < end; i++) {
+      codes[i] = floatToE4m3(src[i] * inv);
+    }
+  }
+}
+
+static void decodeFp8(float *dst, const void *src, size_t count) {
+  size_t nblocks =
+      (count + FLAGCX_CODEC_FP8_BLOCK - 1) / FLAGCX_CODEC_FP8_BLOCK;
+  const float *scales = (const float *)src;
+  const uint8_t *codes = (const uint8_t *)(scales + nblocks);
+  for (size_t i = 0; i < count; i++) {
+    dst[i] =
+        e4m3ToFloat.values[codes[i]] * scales[i / FLAGCX_CODEC_FP8_BLOCK];
+  }
+}
+
+void flagcxCodecEncode(flagcxCodec_t codec, void *dst, const float *src,
+                       size_t count) {
+  uint16_t *d16 = (uint16_t *)dst;
+  switch (codec) {
+  case flagcxCodecBf16:
+    for (size_t i = 0; i < count; i++) {
+      d16[i] = floatToBf16(src[i]);
+    }
+    break;
+  case flagcxCodecFp16:
+    for (size_t i = 0; i < count; i++) {
+      d16[i] = floatToHalf(src[i]);
+    }
+    break;
+  case flagcxCodecFp8:
+    encodeFp8(dst, src, count);
+    break;
+  default:
+    memcpy(dst, src, count * sizeof(float));
+  }
+}
+
+void flagcxCodecDecode(flagcxCodec_t codec, float *dst, const void *src,
+                       size_t count) {
+  const uint16_t *s16 = (const uint16_t *)src;
+  switch (codec) {
+  case flagcxCodecBf16:
+    for (size_t i = 0; i < count; i++) {
+      dst[i] = bf16ToFloat(s16[i]);
+    }
+    break;
+  case flagcxCodecFp16:
+    for (size_t i = 0; i < count; i++) {
+      dst[i] = halfToFloat(s16[i]);
+    }
+    break;
+  case flagcxCodecFp8:
+    decodeFp8(dst, src, count);
+    break;
+  default:
+    memcpy(dst, src, count * sizeof(float));
+  }
+}
@@ -0,0 +1,42 @@
+#ifndef FLAGCX_COMPRESS_H_
+#define FLAGCX_COMPRESS_H_
+
+#include <stddef.h>
+
+/*
+ * Lossy codecs of fp32 data for the inter-cluster transfers, selected with
+ * FLAGCX_C2C_COMPRESS (bf16, fp16 or fp8; unset: none), which has to be the
+ * same on all ranks.
+ *
+ * bf16 and fp16 round every element to nearest even (fp16 saturates to inf
+ * beyond 65504). fp8 stores E4M3 values scaled by the power of two that
+ * brings the largest magnitude of every block of FLAGCX_CODEC_FP8_BLOCK
+ * elements within range: the fp32 scales of all the blocks come first,
+ * followed by one byte per element. Decoding always produces fp32, so
+ * reductions keep accumulating in fp32. Encoding decoded data in the same
+ * messages gives back the same values, data forwarded by several ranks is
+ * only rounded once.
+ */
+typedef enum {
+  flagcxCodecNone = 0,
+  flagcxCodecBf16 = 1,
+  flagcxCodecFp16 = 2,
+  flagcxCodecFp8 = 3,
+  flagcxCodecNum = 4
+} flagcxCodec_t;
+
+#define FLAGCX_CODEC_FP8_BLOCK 128
+
+flagcxCodec_t flagcxCodecFromEnv();
+const char *flagcxCodecToString(flagcxCodec_t codec);
+
+// Bytes of count fp32 elements once encoded.
+size_t flagcxCodecEncodedSize(flagcxCodec_t codec, size_t count);
+
+// dst holds flagcxCodecEncodedSize(codec, count) bytes.
+void flagcxCodecEncode(flagcxCodec_t codec, void *dst, const float *src,
+                       size_t count);
+void flagcxCodecDecode(flagcxCodec_t codec, float *dst, const void *src,
+                       size_t count);
+
+#endif // end include guard
@@ -0,0 +1,84 @@
+#ifndef FLAGCX_FLOAT_CONVERT_H_
+#define FLAGCX_FLOAT_CONVERT_H_
+
+#include <stdint.h>
+#include <string.h>
+
+/* fp16/bf16 <-> fp32 conversions, rounding to nearest even */
+static inline float halfToFloat(uint16_t h) {
+  uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  uint32_t exp = (h >> 10) & 0x1f;
+  uint32_t mant = h & 0x3ff;
+  uint32_t bits;
+  if (exp == 0) {
+    if (mant == 0) {
+      bits = sign;
+    } else {
+      // subnormal half, normalize it
+      exp = 1;
+      while ((mant & 0x400) == 0) {
+        mant <<= 1;
+        exp--;
+      }
+      mant &= 0x3ff;
+      bits = sign | ((exp + 112) << 23) | (mant << 13);
+    }
+  } else if (exp == 0x1f) {
+    bits = sign | 0x7f800000 | (mant << 13);
+  } else {
+    bits = sign | ((exp + 112) << 23) | (mant << 13);
+  }
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+static inline uint16_t floatToHalf(float f) {
+  uint32_t u;
+  memcpy(&u, &f, sizeof(u));
+  uint16_t sign = (u >> 16) & 0x8000;
+  uint32_t mant = u & 0x7fffff;
+  if ((u & 0x7fffffff) >= 0x7f800000) {
+    // inf or nan, keep nan quiet
+    return sign | 0x7c00 | (mant ? 0x200 | (mant >> 13) : 0);
+  }
+  int exp = (int)((u >> 23) & 0xff) - 127 + 15;
+  if (exp >= 0x1f)
+    return sign | 0x7c00;
+  if (exp <= 0) {
+    if (exp < -10)
+      return sign;
+    mant |= 0x800000;
+    int shift = 14 - exp;
+    uint32_t half = mant >> shift;
+    uint32_t rem = mant & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if (rem > halfway || (rem == halfway && (half & 1)))
+      half++;
+    return sign | half;
+  }
+  uint16_t half = sign | (exp << 10) | (mant >> 13);
+  uint32_t rem = mant & 0x1fff;
+  // a carry out of the mantissa correctly bumps the exponent (up to inf)
+  if (rem > 0x1000 || (rem == 0x1000 && (half & 1)))
+    half++;
+  return half;
+}
+
+static inline float bf16ToFloat(uint16_t b) {
+  uint32_t bits = (uint32_t)b << 16;
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+static inline uint16_t floatToBf16(float f) {
+  uint32_t u;
+  memcpy(&u, &f, sizeof(u));
+  if ((u & 0x7fffffff) > 0x7f800000)
+    return (u >> 16) | 0x40;
+  u += 0x7fff + ((u >> 16) & 1);
+  return u >> 16;
+}
+
+#endif // end include guard
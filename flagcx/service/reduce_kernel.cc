@@ -0,0 +1,1069 @@
+#include "reduce_kernel.h"
+#include "check.h"
+#include "cpuset.h"
+#include "debug.h"
+#include "float_convert.h"
+#include "param.h"
+#include <algorithm>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FLAGCX_REDUCE_X86
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define FLAGCX_REDUCE_NEON
+#include <arm_neon.h>
+#endif
+
+// -1 selects the best instruction set of the CPU, otherwise one of
+// flagcxReduceIsa_t (e.g. 0 forces the scalar kernels).
+FLAGCX_PARAM(HostReduceIsa, "HOST_REDUCE_ISA", -1);
+
+typedef void (*flagcxReduceFn_t)(void *res, const void *op1, const void *op2,
+                                 size_t n);
+
+template <int OP>
+struct flagcxRedOpTag {};
+
+/* Element types: storage type S, computation type C */
+template <typename T>
+struct flagcxScalarType {
+  typedef T S;
+  typedef T C;
+  static inline C load(S v) { return v; }
+  static inline S store(C v) { return v; }
+};
+
+struct flagcxHalfType {
+  typedef uint16_t S;
+  typedef float C;
+  static inline C load(S v) { return halfToFloat(v); }
+  static inline S store(C v) { return floatToHalf(v); }
+};
+
+struct flagcxBf16Type {
+  typedef uint16_t S;
+  typedef float C;
+  static inline C load(S v) { return bf16ToFloat(v); }
+  static inline S store(C v) { return floatToBf16(v); }
+};
+
+template <typename C>
+static inline C scalarApply(C a, C b, flagcxRedOpTag<flagcxSum>) {
+  return a + b;
+}
+template <typename C>
+static inline C scalarApply(C a, C b, flagcxRedOpTag<flagcxProd>) {
+  return a * b;
+}
+// Same NaN behavior as the x86 max/min instructions: b is returned when
+// either operand is NaN.
+template <typename C>
+static inline C scalarApply(C a, C b, flagcxRedOpTag<flagcxMax>) {
+  return a > b ? a : b;
+}
+template <typename C>
+static inline C scalarApply(C a, C b, flagcxRedOpTag<flagcxMin>) {
+  return a < b ? a : b;
+}
+
+template <typename Ty, int OP>
+static void reduceScalar(void *res, const void *op1, const void *op2,
+                         size_t n) {
+  typedef typename Ty::S S;
+  typedef typename Ty::C C;
+  const S *a = (const S *)op1;
+  const S *b = (const S *)op2;
+  S *c = (S *)res;
+  for (size_t i = 0; i < n; i++) {
+    c[i] = Ty::store(
+        (C)scalarApply<C>(Ty::load(a[i]), Ty::load(b[i]), flagcxRedOpTag<OP>()));
+  }
+}
+
+#define REDUCE_SCALAR_OPS(Ty)                                                  \
+  (op == flagcxSum    ? reduceScalar<Ty, flagcxSum>                            \
+   : op == flagcxProd ? reduceScalar<Ty, flagcxProd>                           \
+   : op == flagcxMax  ? reduceScalar<Ty, flagcxMax>                            \
+                      : reduceScalar<Ty, flagcxMin>)
+
+static flagcxReduceFn_t scalarSelect(flagcxDataType_t datatype, int op) {
+  switch (datatype) {
+    case flagcxInt8:
+      return REDUCE_SCALAR_OPS(flagcxScalarType<int8_t>);
+    case flagcxUint8:
+      return REDUCE_SCALAR_OPS(flagcxScalarType<uint8_t>);
+    case flagcxInt32:
+      return REDUCE_SCALAR_OPS(flagcxScalarType<int32_t>);
+    case flagcxUint32:
+      return REDUCE_SCALAR_OPS(flagcxScalarType<uint32_t>);
+    case flagcxInt64:
+      return REDUCE_SCALAR_OPS(flagcxScalarType<int64_t>);
+    case flagcxUint64:
+      return REDUCE_SCALAR_OPS(flagcxScalarType<uint64_t>);
+    case flagcxFloat16:
+      return REDUCE_SCALAR_OPS(flagcxHalfType);
+    case flagcxFloat32:
+      return REDUCE_SCALAR_OPS(flagcxScalarType<float>);
+    case flagcxFloat64:
+      return REDUCE_SCALAR_OPS(flagcxScalarType<double>);
+    case flagcxBfloat16:
+      return REDUCE_SCALAR_OPS(flagcxBf16Type);
+    default:
+      return NULL;
+  }
+}
+
+/*
+ * Vector kernels. A vector type Vt provides the storage type S, the scalar
+ * type Ty used for the tail, the register type V with width elements,
+ * load/store and one apply() overload per supported reduction. The loop is
+ * stamped into every target region so that it is compiled for that ISA.
+ */
+#define REDUCE_VECTOR_LOOP                                                     \
+  template <typename Vt, int OP>                                               \
+  static void reduceVector(void *res, const void *op1, const void *op2,        \
+                           size_t n) {                                         \
+    typedef typename Vt::S S;                                                  \
+    const S *a = (const S *)op1;                                               \
+    const S *b = (const S *)op2;                                               \
+    S *c = (S *)res;                                                           \
+    size_t i = 0;                                                              \
+    for (; i + Vt::width <= n; i += Vt::width) {                               \
+      Vt::store(c + i, Vt::apply(Vt::load(a + i), Vt::load(b + i),             \
+                                 flagcxRedOpTag<OP>()));                       \
+    }                                                                          \
+    reduceScalar<typename Vt::Ty, OP>(c + i, a + i, b + i, n - i);             \
+  }
+
+#define REDUCE_VECTOR_OPS(Vt)                                                  \
+  (op == flagcxSum    ? reduceVector<Vt, flagcxSum>                            \
+   : op == flagcxProd ? reduceVector<Vt, flagcxProd>                           \
+   : op == flagcxMax  ? reduceVector<Vt, flagcxMax>                            \
+                      : reduceVector<Vt, flagcxMin>)
+
+#define REDUCE_VECTOR_OPS_NO_PROD(Vt)                                          \
+  (op == flagcxSum    ? reduceVector<Vt, flagcxSum>                            \
+   : op == flagcxProd ? (flagcxReduceFn_t)NULL                                 \
+   : op == flagcxMax  ? reduceVector<Vt, flagcxMax>                            \
+                      : reduceVector<Vt, flagcxMin>)
+
+#ifdef FLAGCX_REDUCE_X86
+#pragma GCC push_options
+#pragma GCC target("avx2,f16c")
+namespace flagcxAvx2 {
+REDUCE_VECTOR_LOOP
+
+struct FloatOps {
+  typedef __m256 V;
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxSum>) {
+    return _mm256_add_ps(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxProd>) {
+    return _mm256_mul_ps(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMax>) {
+    return _mm256_max_ps(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMin>) {
+    return _mm256_min_ps(a, b);
+  }
+};
+
+struct F32 : FloatOps {
+  typedef float S;
+  typedef flagcxScalarType<float> Ty;
+  static const int width = 8;
+  static inline V load(const S *p) { return _mm256_loadu_ps(p); }
+  static inline void store(S *p, V v) { _mm256_storeu_ps(p, v); }
+};
+
+struct F16 : FloatOps {
+  typedef uint16_t S;
+  typedef flagcxHalfType Ty;
+  static const int width = 8;
+  static inline V load(const S *p) {
+    return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)p));
+  }
+  static inline void store(S *p, V v) {
+    _mm_storeu_si128((__m128i *)p, _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+  }
+};
+
+struct Bf16 : FloatOps {
+  typedef uint16_t S;
+  typedef flagcxBf16Type Ty;
+  static const int width = 8;
+  static inline V load(const S *p) {
+    __m256i u = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)p));
+    return _mm256_castsi256_ps(_mm256_slli_epi32(u, 16));
+  }
+  static inline void store(S *p, V v) {
+    __m256i u = _mm256_castps_si256(v);
+    __m256i lsb = _mm256_and_si256(_mm256_srli_epi32(u, 16), _mm256_set1_epi32(1));
+    __m256i r = _mm256_add_epi32(u, _mm256_add_epi32(lsb, _mm256_set1_epi32(0x7fff)));
+    __m256i qnan = _mm256_or_si256(u, _mm256_set1_epi32(0x400000));
+    __m256i isnan = _mm256_castps_si256(_mm256_cmp_ps(v, v, _CMP_UNORD_Q));
+    r = _mm256_srli_epi32(_mm256_blendv_epi8(r, qnan, isnan), 16);
+    // pack the low halves of the 32-bit lanes, then gather the two 64-bit
+    // groups produced per 128-bit lane
+    r = _mm256_permute4x64_epi64(_mm256_packus_epi32(r, r), 0x08);
+    _mm_storeu_si128((__m128i *)p, _mm256_castsi256_si128(r));
+  }
+};
+
+struct F64 {
+  typedef double S;
+  typedef flagcxScalarType<double> Ty;
+  typedef __m256d V;
+  static const int width = 4;
+  static inline V load(const S *p) { return _mm256_loadu_pd(p); }
+  static inline void store(S *p, V v) { _mm256_storeu_pd(p, v); }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxSum>) {
+    return _mm256_add_pd(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxProd>) {
+    return _mm256_mul_pd(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMax>) {
+    return _mm256_max_pd(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMin>) {
+    return _mm256_min_pd(a, b);
+  }
+};
+
+template <typename T>
+struct IntBase {
+  typedef T S;
+  typedef flagcxScalarType<T> Ty;
+  typedef __m256i V;
+  static const int width = 32 / sizeof(T);
+  static inline V load(const S *p) {
+    return _mm256_loadu_si256((const __m256i *)p);
+  }
+  static inline void store(S *p, V v) { _mm256_storeu_si256((__m256i *)p, v); }
+};
+
+struct I8 : IntBase<int8_t> {
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxSum>) {
+    return _mm256_add_epi8(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMax>) {
+    return _mm256_max_epi8(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMin>) {
+    return _mm256_min_epi8(a, b);
+  }
+};
+
+struct U8 : IntBase<uint8_t> {
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxSum>) {
+    return _mm256_add_epi8(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMax>) {
+    return _mm256_max_epu8(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMin>) {
+    return _mm256_min_epu8(a, b);
+  }
+};
+
+struct I32 : IntBase<int32_t> {
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxSum>) {
+    return _mm256_add_epi32(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxProd>) {
+    return _mm256_mullo_epi32(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMax>) {
+    return _mm256_max_epi32(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMin>) {
+    return _mm256_min_epi32(a, b);
+  }
+};
+
+struct U32 : IntBase<uint32_t> {
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxSum>) {
+    return _mm256_add_epi32(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxProd>) {
+    return _mm256_mullo_epi32(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMax>) {
+    return _mm256_max_epu32(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMin>) {
+    return _mm256_min_epu32(a, b);
+  }
+};
+
+// AVX2 has a signed 64-bit compare only; unsigned values are biased first.
+template <typename T, long long BIAS>
+struct Int64 : IntBase<T> {
+  typedef __m256i V;
+  static inline V greater(V a, V b) {
+    V bias = _mm256_set1_epi64x(BIAS);
+    return _mm256_cmpgt_epi64(_mm256_xor_si256(a, bias),
+                              _mm256_xor_si256(b, bias));
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxSum>) {
+    return _mm256_add_epi64(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMax>) {
+    return _mm256_blendv_epi8(b, a, greater(a, b));
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMin>) {
+    return _mm256_blendv_epi8(a, b, greater(a, b));
+  }
+};
+typedef Int64<int64_t, 0> I64;
+typedef Int64<uint64_t, (long long)0x8000000000000000ULL> U64;
+
+static flagcxReduceFn_t select(flagcxDataType_t datatype, int op) {
+  switch (datatype) {
+    case flagcxInt8:
+      return REDUCE_VECTOR_OPS_NO_PROD(I8);
+    case flagcxUint8:
+      return REDUCE_VECTOR_OPS_NO_PROD(U8);
+    case flagcxInt32:
+      return REDUCE_VECTOR_OPS(I32);
+    case flagcxUint32:
+      return REDUCE_VECTOR_OPS(U32);
+    case flagcxInt64:
+      return REDUCE_VECTOR_OPS_NO_PROD(I64);
+    case flagcxUint64:
+      return REDUCE_VECTOR_OPS_NO_PROD(U64);
+    case flagcxFloat16:
+      return REDUCE_VECTOR_OPS(F16);
+    case flagcxFloat32:
+      return REDUCE_VECTOR_OPS(F32);
+    case flagcxFloat64:
+      return REDUCE_VECTOR_OPS(F64);
+    case flagcxBfloat16:
+      return REDUCE_VECTOR_OPS(Bf16);
+    default:
+      return NULL;
+  }
+}
+} // namespace flagcxAvx2
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+namespace flagcxAvx512 {
+REDUCE_VECTOR_LOOP
+
+struct FloatOps {
+  typedef __m512 V;
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxSum>) {
+    return _mm512_add_ps(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxProd>) {
+    return _mm512_mul_ps(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMax>) {
+    return _mm512_max_ps(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMin>) {
+    return _mm512_min_ps(a, b);
+  }
+};
+
+struct F32 : FloatOps {
+  typedef float S;
+  typedef flagcxScalarType<float> Ty;
+  static const int width = 16;
+  static inline V load(const S *p) { return _mm512_loadu_ps(p); }
+  static inline void store(S *p, V v) { _mm512_storeu_ps(p, v); }
+};
+
+struct F16 : FloatOps {
+  typedef uint16_t S;
+  typedef flagcxHalfType Ty;
+  static const int width = 16;
+  static inline V load(const S *p) {
+    return _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)p));
+  }
+  static inline void store(S *p, V v) {
+    _mm256_storeu_si256((__m256i *)p,
+                        _mm512_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+  }
+};
+
+struct Bf16 : FloatOps {
+  typedef uint16_t S;
+  typedef flagcxBf16Type Ty;
+  static const int width = 16;
+  static inline V load(const S *p) {
+    __m512i u = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i *)p));
+    return _mm512_castsi512_ps(_mm512_slli_epi32(u, 16));
+  }
+  static inline void store(S *p, V v) {
+    __m512i u = _mm512_castps_si512(v);
+    __m512i lsb = _mm512_and_si512(_mm512_srli_epi32(u, 16), _mm512_set1_epi32(1));
+    __m512i r = _mm512_add_epi32(u, _mm512_add_epi32(lsb, _mm512_set1_epi32(0x7fff)));
+    __m512i qnan = _mm512_or_si512(u, _mm512_set1_epi32(0x400000));
+    __mmask16 isnan = _mm512_cmp_ps_mask(v, v, _CMP_UNORD_Q);
+    r = _mm512_srli_epi32(_mm512_mask_blend_epi32(isnan, r, qnan), 16);
+    _mm256_storeu_si256((__m256i *)p, _mm512_cvtepi32_epi16(r));
+  }
+};
+
+struct F64 {
+  typedef double S;
+  typedef flagcxScalarType<double> Ty;
+  typedef __m512d V;
+  static const int width = 8;
+  static inline V load(const S *p) { return _mm512_loadu_pd(p); }
+  static inline void store(S *p, V v) { _mm512_storeu_pd(p, v); }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxSum>) {
+    return _mm512_add_pd(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxProd>) {
+    return _mm512_mul_pd(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMax>) {
+    return _mm512_max_pd(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMin>) {
+    return _mm512_min_pd(a, b);
+  }
+};
+
+template <typename T>
+struct IntBase {
+  typedef T S;
+  typedef flagcxScalarType<T> Ty;
+  typedef __m512i V;
+  static const int width = 64 / sizeof(T);
+  static inline V load(const S *p) { return _mm512_loadu_si512(p); }
+  static inline void store(S *p, V v) { _mm512_storeu_si512(p, v); }
+};
+
+struct I32 : IntBase<int32_t> {
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxSum>) {
+    return _mm512_add_epi32(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxProd>) {
+    return _mm512_mullo_epi32(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMax>) {
+    return _mm512_max_epi32(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMin>) {
+    return _mm512_min_epi32(a, b);
+  }
+};
+
+struct U32 : IntBase<uint32_t> {
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxSum>) {
+    return _mm512_add_epi32(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxProd>) {
+    return _mm512_mullo_epi32(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMax>) {
+    return _mm512_max_epu32(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMin>) {
+    return _mm512_min_epu32(a, b);
+  }
+};
+
+struct I64 : IntBase<int64_t> {
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxSum>) {
+    return _mm512_add_epi64(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMax>) {
+    return _mm512_max_epi64(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMin>) {
+    return _mm512_min_epi64(a, b);
+  }
+};
+
+struct U64 : IntBase<uint64_t> {
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxSum>) {
+    return _mm512_add_epi64(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMax>) {
+    return _mm512_max_epu64(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMin>) {
+    return _mm512_min_epu64(a, b);
+  }
+};
+
+// 8-bit types need AVX512BW and are left to the AVX2 kernels.
+static flagcxReduceFn_t select(flagcxDataType_t datatype, int op) {
+  switch (datatype) {
+    case flagcxInt32:
+      return REDUCE_VECTOR_OPS(I32);
+    case flagcxUint32:
+      return REDUCE_VECTOR_OPS(U32);
+    case flagcxInt64:
+      return REDUCE_VECTOR_OPS_NO_PROD(I64);
+    case flagcxUint64:
+      return REDUCE_VECTOR_OPS_NO_PROD(U64);
+    case flagcxFloat16:
+      return REDUCE_VECTOR_OPS(F16);
+    case flagcxFloat32:
+      return REDUCE_VECTOR_OPS(F32);
+    case flagcxFloat64:
+      return REDUCE_VECTOR_OPS(F64);
+    case flagcxBfloat16:
+      return REDUCE_VECTOR_OPS(Bf16);
+    default:
+      return NULL;
+  }
+}
+} // namespace flagcxAvx512
+#pragma GCC pop_options
+#endif // FLAGCX_REDUCE_X86
+
+#ifdef FLAGCX_REDUCE_NEON
+namespace flagcxNeon {
+REDUCE_VECTOR_LOOP
+
+struct FloatOps {
+  typedef float32x4_t V;
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxSum>) {
+    return vaddq_f32(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxProd>) {
+    return vmulq_f32(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMax>) {
+    return vmaxq_f32(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMin>) {
+    return vminq_f32(a, b);
+  }
+};
+
+struct F32 : FloatOps {
+  typedef float S;
+  typedef flagcxScalarType<float> Ty;
+  static const int width = 4;
+  static inline V load(const S *p) { return vld1q_f32(p); }
+  static inline void store(S *p, V v) { vst1q_f32(p, v); }
+};
+
+struct F16 : FloatOps {
+  typedef uint16_t S;
+  typedef flagcxHalfType Ty;
+  static const int width = 4;
+  static inline V load(const S *p) {
+    return vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(p)));
+  }
+  static inline void store(S *p, V v) {
+    vst1_u16(p, vreinterpret_u16_f16(vcvt_f16_f32(v)));
+  }
+};
+
+struct Bf16 : FloatOps {
+  typedef uint16_t S;
+  typedef flagcxBf16Type Ty;
+  static const int width = 4;
+  static inline V load(const S *p) {
+    return vreinterpretq_f32_u32(vshll_n_u16(vld1_u16(p), 16));
+  }
+  static inline void store(S *p, V v) {
+    uint32x4_t u = vreinterpretq_u32_f32(v);
+    uint32x4_t lsb = vandq_u32(vshrq_n_u32(u, 16), vdupq_n_u32(1));
+    uint32x4_t r = vaddq_u32(u, vaddq_u32(lsb, vdupq_n_u32(0x7fff)));
+    uint32x4_t qnan = vorrq_u32(u, vdupq_n_u32(0x400000));
+    uint32x4_t isnan = vmvnq_u32(vceqq_f32(v, v));
+    vst1_u16(p, vshrn_n_u32(vbslq_u32(isnan, qnan, r), 16));
+  }
+};
+
+struct F64 {
+  typedef double S;
+  typedef flagcxScalarType<double> Ty;
+  typedef float64x2_t V;
+  static const int width = 2;
+  static inline V load(const S *p) { return vld1q_f64(p); }
+  static inline void store(S *p, V v) { vst1q_f64(p, v); }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxSum>) {
+    return vaddq_f64(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxProd>) {
+    return vmulq_f64(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMax>) {
+    return vmaxq_f64(a, b);
+  }
+  static inline V apply(V a, V b, flagcxRedOpTag<flagcxMin>) {
+    return vminq_f64(a, b);
+  }
+};
+
+#define NEON_INT_TYPE(Name, T, V_, sfx)                                        \
+  struct Name {                                                                \
+    typedef T S;                                                               \
+    typedef flagcxScalarType<T> Ty;                                            \
+    typedef V_ V;                                                              \
+    static const int width = 16 / sizeof(T);                                   \
+    static inline V load(const S *p) { return vld1q_##sfx(p); }                \
+    static inline void store(S *p, V v) { vst1q_##sfx(p, v); }                 \
+    static inline V apply(V a, V b, flagcxRedOpTag<flagcxSum>) {               \
+      return vaddq_##sfx(a, b);                                                \
+    }                                                                          \
+    static inline V apply(V a, V b, flagcxRedOpTag<flagcxProd>) {              \
+      return vmulq_##sfx(a, b);                                                \
+    }                                                                          \
+    static inline V apply(V a, V b, flagcxRedOpTag<flagcxMax>) {               \
+      return vmaxq_##sfx(a, b);                                                \
+    }                                                                          \
+    static inline V apply(V a, V b, flagcxRedOpTag<flagcxMin>) {               \
+      return vminq_##sfx(a, b);                                                \
+    }                                                                          \
+  };
+NEON_INT_TYPE(I8, int8_t, int8x16_t, s8)
+NEON_INT_TYPE(U8, uint8_t, uint8x16_t, u8)
+NEON_INT_TYPE(I32, int32_t, int32x4_t, s32)
+NEON_INT_TYPE(U32, uint32_t, uint32x4_t, u32)
+#undef NEON_INT_TYPE
+
+// No 64-bit lane multiply/min/max in NEON, select on a compare instead.
+#define NEON_INT64_TYPE(Name, T, V_, sfx)                                      \
+  struct Name {                                                                \
+    typedef T S;                                                               \
+    typedef flagcxScalarType<T> Ty;                                            \
+    typedef V_ V;                                                              \
+    static const int width = 2;                                                \
+    static inline V load(const S *p) { return vld1q_##sfx(p); }                \
+    static inline void store(S *p, V v) { vst1q_##sfx(p, v); }                 \
+    static inline V apply(V a, V b, flagcxRedOpTag<flagcxSum>) {               \
+      return vaddq_##sfx(a, b);                                                \
+    }                                                                          \
+    static inline V apply(V a, V b, flagcxRedOpTag<flagcxMax>) {               \
+      return vbslq_##sfx(vcgtq_##sfx(a, b), a, b);                             \
+    }                                                                          \
+    static inline V apply(V a, V b, flagcxRedOpTag<flagcxMin>) {               \
+      return vbslq_##sfx(vcgtq_##sfx(a, b), b, a);                             \
+    }                                                                          \
+  };
+NEON_INT64_TYPE(I64, int64_t, int64x2_t, s64)
+NEON_INT64_TYPE(U64, uint64_t, uint64x2_t, u64)
+#undef NEON_INT64_TYPE
+
+static flagcxReduceFn_t select(flagcxDataType_t datatype, int op) {
+  switch (datatype) {
+    case flagcxInt8:
+      return REDUCE_VECTOR_OPS(I8);
+    case flagcxUint8:
+      return REDUCE_VECTOR_OPS(U8);
+    case flagcxInt32:
+      return REDUCE_VECTOR_OPS(I32);
+    case flagcxUint32:
+      return REDUCE_VECTOR_OPS(U32);
+    case flagcxInt64:
+      return REDUCE_VECTOR_OPS_NO_PROD(I64);
+    case flagcxUint64:
+      return REDUCE_VECTOR_OPS_NO_PROD(U64);
+    case flagcxFloat16:
+      return REDUCE_VECTOR_OPS(F16);
+    case flagcxFloat32:
+      return REDUCE_VECTOR_OPS(F32);
+    case flagcxFloat64:
+      return REDUCE_VECTOR_OPS(F64);
+    case flagcxBfloat16:
+      return REDUCE_VECTOR_OPS(Bf16);
+    default:
+      return NULL;
+  }
+}
+} // namespace flagcxNeon
+#endif // FLAGCX_REDUCE_NEON
+
+bool flagcxHostReduceIsaSupported(flagcxReduceIsa_t isa) {
+  switch (isa) {
+    case flagcxReduceIsaScalar:
+      return true;
+#ifdef FLAGCX_REDUCE_X86
+    case flagcxReduceIsaAvx2:
+      return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c");
+    case flagcxReduceIsaAvx512:
+      return __builtin_cpu_supports("avx512f") &&
+             flagcxHostReduceIsaSupported(flagcxReduceIsaAvx2);
+#endif
+#ifdef FLAGCX_REDUCE_NEON
+    case flagcxReduceIsaNeon:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+static flagcxReduceIsa_t detectIsa() {
+  flagcxReduceIsa_t best = flagcxReduceIsaScalar;
+  if (flagcxHostReduceIsaSupported(flagcxReduceIsaNeon))
+    best = flagcxReduceIsaNeon;
+  else if (flagcxHostReduceIsaSupported(flagcxReduceIsaAvx512))
+    best = flagcxReduceIsaAvx512;
+  else if (flagcxHostReduceIsaSupported(flagcxReduceIsaAvx2))
+    best = flagcxReduceIsaAvx2;
+
+  int64_t request = flagcxParamHostReduceIsa();
+  if (request >= 0) {
+    if (request < flagcxReduceIsaNum &&
+        flagcxHostReduceIsaSupported((flagcxReduceIsa_t)request)) {
+      best = (flagcxReduceIsa_t)request;
+    } else {
+      WARN("FLAGCX_HOST_REDUCE_ISA=%ld is not supported on this CPU, using %s",
+           request, flagcxReduceIsaToString(best));
+    }
+  }
+  INFO(FLAGCX_INIT, "Host reduction kernels use %s",
+       flagcxReduceIsaToString(best));
+  return best;
+}
+
+const char *flagcxReduceIsaToString(flagcxReduceIsa_t isa) {
+  switch (isa) {
+    case flagcxReduceIsaScalar:
+      return "scalar";
+    case flagcxReduceIsaAvx2:
+      return "AVX2";
+    case flagcxReduceIsaAvx512:
+      return "AVX-512";
+    case flagcxReduceIsaNeon:
+      return "NEON";
+    default:
+      return "unknown";
+  }
+}
+
+flagcxReduceIsa_t flagcxHostReduceIsa() {
+  static flagcxReduceIsa_t isa = detectIsa();
+  return isa;
+}
+
+static flagcxResult_t reduceSelect(flagcxReduceIsa_t isa,
+                                   flagcxDataType_t datatype, flagcxRedOp_t op,
+                                   flagcxReduceFn_t *fn) {
+  if (op == flagcxAvg) {
+    op = flagcxSum;
+  } else if (op != flagcxSum && op != flagcxProd && op != flagcxMax &&
+             op != flagcxMin) {
+    WARN("Unsupported reduction operation %d", op);
+    return flagcxInvalidArgument;
+  }
+  if (!flagcxHostReduceIsaSupported(isa)) {
+    WARN("Host reduction ISA %s is not supported on this CPU",
+         flagcxReduceIsaToString(isa));
+    return flagcxInvalidArgument;
+  }
+
+  *fn = NULL;
+#ifdef FLAGCX_REDUCE_X86
+  if (isa == flagcxReduceIsaAvx512)
+    *fn = flagcxAvx512::select(datatype, op);
+  if (*fn == NULL &&
+      (isa == flagcxReduceIsaAvx512 || isa == flagcxReduceIsaAvx2))
+    *fn = flagcxAvx2::select(datatype, op);
+#endif
+#ifdef FLAGCX_REDUCE_NEON
+  if (isa == flagcxReduceIsaNeon)
+    *fn = flagcxNeon::select(datatype, op);
+#endif
+  if (*fn == NULL)
+    *fn = scalarSelect(datatype, op);
+  if (*fn == NULL) {
+    WARN("Unsupported data type %d", datatype);
+    return flagcxInvalidArgument;
+  }
+  return flagcxSuccess;
+}
+
+/*
+ * Reduction thread pool. Large reductions are cut into parts of at least
+ * FLAGCX_HOST_REDUCE_PARALLEL_SIZE bytes that the caller and
+ * FLAGCX_HOST_REDUCE_THREADS workers take in turn. Workers are bound to the
+ * NUMA node the pool was created from, which is where the ring buffers of the
+ * bootstrap collectives are allocated. A caller that finds the pool busy
+ * reduces on its own thread. The default splits a single
+ * FLAGCX_BOOTSTRAP_REDUCE_BLOCK_SIZE block of the ring reduce-scatter into
+ * four parts.
+ */
+FLAGCX_PARAM(HostReduceThreads, "HOST_REDUCE_THREADS", 0);
+FLAGCX_PARAM(HostReduceParallelSize, "HOST_REDUCE_PARALLEL_SIZE", 1 << 16);
+
+// The job a worker took, copied under the pool mutex so that a worker still
+// running after the job completed never reads the fields of the next one.
+struct flagcxReduceJob {
+  uint64_t generation;
+  flagcxReduceFn_t fn;
+  char *res;
+  const char *op1;
+  const char *op2;
+  size_t typeSize;
+  size_t count;
+  size_t partCount;
+  int nParts;
+};
+
+struct flagcxReducePool {
+  pthread_mutex_t submitLock;
+  pthread_mutex_t mutex;
+  pthread_cond_t workCond;
+  pthread_cond_t doneCond;
+  int nThreads;
+  pthread_t *threads;
+  // current job, generation is bumped when it is published
+  struct flagcxReduceJob job;
+  // generation in the high 32 bits, next part to claim in the low 32 bits
+  uint64_t claim;
+  int remaining;
+};
+
+static struct flagcxReducePool reducePool = {PTHREAD_MUTEX_INITIALIZER,
+                                             PTHREAD_MUTEX_INITIALIZER,
+                                             PTHREAD_COND_INITIALIZER,
+                                             PTHREAD_COND_INITIALIZER};
+
+// Parts are claimed against the generation of the job, a worker that comes
+// back after its job completed fails the claim instead of running a part of
+// the next job twice.
+static bool reducePoolClaim(struct flagcxReducePool *pool,
+                            const struct flagcxReduceJob *job, int *part) {
+  uint64_t claim = __atomic_load_n(&pool->claim, __ATOMIC_ACQUIRE);
+  do {
+    if ((claim >> 32) != (job->generation & 0xffffffff) ||
+        (int)(claim & 0xffffffff) >= job->nParts)
+      return false;
+  } while (!__atomic_compare_exchange_n(&pool->claim, &claim, claim + 1, true,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+  *part = (int)(claim & 0xffffffff);
+  return true;
+}
+
+static void reducePoolRunParts(struct flagcxReducePool *pool,
+                               const struct flagcxReduceJob *job) {
+  int part;
+  while (reducePoolClaim(pool, job, &part)) {
+    size_t first = part * job->partCount;
+    size_t n = std::min(job->partCount, job->count - first);
+    size_t offset = first * job->typeSize;
+    job->fn(job->res + offset, job->op1 + offset, job->op2 + offset, n);
+    if (__atomic_sub_fetch(&pool->remaining, 1, __ATOMIC_ACQ_REL) == 0) {
+      pthread_mutex_lock(&pool->mutex);
+      pthread_cond_signal(&pool->doneCond);
+      pthread_mutex_unlock(&pool->mutex);
+    }
+  }
+}
+
+static void *reducePoolWorker(void *arg) {
+  struct flagcxReducePool *pool = (struct flagcxReducePool *)arg;
+  uint64_t seen = 0;
+  while (true) {
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->job.generation == seen)
+      pthread_cond_wait(&pool->workCond, &pool->mutex);
+    struct flagcxReduceJob job = pool->job;
+    seen = job.generation;
+    pthread_mutex_unlock(&pool->mutex);
+    reducePoolRunParts(pool, &job);
+  }
+  return NULL;
+}
+
+// CPUs of the NUMA node the calling thread runs on, restricted to the
+// process affinity.
+static void reducePoolLocalCpuset(cpu_set_t *cpuset) {
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  sched_getaffinity(0, sizeof(cpu_set_t), &allowed);
+  *cpuset = allowed;
+  int cpu = sched_getcpu();
+  if (cpu < 0)
+    return;
+  for (int node = 0;; node++) {
+    char path[PATH_MAX];
+    snprintf(path, PATH_MAX, "/sys/devices/system/node/node%d/cpumap", node);
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+      break;
+    char mask[1024];
+    bool found = false;
+    if (fgets(mask, sizeof(mask), file) != NULL) {
+      mask[strcspn(mask, "\n")] = '\0';
+      cpu_set_t nodeset;
+      CPU_ZERO(&nodeset);
+      flagcxStrToCpuset(mask, &nodeset);
+      if (CPU_ISSET(cpu, &nodeset)) {
+        CPU_AND(&nodeset, &nodeset, &allowed);
+        if (CPU_COUNT(&nodeset) > 0)
+          *cpuset = nodeset;
+        INFO(FLAGCX_INIT, "Host reduction threads bound to NUMA node %d (%d cpus)",
+             node, CPU_COUNT(cpuset));
+        found = true;
+      }
+    }
+    fclose(file);
+    if (found)
+      break;
+  }
+}
+
+// Called with submitLock held. Returns the number of workers.
+static int reducePoolInit(struct flagcxReducePool *pool) {
+  if (pool->threads != NULL)
+    return pool->nThreads;
+  int64_t nThreads = flagcxParamHostReduceThreads();
+  if (nThreads <= 0)
+    return 0;
+  cpu_set_t cpuset;
+  reducePoolLocalCpuset(&cpuset);
+  pool->threads = (pthread_t *)calloc(nThreads, sizeof(pthread_t));
+  if (pool->threads == NULL)
+    return 0;
+  for (int i = 0; i < nThreads; i++) {
+    if (pthread_create(&pool->threads[i], NULL, reducePoolWorker, pool) != 0) {
+      WARN("Failed to create host reduction thread %d", i);
+      break;
+    }
+    pthread_setaffinity_np(pool->threads[i], sizeof(cpu_set_t), &cpuset);
+    flagcxSetThreadName(pool->threads[i], "FLAGCX reduce %d", i);
+    pool->nThreads++;
+  }
+  INFO(FLAGCX_INIT, "Host reduction pool started with %d threads",
+       pool->nThreads);
+  return pool->nThreads;
+}
+
+// Returns true if the reduction was executed by the pool.
+static bool reducePoolRun(flagcxReduceFn_t fn, void *res, const void *op1,
+                          const void *op2, size_t count, size_t typeSize) {
+  struct flagcxReducePool *pool = &reducePool;
+  size_t minPartBytes = std::max((int64_t)flagcxParamHostReduceParallelSize(),
+                                 (int64_t)typeSize);
+  if (flagcxParamHostReduceThreads() <= 0 ||
+      count * typeSize < 2 * minPartBytes)
+    return false;
+  if (pthread_mutex_trylock(&pool->submitLock) != 0)
+    return false;
+  int nThreads = reducePoolInit(pool);
+  if (nThreads == 0) {
+    pthread_mutex_unlock(&pool->submitLock);
+    return false;
+  }
+
+  int nParts = std::min((size_t)nThreads + 1, count * typeSize / minPartBytes);
+  // keep parts a multiple of 64 elements so that every part but the last one
+  // runs full vectors
+  size_t partCount = (count + nParts - 1) / nParts;
+  partCount = (partCount + 63) / 64 * 64;
+  nParts = (count + partCount - 1) / partCount;
+
+  pthread_mutex_lock(&pool->mutex);
+  struct flagcxReduceJob *job = &pool->job;
+  job->generation++;
+  job->fn = fn;
+  job->res = (char *)res;
+  job->op1 = (const char *)op1;
+  job->op2 = (const char *)op2;
+  job->typeSize = typeSize;
+  job->count = count;
+  job->partCount = partCount;
+  job->nParts = nParts;
+  __atomic_store_n(&pool->remaining, nParts, __ATOMIC_RELEASE);
+  __atomic_store_n(&pool->claim, job->generation << 32, __ATOMIC_RELEASE);
+  struct flagcxReduceJob local = *job;
+  pthread_cond_broadcast(&pool->workCond);
+  pthread_mutex_unlock(&pool->mutex);
+
+  reducePoolRunParts(pool, &local);
+
+  pthread_mutex_lock(&pool->mutex);
+  while (__atomic_load_n(&pool->remaining, __ATOMIC_ACQUIRE) != 0)
+    pthread_cond_wait(&pool->doneCond, &pool->mutex);
+  pthread_mutex_unlock(&pool->mutex);
+  pthread_mutex_unlock(&pool->submitLock);
+  return true;
+}
+
+flagcxResult_t flagcxHostReduceIsaRun(flagcxReduceIsa_t isa, void *res,
+                                      const void *op1, const void *op2,
+                                      size_t count, flagcxDataType_t datatype,
+                                      flagcxRedOp_t op) {
+  flagcxReduceFn_t fn;
+  FLAGCXCHECK(reduceSelect(isa, datatype, op, &fn));
+  fn(res, op1, op2, count);
+  return flagcxSuccess;
+}
+
+flagcxResult_t flagcxHostReduce(void *res, const void *op1, const void *op2,
+                                size_t count, flagcxDataType_t datatype,
+                                flagcxRedOp_t op) {
+  flagcxReduceFn_t fn;
+  FLAGCXCHECK(reduceSelect(flagcxHostReduceIsa(), datatype, op, &fn));
+  if (!reducePoolRun(fn, res, op1, op2, count,
+                     getFlagcxDataTypeSize(datatype)))
+    fn(res, op1, op2, count);
+  return flagcxSuccess;
+}
+
+template <typename Ty>
+static void divideScalar(void *buf, size_t n, int nranks) {
+  typedef typename Ty::S S;
+  typedef typename Ty::C C;
+  S *p = (S *)buf;
+  for (size_t i = 0; i < n; i++) {
+    p[i] = Ty::store((C)(Ty::load(p[i]) / (C)nranks));
+  }
+}
+
+flagcxResult_t flagcxHostReduceFinalize(void *buf, size_t count,
+                                        flagcxDataType_t datatype,
+                                        flagcxRedOp_t op, int nranks) {
+  if (op != flagcxAvg || nranks <= 1)
+    return flagcxSuccess;
+  switch (datatype) {
+    case flagcxInt8:
+      divideScalar<flagcxScalarType<int8_t>>(buf, count, nranks);
+      break;
+    case flagcxUint8:
+      divideScalar<flagcxScalarType<uint8_t>>(buf, count, nranks);
+      break;
+    case flagcxInt32:
+      divideScalar<flagcxScalarType<int32_t>>(buf, count, nranks);
+      break;
+    case flagcxUint32:
+      divideScalar<flagcxScalarType<uint32_t>>(buf, count, nranks);
+      break;
+    case flagcxInt64:
+      divideScalar<flagcxScalarType<int64_t>>(buf, count, nranks);
+      break;
+    case flagcxUint64:
+      divideScalar<flagcxScalarType<uint64_t>>(buf, count, nranks);
+      break;
+    case flagcxFloat16:
+      divideScalar<flagcxHalfType>(buf, count, nranks);
+      break;
+    case flagcxFloat32:
+      divideScalar<flagcxScalarType<float>>(buf, count, nranks);
+      break;
+    case flagcxFloat64:
+      divideScalar<flagcxScalarType<double>>(buf, count, nranks);
+      break;
+    case flagcxBfloat16:
+      divideScalar<flagcxBf16Type>(buf, count, nranks);
+      break;
+    default:
+      WARN("Unsupported data type %d", datatype);
+      return flagcxInvalidArgument;
+  }
+  return flagcxSuccess;
+}
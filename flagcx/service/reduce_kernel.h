@@ -0,0 +1,48 @@
+#ifndef FLAGCX_REDUCE_KERNEL_H_
+#define FLAGCX_REDUCE_KERNEL_H_
+
+#include "type.h"
+#include <stddef.h>
+
+// Instruction sets the host reduction kernels can be dispatched to.
+typedef enum {
+  flagcxReduceIsaScalar = 0,
+  flagcxReduceIsaAvx2 = 1,
+  flagcxReduceIsaAvx512 = 2,
+  flagcxReduceIsaNeon = 3,
+  flagcxReduceIsaNum = 4
+} flagcxReduceIsa_t;
+
+const char *flagcxReduceIsaToString(flagcxReduceIsa_t isa);
+bool flagcxHostReduceIsaSupported(flagcxReduceIsa_t isa);
+
+// Best instruction set supported by the running CPU, capped by
+// FLAGCX_HOST_REDUCE_ISA (0 forces the scalar kernels).
+flagcxReduceIsa_t flagcxHostReduceIsa();
+
+/*
+ * Element-wise reduction res[i] = op(op1[i], op2[i]) for i in [0, count).
+ *
+ * res may alias op1 or op2. All flagcxDataType_t values are supported;
+ * flagcxFloat16 and flagcxBfloat16 are widened to fp32, combined and rounded
+ * back to nearest even. flagcxAvg accumulates like flagcxSum, the division is
+ * applied once by flagcxHostReduceFinalize.
+ */
+flagcxResult_t flagcxHostReduce(void *res, const void *op1, const void *op2,
+                                size_t count, flagcxDataType_t datatype,
+                                flagcxRedOp_t op);
+
+// Same as flagcxHostReduce, but runs the kernels of the given instruction set
+// (falls back to the scalar kernels where isa has no specialization).
+flagcxResult_t flagcxHostReduceIsaRun(flagcxReduceIsa_t isa, void *res,
+                                      const void *op1, const void *op2,
+                                      size_t count, flagcxDataType_t datatype,
+                                      flagcxRedOp_t op);
+
+// Post-processing of a fully reduced buffer: divides by nranks for flagcxAvg,
+// does nothing for other operations.
+flagcxResult_t flagcxHostReduceFinalize(void *buf, size_t count,
+                                        flagcxDataType_t datatype,
+                                        flagcxRedOp_t op, int nranks);
+
+#endif
@@ -0,0 +1,101 @@
+#include "mpi.h"
+#include "flagcx.h"
+#include "tools.h"
+#include <iostream>
+#include <cstring>
+
+// Latency of flagcxBarrier and flagcxStreamBarrier against the previous
+// barrier, an allreduce on a scratch device buffer allocated on every call.
+
+static void allReduceBarrier(flagcxComm_t comm, flagcxDeviceHandle_t devHandle, flagcxStream_t stream, int nranks){
+    void *barrierBuff;
+    devHandle->deviceMalloc(&barrierBuff, nranks, flagcxMemDevice, stream);
+    devHandle->deviceMemset(barrierBuff, 0, nranks, flagcxMemDevice, stream);
+    flagcxAllReduce(barrierBuff, barrierBuff, nranks, flagcxChar, flagcxMax, comm, stream);
+    devHandle->deviceFree(barrierBuff, flagcxMemDevice, stream);
+    devHandle->streamSynchronize(stream);
+}
+
+int main(int argc, char *argv[]){
+    parser args(argc, argv);
+    int num_warmup_iters = args.getWarmupIters();
+    int num_iters = args.getTestIters();
+
+    int totalProcs, proc;
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &totalProcs);
+    MPI_Comm_rank(MPI_COMM_WORLD, &proc);
+    printf("I am %d of %d\n", proc, totalProcs);
+
+    flagcxHandlerGroup_t handler;
+    flagcxHandleInit(&handler);
+    flagcxUniqueId_t& uniqueId = handler->uniqueId;
+    flagcxComm_t& comm = handler->comm;
+    flagcxDeviceHandle_t& devHandle = handler->devHandle;
+
+    int nGpu;
+    devHandle->getDeviceCount(&nGpu);
+    devHandle->setDevice(proc % nGpu);
+
+    if (proc == 0)
+        flagcxGetUniqueId(&uniqueId);
+    MPI_Bcast((void *)uniqueId, sizeof(flagcxUniqueId), MPI_BYTE, 0, MPI_COMM_WORLD);
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    flagcxCommInitRank(&comm, totalProcs, uniqueId, proc);
+
+    flagcxStream_t stream;
+    devHandle->streamCreate(&stream);
+
+    timer tim;
+
+    // allreduce on a scratch buffer
+    for (int i = 0; i < num_warmup_iters; i++) {
+        allReduceBarrier(comm, devHandle, stream, totalProcs);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    tim.reset();
+    for (int i = 0; i < num_iters; i++) {
+        allReduceBarrier(comm, devHandle, stream, totalProcs);
+    }
+    double allreduce_time = tim.elapsed() / num_iters;
+
+    // host barrier
+    for (int i = 0; i < num_warmup_iters; i++) {
+        flagcxBarrier(comm, stream);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    tim.reset();
+    for (int i = 0; i < num_iters; i++) {
+        flagcxBarrier(comm, stream);
+    }
+    double barrier_time = tim.elapsed() / num_iters;
+
+    // stream-ordered barrier, waited for on every iteration
+    for (int i = 0; i < num_warmup_iters; i++) {
+        flagcxStreamBarrier(comm, stream);
+        devHandle->streamSynchronize(stream);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    tim.reset();
+    for (int i = 0; i < num_iters; i++) {
+        flagcxStreamBarrier(comm, stream);
+        devHandle->streamSynchronize(stream);
+    }
+    double stream_barrier_time = tim.elapsed() / num_iters;
+
+    if (proc == 0) {
+        printf("Allreduce barrier: %lf us\n", allreduce_time * 1.0E6);
+        printf("flagcxBarrier: %lf us; Speedup: %.2fx\n", barrier_time * 1.0E6, allreduce_time / barrier_time);
+        printf("flagcxStreamBarrier: %lf us; Speedup: %.2fx\n", stream_barrier_time * 1.0E6, allreduce_time / stream_barrier_time);
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    devHandle->streamDestroy(stream);
+    flagcxCommDestroy(comm);
+    flagcxHandleFree(handler);
+
+    MPI_Finalize();
+    return 0;
+}
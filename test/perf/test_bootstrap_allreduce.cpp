@@ -0,0 +1,93 @@
+#include "mpi.h"
+#include "flagcx.h"
+#include "bootstrap.h"
+#include "tools.h"
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+
+#define DATATYPE flagcxFloat
+
+// Host allreduce over the bootstrap network, the path used by host-side
+// collectives. The algorithm is selected by message size, see
+// FLAGCX_BOOTSTRAP_ALLREDUCE_RD_THRESHOLD and
+// FLAGCX_BOOTSTRAP_ALLREDUCE_RABENSEIFNER_THRESHOLD; run-bootstrap-allreduce
+// forces each algorithm in turn to compare them over the whole size range.
+
+int main(int argc, char *argv[]){
+    parser args(argc, argv);
+    size_t min_bytes = args.getMinBytes();
+    size_t max_bytes = args.getMaxBytes();
+    int step_factor = args.getStepFactor();
+    int num_warmup_iters = args.getWarmupIters();
+    int num_iters = args.getTestIters();
+    int print_buffer = args.isPrintBuffer();
+
+    int totalProcs, proc;
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &totalProcs);
+    MPI_Comm_rank(MPI_COMM_WORLD, &proc);
+    printf("I am %d of %d\n", proc, totalProcs);
+
+    struct flagcxBootstrapHandle handle;
+    bootstrapNetInit();
+    if (proc == 0)
+        bootstrapGetUniqueId(&handle);
+    MPI_Bcast((void *)&handle, sizeof(handle), MPI_BYTE, 0, MPI_COMM_WORLD);
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    static uint32_t abortFlag = 0;
+    struct bootstrapState *state = (struct bootstrapState *)calloc(1, sizeof(struct bootstrapState));
+    state->rank = proc;
+    state->nranks = totalProcs;
+    state->magic = handle.magic;
+    state->abortFlag = &abortFlag;
+    bootstrapInit(&handle, state);
+
+    timer tim;
+    for (size_t size = min_bytes; size <= max_bytes; size *= step_factor) {
+        size_t count = size / sizeof(float);
+        float *sendbuff = (float *)malloc(size);
+        float *recvbuff = (float *)malloc(size);
+        for (size_t i = 0; i < count; i++) {
+            sendbuff[i] = i % 10;
+        }
+
+        for (int i = 0; i < num_warmup_iters; i++) {
+            AllReduceBootstrap(state, sendbuff, recvbuff, count, DATATYPE, flagcxSum);
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+
+        tim.reset();
+        for (int i = 0; i < num_iters; i++) {
+            AllReduceBootstrap(state, sendbuff, recvbuff, count, DATATYPE, flagcxSum);
+        }
+
+        double elapsed_time = tim.elapsed() / num_iters;
+        double base_bw = (double)(size) / 1.0E9 / elapsed_time;
+        double alg_bw = base_bw;
+        double factor = ((double)(2*(totalProcs - 1)))/((double)(totalProcs));
+        double bus_bw = base_bw * factor;
+        if (proc == 0) {
+            printf("Comm size: %zu bytes; Elapsed time: %lf sec; Algo bandwidth: %lf GB/s; Bus bandwidth: %lf GB/s\n", size, elapsed_time, alg_bw, bus_bw);
+        }
+
+        MPI_Barrier(MPI_COMM_WORLD);
+
+        if (proc == 0 && print_buffer) {
+            printf("recvbuff = ");
+            for (size_t i = 0; i < 10 && i < count; i++) {
+                printf("%f ", recvbuff[i]);
+            }
+            printf("\n");
+        }
+
+        free(sendbuff);
+        free(recvbuff);
+    }
+
+    bootstrapClose(state);
+
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include "mpi.h"
+#include "flagcx.h"
+#include "bootstrap.h"
+#include "tools.h"
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+
+// Ping-pong between rank pairs (2i, 2i+1) over the bootstrap network, which
+// carries the host-side collectives. Reports the one-way latency and the
+// bandwidth of each message size. run-bootstrap-sendrecv runs it with the
+// non-blocking send/recv path and with FLAGCX_SOCKET_IO_URING=1.
+
+int main(int argc, char *argv[]){
+    parser args(argc, argv);
+    size_t min_bytes = args.getMinBytes();
+    size_t max_bytes = args.getMaxBytes();
+    int step_factor = args.getStepFactor();
+    int num_warmup_iters = args.getWarmupIters();
+    int num_iters = args.getTestIters();
+
+    int totalProcs, proc;
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &totalProcs);
+    MPI_Comm_rank(MPI_COMM_WORLD, &proc);
+    printf("I am %d of %d\n", proc, totalProcs);
+
+    struct flagcxBootstrapHandle handle;
+    bootstrapNetInit();
+    if (proc == 0)
+        bootstrapGetUniqueId(&handle);
+    MPI_Bcast((void *)&handle, sizeof(handle), MPI_BYTE, 0, MPI_COMM_WORLD);
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    static uint32_t abortFlag = 0;
+    struct bootstrapState *state = (struct bootstrapState *)calloc(1, sizeof(struct bootstrapState));
+    state->rank = proc;
+    state->nranks = totalProcs;
+    state->magic = handle.magic;
+    state->abortFlag = &abortFlag;
+    bootstrapInit(&handle, state);
+
+    // With an odd number of ranks the last one has no partner.
+    int peer = proc ^ 1;
+    bool active = peer < totalProcs;
+    const int tag = 0;
+
+    timer tim;
+    for (size_t size = min_bytes; size <= max_bytes; size *= step_factor) {
+        char *buff = (char *)malloc(size);
+        memset(buff, proc, size);
+
+        auto pingpong = [&](int iters) {
+            for (int i = 0; i < iters && active; i++) {
+                if (proc % 2 == 0) {
+                    bootstrapSend(state, peer, tag, buff, size);
+                    bootstrapRecv(state, peer, tag, buff, size);
+                } else {
+                    bootstrapRecv(state, peer, tag, buff, size);
+                    bootstrapSend(state, peer, tag, buff, size);
+                }
+            }
+        };
+
+        pingpong(num_warmup_iters);
+        MPI_Barrier(MPI_COMM_WORLD);
+
+        tim.reset();
+        pingpong(num_iters);
+        double elapsed_time = tim.elapsed() / num_iters / 2;
+        double bw = (double)(size) / 1.0E9 / elapsed_time;
+        if (proc == 0) {
+            printf("Comm size: %zu bytes; Latency: %lf us; Bandwidth: %lf GB/s\n", size, elapsed_time * 1e6, bw);
+        }
+
+        MPI_Barrier(MPI_COMM_WORLD);
+        free(buff);
+    }
+
+    bootstrapClose(state);
+
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,105 @@
+#include "mpi.h"
+#include "flagcx.h"
+#include "tools.h"
+#include <iostream>
+#include <cstring>
+
+// Checks every element received by the heterogeneous alltoall. Run with
+// FLAGCX_VENDOR listing two vendors to split the ranks into two clusters, and
+// with FLAGCX_C2C_ALLTOALL_AGG_THRESHOLD above the largest block (blocks
+// aggregated by the cluster inter ranks) and at 0 (blocks sent directly): both
+// paths have to deliver the same blocks.
+
+// Element i of the block rank src sends to rank dst, exact in fp32 for up to
+// 128 ranks.
+static float blockValue(int src, int dst, size_t i) {
+    return (float)(src * 65536 + dst * 256 + (int)(i % 256));
+}
+
+int main(int argc, char *argv[]){
+    parser args(argc, argv);
+    size_t min_bytes = args.getMinBytes();
+    size_t max_bytes = args.getMaxBytes();
+    int step_factor = args.getStepFactor();
+
+    int totalProcs, proc;
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &totalProcs);
+    MPI_Comm_rank(MPI_COMM_WORLD, &proc);
+    printf("I am %d of %d\n", proc, totalProcs);
+
+    flagcxHandlerGroup_t handler;
+    flagcxHandleInit(&handler);
+    flagcxUniqueId_t& uniqueId = handler->uniqueId;
+    flagcxComm_t& comm = handler->comm;
+    flagcxDeviceHandle_t& devHandle = handler->devHandle;
+
+    int nGpu;
+    devHandle->getDeviceCount(&nGpu);
+    devHandle->setDevice(proc % nGpu);
+
+    if (proc == 0)
+        flagcxGetUniqueId(&uniqueId);
+    MPI_Bcast((void *)uniqueId, sizeof(flagcxUniqueId), MPI_BYTE, 0, MPI_COMM_WORLD);
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    flagcxCommInitRank(&comm, totalProcs, uniqueId, proc);
+
+    flagcxStream_t stream;
+    devHandle->streamCreate(&stream);
+
+    int failures = 0;
+    for (size_t size = min_bytes; size <= max_bytes; size *= step_factor) {
+        size_t count = size / sizeof(float) / totalProcs;
+        if (count == 0)
+            continue;
+        size_t totalsize = count * totalProcs * sizeof(float);
+        void *sendbuff, *recvbuff, *hello;
+        devHandle->deviceMalloc(&sendbuff, totalsize, flagcxMemDevice, NULL);
+        devHandle->deviceMalloc(&recvbuff, totalsize, flagcxMemDevice, NULL);
+        devHandle->deviceMalloc(&hello, totalsize, flagcxMemHost, NULL);
+
+        for (int dst = 0; dst < totalProcs; dst++) {
+            for (size_t i = 0; i < count; i++) {
+                ((float *)hello)[dst * count + i] = blockValue(proc, dst, i);
+            }
+        }
+        devHandle->deviceMemcpy(sendbuff, hello, totalsize, flagcxMemcpyHostToDevice, NULL);
+        devHandle->deviceMemset(recvbuff, 0, totalsize, flagcxMemDevice, NULL);
+
+        flagcxAlltoAll(sendbuff, recvbuff, count, flagcxFloat, comm, stream);
+        devHandle->streamSynchronize(stream);
+
+        devHandle->deviceMemcpy(hello, recvbuff, totalsize, flagcxMemcpyDeviceToHost, NULL);
+        bool ok = true;
+        for (int src = 0; src < totalProcs && ok; src++) {
+            for (size_t i = 0; i < count; i++) {
+                float value = ((float *)hello)[src * count + i];
+                if (value != blockValue(src, proc, i)) {
+                    printf("FAILED: rank %d block size %zu: element %zu from rank %d is %f, expected %f\n",
+                           proc, count * sizeof(float), i, src, value, blockValue(src, proc, i));
+                    ok = false;
+                    failures++;
+                    break;
+                }
+            }
+        }
+
+        if (proc == 0) {
+            printf("Block size: %zu bytes; checked\n", count * sizeof(float));
+        }
+
+        devHandle->deviceFree(sendbuff, flagcxMemDevice, NULL);
+        devHandle->deviceFree(recvbuff, flagcxMemDevice, NULL);
+        devHandle->deviceFree(hello, flagcxMemHost, NULL);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &failures, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+
+    devHandle->streamDestroy(stream);
+    flagcxCommDestroy(comm);
+    flagcxHandleFree(handler);
+
+    MPI_Finalize();
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,119 @@
+#include "mpi.h"
+#include "flagcx.h"
+#include "tools.h"
+#include <iostream>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+// Results of the collectives compressing their inter-cluster transfers
+// (FLAGCX_C2C_COMPRESS) have to be the same bits on all ranks. Every rank
+// compares the allreduce and allgather results with the ones of rank 0, the
+// run fails on the first difference.
+
+// Index of the first element of buff differing from the one of rank 0, -1 if
+// none does.
+static long firstMismatch(float *buff, float *ref, size_t count, int proc) {
+    if (proc == 0) {
+        memcpy(ref, buff, count * sizeof(float));
+    }
+    MPI_Bcast(ref, count * sizeof(float), MPI_BYTE, 0, MPI_COMM_WORLD);
+    for (size_t i = 0; i < count; i++) {
+        if (memcmp(&buff[i], &ref[i], sizeof(float)) != 0) {
+            return (long)i;
+        }
+    }
+    return -1;
+}
+
+int main(int argc, char *argv[]){
+    parser args(argc, argv);
+    size_t min_bytes = args.getMinBytes();
+    size_t max_bytes = args.getMaxBytes();
+    int step_factor = args.getStepFactor();
+
+    int totalProcs, proc;
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &totalProcs);
+    MPI_Comm_rank(MPI_COMM_WORLD, &proc);
+    printf("I am %d of %d\n", proc, totalProcs);
+
+    flagcxHandlerGroup_t handler;
+    flagcxHandleInit(&handler);
+    flagcxUniqueId_t& uniqueId = handler->uniqueId;
+    flagcxComm_t& comm = handler->comm;
+    flagcxDeviceHandle_t& devHandle = handler->devHandle;
+
+    int nGpu;
+    devHandle->getDeviceCount(&nGpu);
+    devHandle->setDevice(proc % nGpu);
+
+    if (proc == 0)
+        flagcxGetUniqueId(&uniqueId);
+    MPI_Bcast((void *)uniqueId, sizeof(flagcxUniqueId), MPI_BYTE, 0, MPI_COMM_WORLD);
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    flagcxCommInitRank(&comm, totalProcs, uniqueId, proc);
+
+    flagcxStream_t stream;
+    devHandle->streamCreate(&stream);
+
+    // values spread over six orders of magnitude, different on every rank
+    std::mt19937 gen(1234 + proc);
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    std::uniform_real_distribution<float> magnitude(-3.0f, 3.0f);
+
+    int failures = 0;
+    for (size_t size = min_bytes; size <= max_bytes; size *= step_factor) {
+        size_t count = size / sizeof(float);
+        size_t gathersize = size * totalProcs;
+        void *sendbuff, *recvbuff, *hello;
+        devHandle->deviceMalloc(&sendbuff, size, flagcxMemDevice, NULL);
+        devHandle->deviceMalloc(&recvbuff, gathersize, flagcxMemDevice, NULL);
+        devHandle->deviceMalloc(&hello, gathersize, flagcxMemHost, NULL);
+        float *ref = new float[count * totalProcs];
+
+        for (size_t i = 0; i < count; i++) {
+            ((float *)hello)[i] = normal(gen) * std::pow(10.0f, magnitude(gen));
+        }
+        devHandle->deviceMemcpy(sendbuff, hello, size, flagcxMemcpyHostToDevice, NULL);
+
+        flagcxAllReduce(sendbuff, recvbuff, count, flagcxFloat, flagcxSum, comm, stream);
+        devHandle->streamSynchronize(stream);
+        devHandle->deviceMemcpy(hello, recvbuff, size, flagcxMemcpyDeviceToHost, NULL);
+        long mismatch = firstMismatch((float *)hello, ref, count, proc);
+        if (mismatch >= 0) {
+            printf("FAILED: rank %d size %zu: allreduce element %ld is %.9g, %.9g on rank 0\n",
+                   proc, size, mismatch, ((float *)hello)[mismatch], ref[mismatch]);
+            failures++;
+        }
+
+        flagcxAllGather(sendbuff, recvbuff, count, flagcxFloat, comm, stream);
+        devHandle->streamSynchronize(stream);
+        devHandle->deviceMemcpy(hello, recvbuff, gathersize, flagcxMemcpyDeviceToHost, NULL);
+        mismatch = firstMismatch((float *)hello, ref, count * totalProcs, proc);
+        if (mismatch >= 0) {
+            printf("FAILED: rank %d size %zu: allgather element %ld is %.9g, %.9g on rank 0\n",
+                   proc, size, mismatch, ((float *)hello)[mismatch], ref[mismatch]);
+            failures++;
+        }
+
+        if (proc == 0) {
+            printf("Comm size: %zu bytes; checked\n", size);
+        }
+
+        delete[] ref;
+        devHandle->deviceFree(sendbuff, flagcxMemDevice, NULL);
+        devHandle->deviceFree(recvbuff, flagcxMemDevice, NULL);
+        devHandle->deviceFree(hello, flagcxMemHost, NULL);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &failures, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+
+    devHandle->streamDestroy(stream);
+    flagcxCommDestroy(comm);
+    flagcxHandleFree(handler);
+
+    MPI_Finalize();
+    return failures > 0 ? 1 : 0;
+}
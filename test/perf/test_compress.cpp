@@ -0,0 +1,122 @@
+#include "compress.h"
+#include "tools.h"
+#include <iostream>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+// Error bounds and single-core throughput of the codecs of the inter-cluster
+// transfers (FLAGCX_C2C_COMPRESS). Every element decoded from the encoded
+// data is checked against the bound of its codec, and encoding the decoded
+// data again has to give back the same bits, the run fails on any violation.
+// Encode bandwidth counts the fp32 bytes consumed per second.
+
+// Largest error allowed on element x, amax being the largest magnitude of its
+// fp8 block.
+static double errorBound(flagcxCodec_t codec, double x, double amax) {
+    switch (codec) {
+    case flagcxCodecBf16:
+        // 8 significant bits, rounded to nearest
+        return std::ldexp(std::fabs(x), -8);
+    case flagcxCodecFp16:
+        // 11 significant bits, subnormals below 2^-14 are multiples of 2^-24
+        return std::fmax(std::ldexp(std::fabs(x), -11), std::ldexp(1.0, -25));
+    case flagcxCodecFp8: {
+        // 4 significant bits of x / scale, subnormals are multiples of 2^-9,
+        // the scale is the power of two at or above amax / 448
+        int exp;
+        double mant = std::frexp(amax / 448.0, &exp);
+        double scale = std::ldexp(1.0, mant == 0.5 ? exp - 1 : exp);
+        return std::fmax(std::ldexp(std::fabs(x), -4), std::ldexp(scale, -10)) * (1 + 1e-6);
+    }
+    default:
+        return 0;
+    }
+}
+
+int main(int argc, char *argv[]){
+    parser args(argc, argv);
+    size_t min_bytes = args.getMinBytes();
+    size_t max_bytes = args.getMaxBytes();
+    int step_factor = args.getStepFactor();
+    int num_warmup_iters = args.getWarmupIters();
+    int num_iters = args.getTestIters();
+
+    std::mt19937 gen(1234);
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    std::uniform_real_distribution<float> magnitude(-3.0f, 3.0f);
+
+    int failures = 0;
+    timer tim;
+    for (size_t size = min_bytes; size <= max_bytes; size *= step_factor) {
+        size_t count = size / sizeof(float);
+        std::vector<float> src(count), dst(count), again(count);
+        // values spread over six orders of magnitude, with runs of zeros
+        for (size_t i = 0; i < count; i++) {
+            src[i] = (i / 1000) % 7 == 3 ? 0.0f : normal(gen) * std::pow(10.0f, magnitude(gen));
+        }
+
+        for (int codec = flagcxCodecBf16; codec < flagcxCodecNum; codec++) {
+            flagcxCodec_t c = (flagcxCodec_t)codec;
+            size_t encoded_size = flagcxCodecEncodedSize(c, count);
+            std::vector<char> encoded(encoded_size);
+
+            for (int i = 0; i < num_warmup_iters; i++) {
+                flagcxCodecEncode(c, encoded.data(), src.data(), count);
+            }
+            tim.reset();
+            for (int i = 0; i < num_iters; i++) {
+                flagcxCodecEncode(c, encoded.data(), src.data(), count);
+            }
+            double encode_time = tim.elapsed() / num_iters;
+            tim.reset();
+            for (int i = 0; i < num_iters; i++) {
+                flagcxCodecDecode(c, dst.data(), encoded.data(), count);
+            }
+            double decode_time = tim.elapsed() / num_iters;
+
+            // decoded data is forwarded as is by the collectives
+            std::vector<char> reencoded(encoded_size);
+            flagcxCodecEncode(c, reencoded.data(), dst.data(), count);
+            flagcxCodecDecode(c, again.data(), reencoded.data(), count);
+            if (memcmp(again.data(), dst.data(), size) != 0) {
+                printf("FAILED: %s size %zu: decoded data changes when encoded again\n",
+                       flagcxCodecToString(c), size);
+                failures++;
+            }
+
+            double max_err = 0, max_ratio = 0;
+            for (size_t b = 0; b < count; b += FLAGCX_CODEC_FP8_BLOCK) {
+                size_t end = std::min(b + FLAGCX_CODEC_FP8_BLOCK, count);
+                double amax = 0;
+                for (size_t i = b; i < end; i++) {
+                    amax = std::fmax(amax, std::fabs((double)src[i]));
+                }
+                for (size_t i = b; i < end; i++) {
+                    double err = std::fabs((double)dst[i] - (double)src[i]);
+                    double bound = errorBound(c, src[i], amax);
+                    max_err = std::fmax(max_err, err);
+                    if (bound > 0) {
+                        max_ratio = std::fmax(max_ratio, err / bound);
+                    }
+                    if (err > bound) {
+                        if (failures++ < 10) {
+                            printf("FAILED: %s element %zu: %.9g decoded as %.9g, error %.3g > bound %.3g\n",
+                                   flagcxCodecToString(c), i, src[i], dst[i], err, bound);
+                        }
+                    }
+                }
+            }
+            printf("Codec size: %zu bytes; Codec: %s; Ratio: %.2fx; Max error: %.3g; Max error / bound: %.3f; Encode: %lf GB/s; Decode: %lf GB/s\n",
+                   size, flagcxCodecToString(c), (double)size / encoded_size, max_err, max_ratio,
+                   (double)size / 1.0E9 / encode_time, (double)size / 1.0E9 / decode_time);
+        }
+    }
+    if (failures > 0) {
+        printf("%d elements out of their error bound\n", failures);
+        return 1;
+    }
+    return 0;
+}
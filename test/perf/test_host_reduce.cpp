@@ -0,0 +1,93 @@
+#include "flagcx.h"
+#include "reduce_kernel.h"
+#include "tools.h"
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+
+// Single-core throughput of the host reduction kernels used by the bootstrap
+// collectives, for every instruction set the CPU supports, followed by the
+// default path (flagcxHostReduce), which also uses the reduction thread pool
+// when FLAGCX_HOST_REDUCE_THREADS is set. Bandwidth counts the bytes of one
+// operand reduced per second.
+
+struct reduceCase {
+    flagcxDataType_t dtype;
+    size_t typeSize;
+    const char *name;
+};
+
+int main(int argc, char *argv[]){
+    parser args(argc, argv);
+    size_t min_bytes = args.getMinBytes();
+    size_t max_bytes = args.getMaxBytes();
+    int step_factor = args.getStepFactor();
+    int num_warmup_iters = args.getWarmupIters();
+    int num_iters = args.getTestIters();
+
+    const reduceCase cases[] = {
+        {flagcxFloat, 4, "float32"},
+        {flagcxHalf, 2, "float16"},
+        {flagcxBfloat16, 2, "bfloat16"},
+        {flagcxDouble, 8, "float64"},
+        {flagcxInt32, 4, "int32"},
+    };
+    std::vector<flagcxReduceIsa_t> isas;
+    isas.push_back(flagcxReduceIsaScalar);
+    for (int isa = flagcxReduceIsaAvx2; isa < flagcxReduceIsaNum; isa++) {
+        if (flagcxHostReduceIsaSupported((flagcxReduceIsa_t)isa)) {
+            isas.push_back((flagcxReduceIsa_t)isa);
+        }
+    }
+    printf("Default host reduction ISA: %s\n", flagcxReduceIsaToString(flagcxHostReduceIsa()));
+
+    timer tim;
+    for (size_t size = min_bytes; size <= max_bytes; size *= step_factor) {
+        char *op1 = (char *)malloc(size);
+        char *op2 = (char *)malloc(size);
+        char *res = (char *)malloc(size);
+        for (size_t i = 0; i < size; i++) {
+            // small positive values, valid for every element type
+            op1[i] = (i % 2) ? 0x3c : (char)(i % 7);
+            op2[i] = (i % 2) ? 0x3c : (char)(i % 5);
+        }
+
+        for (const reduceCase &c : cases) {
+            size_t count = size / c.typeSize;
+            double scalar_bw = 0;
+            for (flagcxReduceIsa_t isa : isas) {
+                for (int i = 0; i < num_warmup_iters; i++) {
+                    flagcxHostReduceIsaRun(isa, res, op1, op2, count, c.dtype, flagcxSum);
+                }
+                tim.reset();
+                for (int i = 0; i < num_iters; i++) {
+                    flagcxHostReduceIsaRun(isa, res, op1, op2, count, c.dtype, flagcxSum);
+                }
+                double elapsed_time = tim.elapsed() / num_iters;
+                double bw = (double)(count * c.typeSize) / 1.0E9 / elapsed_time;
+                if (isa == flagcxReduceIsaScalar) {
+                    scalar_bw = bw;
+                }
+                printf("Reduce size: %zu bytes; Type: %s; ISA: %s; Elapsed time: %lf sec; Bandwidth: %lf GB/s; Speedup: %.2fx\n",
+                       size, c.name, flagcxReduceIsaToString(isa), elapsed_time, bw, bw / scalar_bw);
+            }
+            for (int i = 0; i < num_warmup_iters; i++) {
+                flagcxHostReduce(res, op1, op2, count, c.dtype, flagcxSum);
+            }
+            tim.reset();
+            for (int i = 0; i < num_iters; i++) {
+                flagcxHostReduce(res, op1, op2, count, c.dtype, flagcxSum);
+            }
+            double elapsed_time = tim.elapsed() / num_iters;
+            double bw = (double)(count * c.typeSize) / 1.0E9 / elapsed_time;
+            printf("Reduce size: %zu bytes; Type: %s; ISA: default; Elapsed time: %lf sec; Bandwidth: %lf GB/s; Speedup: %.2fx\n",
+                   size, c.name, elapsed_time, bw, bw / scalar_bw);
+        }
+
+        free(op1);
+        free(op2);
+        free(res);
+    }
+    return 0;
+}